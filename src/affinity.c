@@ -0,0 +1,387 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+
+#define SYS_CPU_DIR "/sys/devices/system/cpu/"
+
+/* Defines where a CPU sits in the topology */
+typedef struct _cpu_info_t {
+	int cpu;		//The CPU's number
+	int node;		//NUMA node it's on
+	int package;	//Socket it's on
+	int core;		//Core it's part of
+	int smt;		//Which of its core's hardware threads it is (0 is the first)
+} cpu_info_t;
+
+/* Static function prototypes */
+
+/*
+ * Parses a CPU list like 0-3,8 (the format of -cpus and /sys).
+ * Params: str - the list.
+ *         set - where to put the CPUs.
+ * Returns: 0 if the list made sense; a nonzero value otherwise.
+ */
+static int parse_cpu_list(char *str, cpu_set_t *set);
+
+/*
+ * Reads a single integer from a file under SYS_CPU_DIR.
+ * Params: cpu - the CPU the file is about.
+ *         file - the file, relative to the CPU's directory.
+ * Returns: the integer, or 0 if the file isn't there.
+ */
+static int read_cpu_int(int cpu, char *file);
+
+/*
+ * Finds a CPU's NUMA node from the node link in its directory.
+ * Params: cpu - the CPU.
+ * Returns: the node, or 0 if the system doesn't have NUMA.
+ */
+static int cpu_node(int cpu);
+
+/*
+ * Works out which of its core's hardware threads a CPU is.
+ * Params: cpu - the CPU.
+ * Returns: the number of the core's CPUs that come before this one.
+ */
+static int cpu_smt(int cpu);
+
+/*
+ * Takes a rank's share of the CPUs: its slice of the cores, with each core's
+ * hardware threads kept together, so no two ranks share a core unless there
+ * are more ranks than cores. Fills in share and share_len.
+ * Params: cpus - every CPU, sorted with compare_cores().
+ *         n - the number of CPUs.
+ *         slot - the rank's slot among the ranks on this host.
+ *         slots - the number of ranks on this host.
+ * Returns: nothing
+ */
+static void take_share(cpu_info_t *cpus, int n, int slot, int slots);
+
+/*
+ * Compares two CPUs by node, socket, core and then hardware thread, for
+ * qsort(), so every core's hardware threads are next to each other.
+ * Params: a - the first CPU.
+ *         b - the second CPU.
+ * Returns: a negative, zero or positive value if a comes before, with or after
+ *          b.
+ */
+static int compare_cores(const void *a, const void *b);
+
+/*
+ * Compares two CPUs by node, socket, hardware thread and then core, for
+ * qsort(), so spreading threads along the list fills every core once before
+ * doubling up.
+ * Params: a - the first CPU.
+ *         b - the second CPU.
+ * Returns: a negative, zero or positive value if a comes before, with or after
+ *          b.
+ */
+static int compare_cpus(const void *a, const void *b);
+
+/* affinity.h extern variables */
+int bind_mode = BIND_NONE;
+char *bind_cpus = NULL;
+
+/* Static variables */
+static cpu_info_t *share = NULL;		//Our CPUs, in the order threads are given them
+static int share_len = 0;				//Number of CPUs in share
+
+int affinity_init(int slot, int slots)
+{
+	if(bind_mode == BIND_NONE)
+		return 0;
+	
+	//Start with every CPU we're allowed on, narrowed down to the ones we were given
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed))
+		return 1;
+	
+	if(bind_cpus != NULL)
+	{
+		cpu_set_t given;
+		
+		if(parse_cpu_list(bind_cpus, &given))
+			return 1;
+		
+		CPU_AND(&allowed, &allowed, &given);
+	}
+	
+	int count = CPU_COUNT(&allowed);
+	
+	if(count == 0)
+		return 1;
+	
+	//Order them by where they sit in the topology, and take our share of the cores
+	cpu_info_t *cpus = malloc(sizeof(cpu_info_t) * count);
+	int n = 0;
+	
+	for(int cpu = 0; cpu < CPU_SETSIZE && n < count; cpu++)
+	{
+		if(!CPU_ISSET(cpu, &allowed))
+			continue;
+		
+		cpus[n].cpu = cpu;
+		cpus[n].node = cpu_node(cpu);
+		cpus[n].package = read_cpu_int(cpu, "topology/physical_package_id");
+		cpus[n].core = read_cpu_int(cpu, "topology/core_id");
+		cpus[n].smt = cpu_smt(cpu);
+		n++;
+	}
+	
+	qsort(cpus, n, sizeof(cpu_info_t), compare_cores);
+	take_share(cpus, n, slot, slots);
+	free(cpus);
+	
+	//Then have threads fill every core of our share once before doubling up
+	qsort(share, share_len, sizeof(cpu_info_t), compare_cpus);
+	return 0;
+}
+
+void affinity_bind(int index)
+{
+	if(share == NULL)
+		return;
+	
+	cpu_info_t *mine = &(share[index % share_len]);
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	
+	//Either just our CPU, or every CPU of our share on its node
+	for(int i = 0; i < share_len; i++)
+		if(share[i].cpu == mine->cpu || (bind_mode == BIND_NUMA && share[i].node == mine->node))
+			CPU_SET(share[i].cpu, &mask);
+	
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+}
+
+int affinity_domain_mask(cpu_set_t *mask)
+{
+	if(share == NULL)
+		return 1;
+	
+	//Find the node we're running on; if it isn't one of ours, the whole share will do
+	int node = cpu_node(sched_getcpu());
+	int found = 0;
+	CPU_ZERO(mask);
+	
+	for(int i = 0; i < share_len; i++)
+	{
+		if(share[i].node == node)
+		{
+			CPU_SET(share[i].cpu, mask);
+			found = 1;
+		}
+	}
+	
+	if(!found)
+		for(int i = 0; i < share_len; i++)
+			CPU_SET(share[i].cpu, mask);
+	
+	return 0;
+}
+
+void affinity_print(int id)
+{
+	if(share == NULL)
+		return;
+	
+	printf("%d IS BOUND TO CPUS:", id);
+	
+	for(int i = 0; i < share_len; i++)
+		printf(" %d (node %d)", share[i].cpu, share[i].node);
+	
+	printf("\n");
+}
+
+void affinity_cleanup()
+{
+	free(share);
+	share = NULL;
+	share_len = 0;
+}
+
+static int parse_cpu_list(char *str, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+	char *pos = str;
+	
+	//Each comma-separated piece is either a CPU or a range of them
+	while(*pos != '\0' && *pos != '\n')
+	{
+		char *end;
+		long first = strtol(pos, &end, 10), last = first;
+		
+		if(end == pos || first < 0)
+			return 1;
+		
+		if(*end == '-')
+		{
+			pos = end + 1;
+			last = strtol(pos, &end, 10);
+			
+			if(end == pos || last < first)
+				return 1;
+		}
+		
+		for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, set);
+		
+		pos = (*end == ',') ? end + 1 : end;
+		
+		if(*end != ',' && *end != '\0' && *end != '\n')
+			return 1;
+	}
+	
+	return CPU_COUNT(set) == 0;
+}
+
+static int read_cpu_int(int cpu, char *file)
+{
+	char path[128];
+	snprintf(path, sizeof(path), SYS_CPU_DIR "cpu%d/%s", cpu, file);
+	
+	FILE *f = fopen(path, "r");
+	int value = 0;
+	
+	if(f != NULL)
+	{
+		if(fscanf(f, "%d", &value) != 1)
+			value = 0;
+		
+		fclose(f);
+	}
+	
+	return value;
+}
+
+static int cpu_node(int cpu)
+{
+	char path[128];
+	snprintf(path, sizeof(path), SYS_CPU_DIR "cpu%d", cpu);
+	
+	DIR *dir = opendir(path);
+	int node = 0;
+	
+	if(dir == NULL)
+		return 0;
+	
+	//The CPU's directory has a link named node<N> to its node
+	struct dirent *entry;
+	
+	while((entry = readdir(dir)) != NULL)
+		if(sscanf(entry->d_name, "node%d", &node) == 1)
+			break;
+	
+	closedir(dir);
+	return (entry != NULL) ? node : 0;
+}
+
+static int cpu_smt(int cpu)
+{
+	char path[128], list[256];
+	snprintf(path, sizeof(path), SYS_CPU_DIR "cpu%d/topology/thread_siblings_list", cpu);
+	
+	FILE *f = fopen(path, "r");
+	
+	if(f == NULL)
+		return 0;
+	
+	char *line = fgets(list, sizeof(list), f);
+	fclose(f);
+	
+	cpu_set_t siblings;
+	
+	if(line == NULL || parse_cpu_list(list, &siblings))
+		return 0;
+	
+	int smt = 0;
+	
+	for(int i = 0; i < cpu; i++)
+		if(CPU_ISSET(i, &siblings))
+			smt++;
+	
+	return smt;
+}
+
+static void take_share(cpu_info_t *cpus, int n, int slot, int slots)
+{
+	//Find where each core starts
+	int *starts = malloc(sizeof(int) * (n + 1));
+	int cores = 0;
+	
+	for(int i = 0; i < n; i++)
+		if(i == 0 || cpus[i].node != cpus[i - 1].node || cpus[i].package != cpus[i - 1].package || cpus[i].core != cpus[i - 1].core)
+			starts[cores++] = i;
+	
+	starts[cores] = n;
+	int first, last;
+	
+	if(cores >= slots)
+	{
+		//Take our slice of the cores
+		first = starts[(long long) slot * cores / slots];
+		last = starts[(long long) (slot + 1) * cores / slots];
+	}
+	else
+	{
+		//If there are more of us than cores, spread us over them, splitting each core's hardware threads between the
+		//ranks on it (or sharing one if there are more of those than hardware threads)
+		int core = (int) ((long long) slot * cores / slots);
+		int core_first = (int) (((long long) core * slots + cores - 1) / cores);
+		int core_slots = (int) (((long long) (core + 1) * slots + cores - 1) / cores) - core_first;
+		int threads = starts[core + 1] - starts[core], index = slot - core_first;
+		
+		first = starts[core] + ((threads >= core_slots) ? index * threads / core_slots : index % threads);
+		last = starts[core] + ((threads >= core_slots) ? (index + 1) * threads / core_slots : index % threads + 1);
+	}
+	
+	share_len = last - first;
+	share = malloc(sizeof(cpu_info_t) * share_len);
+	memcpy(share, cpus + first, sizeof(cpu_info_t) * share_len);
+	free(starts);
+}
+
+static int compare_cores(const void *a, const void *b)
+{
+	const cpu_info_t *ca = a, *cb = b;
+	
+	if(ca->node != cb->node)
+		return ca->node - cb->node;
+	
+	if(ca->package != cb->package)
+		return ca->package - cb->package;
+	
+	if(ca->core != cb->core)
+		return ca->core - cb->core;
+	
+	if(ca->smt != cb->smt)
+		return ca->smt - cb->smt;
+	
+	return ca->cpu - cb->cpu;
+}
+
+static int compare_cpus(const void *a, const void *b)
+{
+	const cpu_info_t *ca = a, *cb = b;
+	
+	if(ca->node != cb->node)
+		return ca->node - cb->node;
+	
+	if(ca->package != cb->package)
+		return ca->package - cb->package;
+	
+	if(ca->smt != cb->smt)
+		return ca->smt - cb->smt;
+	
+	if(ca->core != cb->core)
+		return ca->core - cb->core;
+	
+	return ca->cpu - cb->cpu;
+}
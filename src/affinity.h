@@ -0,0 +1,79 @@
+#ifndef AFFINITY_H_INCLUDED
+#define AFFINITY_H_INCLUDED
+
+#include <sched.h>
+
+/*
+ * With -bind, every thread that touches file data is pinned, so it stays near
+ * the memory it reads into. The cores we're allowed to run on (or the ones
+ * given with -cpus) are ordered by NUMA node, then socket; the ranks on a host
+ * split them evenly, each core with all of its hardware threads, so each rank
+ * gets its own cores and, where there are enough ranks, its own NUMA node. Only
+ * if there are more ranks than cores do ranks share one, splitting its hardware
+ * threads between them. Within a rank's share, the second hardware thread of
+ * every core comes after the first.
+ *
+ * Each thread then binds itself, before it touches anything, to one CPU of its
+ * rank's share: index 0 is the communication threads (dispatch, receive and
+ * archive), and the process thread or worker i is index i. With -bind core, a
+ * thread stays on that CPU; with -bind numa, it can move between the CPUs of
+ * its share on that CPU's NUMA node. Either way, the buffers a thread reads
+ * files into are first touched by that thread, so they end up on its node.
+ *
+ * If the launcher already bound each rank (mpirun does by default), the share
+ * is taken from what it gave us, so ranks still don't overlap.
+ */
+
+/* Binding modes */
+enum {
+	BIND_NONE,		//Threads go wherever the OS puts them
+	BIND_CORE,		//Each thread is pinned to a single CPU
+	BIND_NUMA		//Each thread is pinned to the NUMA node of its CPU
+};
+
+/* affinity.h extern variables */
+extern int bind_mode;			//How threads are pinned
+extern char *bind_cpus;			//CPUs to use, as a list like 0-3,8, or NULL for every CPU we're allowed
+
+/* Affinity functions */
+
+/*
+ * Reads the CPU topology and works out which CPUs are ours. Call before
+ * creating any threads. Does nothing if bind_mode is BIND_NONE.
+ * Params: slot - our index among the processes on this host.
+ *         slots - the number of processes on this host.
+ * Returns: 0 if we know our CPUs; a nonzero value if there aren't any.
+ */
+int affinity_init(int slot, int slots);
+
+/*
+ * Pins the calling thread to CPU number index of our share (wrapping around if
+ * there aren't enough). Does nothing if bind_mode is BIND_NONE.
+ * Params: index - 0 for a communication thread; the worker's number otherwise.
+ * Returns: nothing
+ */
+void affinity_bind(int index);
+
+/*
+ * Gets the CPUs of our share that are on the calling thread's NUMA node, for
+ * helper threads that work on the calling thread's buffers.
+ * Params: mask - where to put the CPUs.
+ * Returns: 0 if mask was set; a nonzero value if threads aren't being pinned.
+ */
+int affinity_domain_mask(cpu_set_t *mask);
+
+/*
+ * Prints which CPUs are ours, for checking the placement.
+ * Params: id - the rank doing the printing.
+ * Returns: nothing
+ */
+void affinity_print(int id);
+
+/*
+ * Frees the topology. Call once every pinned thread has been joined.
+ * Params: nothing
+ * Returns: nothing
+ */
+void affinity_cleanup();
+
+#endif //AFFINITY_H_INCLUDED
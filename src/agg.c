@@ -0,0 +1,252 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agg.h"
+#include "query.h"
+
+#define AGG_INITIAL_CAP 64		//Entries a table starts out with
+
+/* Defines one thread's table in a list of every thread's tables */
+typedef struct _thread_agg_t {
+	agg_table_t table;
+	struct _thread_agg_t *next;
+} thread_agg_t;
+
+/* Static function prototypes */
+
+/*
+ * Finds a group's entry in a table, adding an empty one if it isn't there.
+ * Grows the table first if it's getting full.
+ * Params: table - the table.
+ *         sensor - the group's sensor.
+ *         bucket - the start of the group's time bucket.
+ * Returns: the group's entry.
+ */
+static agg_entry_t* find_group(agg_table_t *table, int32_t sensor, int64_t bucket);
+
+/*
+ * Merges one group's aggregates into another's.
+ * Params: to - the group to merge into.
+ *         from - the group to merge.
+ * Returns: nothing
+ */
+static void merge_group(agg_entry_t *to, agg_entry_t *from);
+
+/*
+ * Compares two groups by sensor and then bucket, for qsort().
+ * Params: a - the first group.
+ *         b - the second group.
+ * Returns: a negative, zero or positive value if a comes before, with or after
+ *          b.
+ */
+static int compare_groups(const void *a, const void *b);
+
+/* agg.h extern variables */
+char *agg_key = NULL;
+int agg_bucket = AGG_DEFAULT_BUCKET;
+
+/* Static variables */
+static int value_slot = -1;								//Slot the query records agg_key's value in
+static __thread thread_agg_t *local_agg = NULL;			//This thread's table
+static thread_agg_t *all_aggs = NULL;					//Every thread's table
+static pthread_mutex_t aggs_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects all_aggs
+
+int agg_init()
+{
+	//Without a -where query, every file with the search key counts
+	if(search_query == NULL)
+		search_query = query_compile("", NULL, 0);
+	
+	value_slot = query_add_key(search_query, agg_key, strlen(agg_key));
+	return value_slot < 0;
+}
+
+int agg_value_slot()
+{
+	return value_slot;
+}
+
+void agg_add_value(char *filename, char *value, int len)
+{
+	//Only whole numbers can be aggregated
+	char num_str[32];
+	
+	if(len <= 0 || len >= (int) sizeof(num_str))
+		return;
+	
+	memcpy(num_str, value, len);
+	num_str[len] = '\0';
+	
+	char *end;
+	int64_t num = strtoll(num_str, &end, 10);
+	
+	if(*end != '\0')
+		return;
+	
+	//The group comes from the file's name, <sensor>_<timestamp>.sen, minus any directory or segment
+	char *name = filename, *sep;
+	
+	if((sep = strrchr(name, '/')) != NULL)
+		name = sep + 1;
+	
+	if((sep = strrchr(name, ':')) != NULL)
+		name = sep + 1;
+	
+	char *underscore = strchr(name, '_');
+	int64_t time = (underscore != NULL) ? atoll(underscore + 1) : 0;
+	
+	//If this is the first time this thread has aggregated anything, give it its own table
+	if(local_agg == NULL)
+	{
+		local_agg = malloc(sizeof(thread_agg_t));
+		agg_init_table(&(local_agg->table));
+		
+		pthread_mutex_lock(&aggs_mutex);
+		local_agg->next = all_aggs;
+		all_aggs = local_agg;
+		pthread_mutex_unlock(&aggs_mutex);
+	}
+	
+	agg_entry_t value_group = { 0, 0, 1, 1, num, num, (double) num };
+	merge_group(find_group(&(local_agg->table), atoi(name), time - time % agg_bucket), &value_group);
+}
+
+void agg_init_table(agg_table_t *table)
+{
+	table->cap = AGG_INITIAL_CAP;
+	table->size = 0;
+	table->entries = calloc(table->cap, sizeof(agg_entry_t));
+}
+
+void agg_free_table(agg_table_t *table)
+{
+	free(table->entries);
+	table->entries = NULL;
+	table->cap = table->size = 0;
+}
+
+void agg_merge_threads(agg_table_t *table)
+{
+	pthread_mutex_lock(&aggs_mutex);
+	
+	for(thread_agg_t *t = all_aggs; t != NULL; t = t->next)
+		for(uint32_t i = 0; i < t->table.cap; i++)
+			if(t->table.entries[i].used)
+				merge_group(find_group(table, t->table.entries[i].sensor, t->table.entries[i].bucket), &(t->table.entries[i]));
+	
+	pthread_mutex_unlock(&aggs_mutex);
+}
+
+void agg_merge_entries(agg_table_t *table, agg_entry_t *entries, int count)
+{
+	for(int i = 0; i < count; i++)
+		merge_group(find_group(table, entries[i].sensor, entries[i].bucket), &(entries[i]));
+}
+
+agg_entry_t* agg_pack(agg_table_t *table, int *count)
+{
+	agg_entry_t *packed = malloc(sizeof(agg_entry_t) * (table->size + 1));	//+ 1 so an empty table still gets a buffer
+	*count = 0;
+	
+	for(uint32_t i = 0; i < table->cap; i++)
+		if(table->entries[i].used)
+			packed[(*count)++] = table->entries[i];
+	
+	qsort(packed, *count, sizeof(agg_entry_t), compare_groups);
+	return packed;
+}
+
+void agg_write(FILE *file, agg_table_t *table)
+{
+	int count;
+	agg_entry_t *groups = agg_pack(table, &count);
+	
+	fprintf(file, "AGGREGATES OF %s PER SENSOR PER %d SECONDS:\n", agg_key, agg_bucket);
+	fprintf(file, "sensor,bucket,count,sum,min,max\n");
+	
+	for(int i = 0; i < count; i++)
+		fprintf(file, "%d,%lld,%lld,%.17g,%lld,%lld\n", groups[i].sensor, (long long) groups[i].bucket, (long long) groups[i].count,
+			groups[i].sum, (long long) groups[i].min, (long long) groups[i].max);
+	
+	free(groups);
+}
+
+void agg_cleanup()
+{
+	pthread_mutex_lock(&aggs_mutex);
+	
+	while(all_aggs != NULL)
+	{
+		thread_agg_t *next = all_aggs->next;
+		agg_free_table(&(all_aggs->table));
+		free(all_aggs);
+		all_aggs = next;
+	}
+	
+	pthread_mutex_unlock(&aggs_mutex);
+	local_agg = NULL;
+}
+
+static agg_entry_t* find_group(agg_table_t *table, int32_t sensor, int64_t bucket)
+{
+	//Keep the table under 70% full so probes stay short
+	if((table->size + 1) * 10 > table->cap * 7)
+	{
+		agg_table_t bigger;
+		bigger.cap = table->cap * 2;
+		bigger.size = 0;
+		bigger.entries = calloc(bigger.cap, sizeof(agg_entry_t));
+		
+		for(uint32_t i = 0; i < table->cap; i++)
+			if(table->entries[i].used)
+				*find_group(&bigger, table->entries[i].sensor, table->entries[i].bucket) = table->entries[i];
+		
+		free(table->entries);
+		*table = bigger;
+	}
+	
+	//Mix the sensor and bucket together, then probe from there
+	uint64_t hash = (uint64_t) bucket * 0x9e3779b97f4a7c15ULL ^ (uint64_t) (uint32_t) sensor;
+	hash = (hash ^ (hash >> 31)) * 0xbf58476d1ce4e5b9ULL;
+	uint32_t i = (uint32_t) (hash ^ (hash >> 29)) & (table->cap - 1);
+	
+	while(table->entries[i].used && (table->entries[i].sensor != sensor || table->entries[i].bucket != bucket))
+		i = (i + 1) & (table->cap - 1);
+	
+	if(!table->entries[i].used)
+	{
+		agg_entry_t *entry = &(table->entries[i]);
+		entry->sensor = sensor;
+		entry->bucket = bucket;
+		entry->used = 1;
+		table->size++;
+	}
+	
+	return &(table->entries[i]);
+}
+
+static void merge_group(agg_entry_t *to, agg_entry_t *from)
+{
+	if(from->count == 0)
+		return;
+	
+	if(to->count == 0 || from->min < to->min)
+		to->min = from->min;
+	
+	if(to->count == 0 || from->max > to->max)
+		to->max = from->max;
+	
+	to->count += from->count;
+	to->sum += from->sum;
+}
+
+static int compare_groups(const void *a, const void *b)
+{
+	const agg_entry_t *ga = a, *gb = b;
+	
+	if(ga->sensor != gb->sensor)
+		return (ga->sensor > gb->sensor) - (ga->sensor < gb->sensor);
+	
+	return (ga->bucket > gb->bucket) - (ga->bucket < gb->bucket);
+}
@@ -0,0 +1,125 @@
+#ifndef AGG_H_INCLUDED
+#define AGG_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * In aggregation mode (-agg <key>), every file that matches adds the value
+ * of <key> to its group instead of being printed. A file's group is its
+ * sensor and the time bucket its timestamp falls in, both taken from its
+ * name (<sensor>_<timestamp>.sen). Each group keeps the count, sum, min and
+ * max of its values, so memory grows with the number of groups rather than
+ * the number of files.
+ *
+ * Each thread aggregates into its own hash table. When processing is done,
+ * the tables are merged on each rank and then across ranks, and the central
+ * machine prints the final table.
+ */
+
+#define AGG_DEFAULT_BUCKET 3600	//Default width of a time bucket, in seconds
+
+/* Defines the aggregates of a single group */
+typedef struct _agg_entry_t {
+	int64_t bucket;				//Start of the group's time bucket, in seconds since the epoch
+	int32_t sensor;				//The group's sensor
+	int32_t used;				//1 if this entry of a table holds a group; 0 if it's empty
+	int64_t count;				//Number of values added
+	int64_t min;				//Smallest value added
+	int64_t max;				//Largest value added
+	double sum;					//Sum of the values added (a double, since 63-bit values overflow)
+} agg_entry_t;
+
+/* Defines a hash table of groups, keyed on sensor and bucket */
+typedef struct _agg_table_t {
+	agg_entry_t *entries;		//The table, open addressed with linear probing
+	uint32_t cap;				//Number of entries allocated, always a power of two
+	uint32_t size;				//Number of groups
+} agg_table_t;
+
+/* agg.h extern variables */
+extern char *agg_key;			//Key whose values are aggregated, or NULL if we're not aggregating
+extern int agg_bucket;			//Width of a time bucket, in seconds
+
+/* Aggregation functions */
+
+/*
+ * Starts aggregating, making sure the query records agg_key's value as each
+ * file is scanned. Call once agg_key and any -where query are set.
+ * Params: nothing
+ * Returns: 0 on success; nonzero if the query can't record another key.
+ */
+int agg_init();
+
+/*
+ * Gets the slot the query records agg_key's value in.
+ * Params: nothing
+ * Returns: the slot.
+ */
+int agg_value_slot();
+
+/*
+ * Adds a value to a file's group, in this thread's table.
+ * Params: filename - the file (or "<segment>:<record>"), with or without its
+ *         directory.
+ *         value - the value, not null-terminated.
+ *         len - the length of the value.
+ * Returns: nothing
+ */
+void agg_add_value(char *filename, char *value, int len);
+
+/*
+ * Initializes an empty table.
+ * Params: table - the table.
+ * Returns: nothing
+ */
+void agg_init_table(agg_table_t *table);
+
+/*
+ * Frees a table's entries.
+ * Params: table - the table.
+ * Returns: nothing
+ */
+void agg_free_table(agg_table_t *table);
+
+/*
+ * Merges the tables of every thread in this process.
+ * Params: table - an initialized table to merge into.
+ * Returns: nothing
+ */
+void agg_merge_threads(agg_table_t *table);
+
+/*
+ * Merges a packed array of groups (e.g. from another rank) into a table.
+ * Params: table - the table.
+ *         entries - the groups.
+ *         count - the number of groups.
+ * Returns: nothing
+ */
+void agg_merge_entries(agg_table_t *table, agg_entry_t *entries, int count);
+
+/*
+ * Packs a table's groups into an array, sorted by sensor and then bucket.
+ * Params: table - the table.
+ *         count - a single int buffer that will contain the number of groups
+ *         on return.
+ * Returns: a malloc()'d array of the groups.
+ */
+agg_entry_t* agg_pack(agg_table_t *table, int *count);
+
+/*
+ * Writes a table as CSV, sorted by sensor and then bucket.
+ * Params: file - the file to write to.
+ *         table - the table.
+ * Returns: nothing
+ */
+void agg_write(FILE *file, agg_table_t *table);
+
+/*
+ * Frees every thread's table.
+ * Params: nothing
+ * Returns: nothing
+ */
+void agg_cleanup();
+
+#endif //AGG_H_INCLUDED
@@ -0,0 +1,103 @@
+#!/bin/sh
+# bench.sh
+# MATH 4777 Project benchmark suite
+#
+# Generates fixed-seed corpora with filegen, then runs fsch once for every
+# corpus, scheduling algorithm, priority option and rank count, moving the
+# archive back into the input directory between runs so every run sees the
+# same files. Results are written as CSV and JSON.
+#
+# Everything can be overridden from the environment, e.g.
+#   BENCH_FILES=100000 BENCH_RANKS="3 5 9" make bench
+
+BENCH_FILES=${BENCH_FILES:-20000}					# Files per corpus
+BENCH_SEED=${BENCH_SEED:-4777}						# Seed for filegen
+BENCH_TIME=${BENCH_TIME:-1500000000}				# Time the newest file was written
+BENCH_KEY=${BENCH_KEY:-threatlevel}				# Search key
+BENCH_RANKS=${BENCH_RANKS:-"2 3 5"}				# Rank counts (including the central rank)
+BENCH_SCHEDS=${BENCH_SCHEDS:-"-c -b -r -qs -ql"}	# Scheduling algorithms
+BENCH_PRIOS=${BENCH_PRIOS:-"-n -op"}				# Priority options
+BENCH_CORPORA=${BENCH_CORPORA:-"small pareto"}		# Corpora to generate (see gen_corpus)
+BENCH_DIR=${BENCH_DIR:-bench_data}					# Where corpora and archives live
+BENCH_OUT=${BENCH_OUT:-bench_results}				# Results go to $BENCH_OUT.csv and $BENCH_OUT.json
+MPIRUN=${MPIRUN:-mpirun}							# MPI launcher
+MPIRUN_FLAGS=${MPIRUN_FLAGS:-"--oversubscribe"}	# Extra launcher flags
+
+set -e
+
+# Generates a corpus into $BENCH_DIR/<name>/input.
+# Params: $1 - the name of the corpus.
+gen_corpus()
+{
+	case "$1" in
+		small)	opts="-s 0.1 -g 0.1" ;;
+		pareto)	opts="-s 0.1 -g 0.1 -size 4096 -sd pareto" ;;
+		*)		echo "Unknown corpus $1" >&2; exit 1 ;;
+	esac
+
+	rm -rf "$BENCH_DIR/$1"
+	mkdir -p "$BENCH_DIR/$1/input" "$BENCH_DIR/$1/archive"
+	./filegen "$BENCH_FILES" "$BENCH_DIR/$1/input" -seed "$BENCH_SEED" -time "$BENCH_TIME" $opts > /dev/null
+}
+
+# Moves everything in a corpus's archive back into its input directory.
+# Params: $1 - the name of the corpus.
+reset_archive()
+{
+	find "$BENCH_DIR/$1/archive" -name '*.sen' -exec mv -t "$BENCH_DIR/$1/input" {} +
+}
+
+mkdir -p "$BENCH_DIR"
+echo "corpus,ranks,sched,priority,seconds,files,bytes,files_per_sec,bytes_per_sec,min_node_bytes,max_node_bytes,imbalance" > "$BENCH_OUT.csv"
+
+for corpus in $BENCH_CORPORA
+do
+	gen_corpus "$corpus"
+
+	for ranks in $BENCH_RANKS
+	do
+		for sched in $BENCH_SCHEDS
+		do
+			for prio in $BENCH_PRIOS
+			do
+				reset_archive "$corpus"
+				log="$BENCH_DIR/$corpus-$ranks$sched$prio.log"
+				$MPIRUN $MPIRUN_FLAGS -np "$ranks" ./fsch "$BENCH_DIR/$corpus/input" "$BENCH_DIR/$corpus/archive" "$BENCH_KEY" $sched $prio > "$log" 2>&1
+
+				# Imbalance is the busiest node's bytes over the mean node's bytes, minus one
+				awk -v corpus="$corpus" -v ranks="$ranks" -v sched="$sched" -v prio="$prio" '
+					/^TOTAL RUNTIME:/ { seconds = $3 }
+					/^NODE [0-9]+ PROCESSED:/ {
+						f = $4; b = $6
+						files += f; bytes += b; nodes++
+						if(nodes == 1 || b < min) min = b
+						if(nodes == 1 || b > max) max = b
+					}
+					END {
+						mean = (nodes > 0) ? bytes / nodes : 0
+						printf "%s,%d,%s,%s,%f,%d,%d,%f,%f,%d,%d,%f\n", corpus, ranks, sched, prio, seconds, files, bytes,
+							(seconds > 0) ? files / seconds : 0, (seconds > 0) ? bytes / seconds : 0,
+							min, max, (mean > 0) ? max / mean - 1 : 0
+					}' "$log" | tee -a "$BENCH_OUT.csv"
+			done
+		done
+	done
+
+	reset_archive "$corpus"
+done
+
+# Turn the CSV into a JSON array of objects
+awk -F, '
+	NR == 1 { for(i = 1; i <= NF; i++) name[i] = $i; n = NF; print "["; next }
+	{
+		printf "%s  {", (NR > 2) ? ",\n" : ""
+		for(i = 1; i <= n; i++)
+		{
+			quote = (i == 1 || i == 3 || i == 4) ? "\"" : ""
+			printf "%s\"%s\": %s%s%s", (i > 1) ? ", " : "", name[i], quote, $i, quote
+		}
+		printf "}"
+	}
+	END { print "\n]" }' "$BENCH_OUT.csv" > "$BENCH_OUT.json"
+
+echo "Wrote $BENCH_OUT.csv and $BENCH_OUT.json"
@@ -1,11 +1,15 @@
-#include <dirent.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "affinity.h"
 #include "central.h"
+#include "shmq.h"
+#include "timing.h"
+#include "trace.h"
 #include "univ.h"
+#include "walk.h"
 
 /* Static function prototypes */
 
@@ -17,59 +21,18 @@
  */
 static void* archive_thread_func(void *nothing);
 
-/*
- * Helper function to find the next best processor if we're using cyclic
- * distribution.
- * Params: nothing
- * Returns: the rank of the next best processor to send to according to cyclic
- *          distribution.
- */
-static int get_best_proc_cyclic();
-
-/*
- * Helper function to find the next best processor if we're using block
- * distribution.
- * Params: nothing
- * Returns: the rank of the next best processor to send to according to block
- *          distribution.
- */
-static int get_best_proc_block();
-
-/*
- * Helper function to find the next best processor if we're using random
- * distribution. Inline because it's just a one-liner.
- * Params: nothing
- * Returns: the rank of the next best processor to send to according to
- *          random distribution.
- */
-static inline int get_best_proc_random();
-
-/*
- * Helper function to find the next best processor if we're using a scheduling
- * method that requires node data.
- * Params: nothing
- * Returns: the rank of the next best processor to send to according to the
- *          scheduling method we're using that requires queue data.
- */
-static int get_best_proc_queue_data();
-
 /* central.h extern variables */
-int *node_stats;
-file_queue_t *all_files;
-int file_count;
 pthread_t archive_thread;
-int files_per_proc = 1;
-
-/* Static variables */
-static int stop_counter = 1;	//Counts the number of STOP signals we receive from nodes
+pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void init_central()
 {
-	//Initialize the file queue
-	all_files = malloc(sizeof(file_queue_t));
-	init_queue(all_files);
+	//Initialize the file catalog
+	all_files = init_catalog(malloc(sizeof(file_catalog_t)), walk_roots);
 	
-	pthread_create(&archive_thread, NULL, archive_thread_func, NULL);	//Create the archive thread
+	//Create the archive thread, unless sub-coordinators are archiving for their groups
+	if(!hier_enabled)
+		pthread_create(&archive_thread, NULL, archive_thread_func, NULL);
 	
 	//If we're using a scheduling algorithm that requires node stats, initialize the node stats array
 	if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
@@ -77,19 +40,36 @@ void init_central()
 		node_stats = malloc(sizeof(int) * proc_count);
 		memset(node_stats, 0, sizeof(int) * proc_count);
 	}
+	
+	//If we schedule by deadline or credits, initialize the estimates of how much work each node has left
+	if(reports_done())
+		init_estimates();
 }
 
 //This returns void* and takes in void* because pthread needs it to
 static void* archive_thread_func(void *nothing)
 {
 	//We don't actually use the parameter for anything
+	affinity_bind(0);	//We share a CPU with the other communication threads
+	trace_thread_name("archive");
+	archive_listener(MPI_COMM_WORLD, NULL, 0);	//Every node reports straight to us
+	return NULL;	//And we actually don't return anything useful
+}
+
+void archive_listener(MPI_Comm comm, int *ids, int first_target)
+{
+	int stop_counter = 1;	//Counts the number of STOP signals we receive from nodes (we count ourselves)
+	int comm_size;
+	MPI_Comm_size(comm, &comm_size);
 	
-	//Do this until we receive a number of STOPs equal to the number of nodes this program was initialized with
-	while(stop_counter < proc_count)
+	//Do this until we receive a number of STOPs equal to the number of nodes reporting to us
+	while(stop_counter < comm_size)
 	{
 		//Check to see if we got a message
 		MPI_Status status;
-		MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+		int source = (ids != NULL) ? ids[status.MPI_SOURCE] : status.MPI_SOURCE;	//Who sent it, for tracing
+		int target = (host_targets != NULL) ? host_targets[status.MPI_SOURCE] : status.MPI_SOURCE + first_target;	//Which target it is (its host, with shared queues)
 		
 		switch(status.MPI_TAG)
 		{
@@ -98,162 +78,70 @@ static void* archive_thread_func(void *nothing)
 				//Get the file we should archive...
 				char file_path[FILE_NAME_LEN];
 				memset(file_path, 0, FILE_NAME_LEN);
-				MPI_Recv(file_path, FILE_NAME_LEN, MPI_CHAR, status.MPI_SOURCE, ARCHIVE_TAG, MPI_COMM_WORLD, &status);
+				long long recv_start = trace_now();
+				MPI_Recv(file_path, FILE_NAME_LEN, MPI_CHAR, status.MPI_SOURCE, ARCHIVE_TAG, comm, &status);
+				trace_span(MPI_RECV_EVENT, file_path, source, recv_start);
+				
+				pthread_mutex_lock(&archive_mutex);
+				long long start = timing_start(), move_start = trace_now();
 				move_file(file_path);	//...and archive it
+				trace_span(ARCHIVE_EVENT, file_path, source, move_start);
+				timing_stop(ARCHIVE_PHASE, start);
+				pthread_mutex_unlock(&archive_mutex);
+			} break;
+			case ARCHIVE_RECORD_TAG:	//We got a signal to archive a record of a segment
+			{
+				//Get the segment and record we should archive...
+				char msg[FILE_NAME_LEN + sizeof(int)];
+				int index;
+				long long recv_start = trace_now();
+				MPI_Recv(msg, sizeof(msg), MPI_CHAR, status.MPI_SOURCE, ARCHIVE_RECORD_TAG, comm, &status);
+				memcpy(&index, msg + FILE_NAME_LEN, sizeof(int));
+				trace_span(MPI_RECV_EVENT, msg, source, recv_start);
+				
+				pthread_mutex_lock(&archive_mutex);
+				long long start = timing_start(), move_start = trace_now();
+				move_record(msg, index);	//...and archive it
+				trace_span(ARCHIVE_EVENT, msg, source, move_start);
+				timing_stop(ARCHIVE_PHASE, start);
+				pthread_mutex_unlock(&archive_mutex);
 			} break;
 			case STOP_TAG:	//We got a signal to increment the stop counter
 			{
 				int plusone;
-				MPI_Recv(&plusone, 1, MPI_INT, status.MPI_SOURCE, STOP_TAG, MPI_COMM_WORLD, &status);
+				MPI_Recv(&plusone, 1, MPI_INT, status.MPI_SOURCE, STOP_TAG, comm, &status);
 				stop_counter += plusone;	//Increment the stop counter by 1
 			} break;
 			case QUEUE_DATA_TAG:	//We received queue data
 			{
 				int dat;
-				MPI_Recv(&dat, 1, MPI_INT, status.MPI_SOURCE, QUEUE_DATA_TAG, MPI_COMM_WORLD, &status);
-				node_stats[status.MPI_SOURCE] = dat;	//Update node data array
+				MPI_Recv(&dat, 1, MPI_INT, status.MPI_SOURCE, QUEUE_DATA_TAG, comm, &status);
+				node_stats[target] = dat;	//Update node data array
+			} break;
+			case FILE_DONE_TAG:	//A node finished a file
+			{
+				long long msg[2];
+				MPI_Recv(msg, 2, MPI_LONG_LONG, status.MPI_SOURCE, FILE_DONE_TAG, comm, &status);
+				sched_file_done(target, (int) msg[0], msg[1]);	//Update its estimates
 			} break;
 		}
 	}
-	
-	return NULL;	//And we actually don't return anything useful
-}
-
-int enqueue_all_files()
-{
-	DIR *file_dir = opendir(file_dir_str);	//Open the work directory stream
-    struct dirent *subdir = NULL;	//Pointer to a directory entry
-    
-    //Iterate through all filenames in the directory
-    while((subdir = readdir(file_dir)) != NULL)
-    {
-    	//If the name is valid, we should do something with it
-        if(file_name_valid(subdir->d_name))
-        {
-        	//Get the full path to the file
-        	char filename[FILE_NAME_LEN];
-        	strcpy(filename, file_dir_str);
-        	strcat(filename, subdir->d_name);
-        	
-        	//Get the size of the file
-        	FILE *file = fopen(filename, "r");
-        	fseek(file, 0, SEEK_END);
-        	int file_size = ftell(file);
-        	fclose(file);
-        	
-        	//Set the file priority (1 unless we specified a priority option)
-        	int priority = 1;
-        	
-        	if(priority_option == OLDEST_FILE_PRIORITY)
-        	{
-		    	char *priority_string = strchr(subdir->d_name, (int) '_') + 1;
-		    	priority = -atoi(priority_string);
-        	}
-        	
-		    enqueue(all_files, filename, file_size, priority);	//Enqueue the file
-		}
-    }
-    
-    closedir(file_dir);	//Close the work directory stream
-    return (file_count = all_files->size);	//Set file count while returning it
-}
-
-void move_file(char *filepath)
-{
-	char *file_name = strrchr(filepath, (int) '/') + 1;	//Get the file name only
-	
-	//Get the full new path to the file
-	char new_path[FILE_NAME_LEN];
-	memset(new_path, 0, FILE_NAME_LEN);
-	strcpy(new_path, archive_dir_str);
-	strcat(new_path, file_name);
-	
-	printf("Moving from %s to %s\n", filepath, new_path);
-	rename(filepath, new_path);	//Rename the file, i.e. move it
-}
-
-int file_name_valid(char *filename)
-{
-	//If the filename is a directory, it's definitely not valid
-	if(filename[0] == '.')
-		return 0;
-	
-	return !strcmp((filename + strlen(filename) - 4), ".sen");	//Check if filename ends with ".sen"
-}
-
-int get_best_proc()
-{
-	//Depending on the scheduling type, return the value a helper function returns
-	switch(sched_type)
-	{
-		case CYCLIC:
-			return get_best_proc_cyclic();
-		case BLOCK:
-			return get_best_proc_block();
-		case RANDOM:
-			return get_best_proc_random();
-		case QUEUE_SIZE:
-			return get_best_proc_queue_data();
-		case QUEUE_LENGTH:
-			return get_best_proc_queue_data();
-		default:
-			return -1;	//Something went really wrong
-	}
-}
-
-static int get_best_proc_cyclic()
-{
-	static int proc_counter = 0;	//Keep track of which processor we last left off at
-	
-	int retval = (proc_counter % (proc_count - 1)) + 1;	//Get the processor we left off at
-	proc_counter++;	//Increment so next time, we get the next cyclic processor
-	return retval;
-}
-
-static int get_best_proc_block()
-{
-	static int proc_counter = 0;	//Keep track of which processor we last left off at
-	static int block_counter = 0;	//Keep track of how many files we've sent to it so far
-	
-	int retval = (proc_counter % (proc_count - 1)) + 1;	//Get the processor we left off at
-	block_counter++;	//Increment the number of files we've sent to it by 1
-	
-	//If it's greater than the number of files it should be getting, increment so we get the next processor next time
-	if(block_counter >= files_per_proc)
-	{
-		proc_counter++;
-		block_counter = 0;
-	}
-	
-	return retval;
-}
-
-static inline int get_best_proc_random()
-{
-	return (rand() % (proc_count - 1)) + 1;	//Just get a random processor between [1, # of nodes)
-}
-
-static int get_best_proc_queue_data()
-{
-	//Find the node with minimum "x", where x is some metric
-	int min = 1;
-	
-	for(int i = 1; i < proc_count; i++)
-		if(node_stats[i] < node_stats[min])
-			min = i;
-	
-	return min;
 }
 
 void central_cleanup()
 {
-	pthread_join(archive_thread, NULL);	//Join the archive thread
+	if(!hier_enabled)
+		pthread_join(archive_thread, NULL);	//Join the archive thread
+	finish_archive();	//Finish any archive segments we were writing
 	
 	//Free the node stats array if we initialized it
 	if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
 		free(node_stats);
 	
-	//Free the file queue
-	free_queue(all_files);
+	if(reports_done())
+		free_estimates();
+	
+	//Free the file catalog
+	free_catalog(all_files);
 }
 
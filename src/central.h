@@ -1,16 +1,13 @@
 #ifndef CENTRAL_H_INCLUDED
 #define CENTRAL_H_INCLUDED
 
+#include <mpi.h>
 #include <pthread.h>
-#include "container.h"
+#include "sched.h"
 
 /* Central machine variables */
-extern int *node_stats;				//Array of node stats for certain scheduling algorithms
-
-extern file_queue_t *all_files;		//Queue of all files we found
-extern pthread_t archive_thread;	//Thread that performs all receives (particularly signals to archive)
-extern int file_count;				//Number of files we found
-extern int files_per_proc;			//Number of files each processor should get for block scheduling
+extern pthread_t archive_thread;		//Thread that performs all receives (particularly signals to archive)
+extern pthread_mutex_t archive_mutex;	//Serializes archiving on a rank that archives from more than one thread
 
 /* Central machine functions */
 
@@ -22,34 +19,17 @@ extern int files_per_proc;			//Number of files each processor should get for blo
 void init_central();
 
 /*
- * Iterates through all files in the file directory and enqueues them in
- * all_files.
- * Params: nothing
- * Returns: the number of files inserted into the queue.
- */
-int enqueue_all_files();
-
-/*
- * Moves a file from the file directory to the archive directory.
- * Params: filepath - the full path to the file.
+ * Listens for messages from the nodes reporting to us, archiving what they
+ * tell us to and recording their queue data, until every one of them has sent
+ * STOP. Rank 0 of comm is us.
+ * Params: comm - the communicator the nodes report to us on.
+ *         ids - each rank of comm's rank in MPI_COMM_WORLD, for tracing, or
+ *         NULL if comm is MPI_COMM_WORLD.
+ *         first_target - the index in node_stats of rank 0 of comm; node_stats
+ *         is indexed like get_best_proc()'s targets.
  * Returns: nothing
  */
-void move_file(char *filepath);
-
-/*
- * Checks if a file name is valid. A file name is considered valid if it does
- * not begin with "." and ends with ".sen."
- * Params: filename - the full path to the file.
- * Returns: 1 if the file name is valid; 0 otherwise.
- */
-int file_name_valid(char *filename);
-
-/*
- * Returns the best node to send the next file to.
- * Params: nothing
- * Returns: the rank of the best node to send the next file to.
- */
-int get_best_proc();
+void archive_listener(MPI_Comm comm, int *ids, int first_target);
 
 /*
  * Finalizes us as the central machine.
@@ -57,4 +37,3 @@ int get_best_proc();
 void central_cleanup();
 
 #endif //CENTRAL_H_INCLUDED
-
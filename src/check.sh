@@ -0,0 +1,71 @@
+#!/bin/sh
+# check.sh
+# MATH 4777 Project archive check
+#
+# Generates the same fixed-seed files under two roots, and again under a
+# subdirectory of each, so every file name shows up four times. Then runs fsch
+# over both roots with -recursive, twice, so the second run's files also
+# collide with everything the first run archived. Fails unless every match
+# ends up in the archive and every file is either still where it was or in
+# the archive.
+#
+# Everything can be overridden from the environment, e.g.
+#   CHECK_FILES=1000 CHECK_RANKS=5 make check
+
+CHECK_FILES=${CHECK_FILES:-200}					# Files per directory
+CHECK_SEED=${CHECK_SEED:-4777}					# Seed for filegen
+CHECK_TIME=${CHECK_TIME:-1500000000}			# Time the newest file was written
+CHECK_KEY=${CHECK_KEY:-threatlevel}				# Search key
+CHECK_RANKS=${CHECK_RANKS:-3}					# Rank count (including the central rank)
+CHECK_DIR=${CHECK_DIR:-check_data}				# Where the roots and archive live
+MPIRUN=${MPIRUN:-mpirun}						# MPI launcher
+MPIRUN_FLAGS=${MPIRUN_FLAGS:-"--oversubscribe"}	# Extra launcher flags
+
+set -e
+
+# Counts the files under a directory.
+# Params: $@ - the directories.
+count_files()
+{
+	find "$@" -type f -name '*.sen' | wc -l
+}
+
+rm -rf "$CHECK_DIR"
+mkdir -p "$CHECK_DIR/archive"
+failed=0
+
+for run in 1 2
+do
+	for dir in root1 root1/day root2 root2/day
+	do
+		mkdir -p "$CHECK_DIR/$dir"
+		./filegen "$CHECK_FILES" "$CHECK_DIR/$dir" -seed "$CHECK_SEED" -time "$CHECK_TIME" -s 0.1 > /dev/null
+	done
+
+	files=$(count_files "$CHECK_DIR/root1" "$CHECK_DIR/root2")
+	before=$(count_files "$CHECK_DIR/archive")
+	rm -f "$CHECK_DIR"/results.json.*
+	$MPIRUN $MPIRUN_FLAGS -np "$CHECK_RANKS" ./fsch "$CHECK_DIR/root1" "$CHECK_DIR/archive" "$CHECK_KEY" \
+		-root "$CHECK_DIR/root2" -recursive -results "$CHECK_DIR/results.json" -v 0 > "$CHECK_DIR/run$run.log" 2>&1
+
+	matches=$(cat "$CHECK_DIR"/results.json.* | wc -l)
+	archived=$(($(count_files "$CHECK_DIR/archive") - before))
+	left=$(count_files "$CHECK_DIR/root1" "$CHECK_DIR/root2")
+	echo "Run $run: $files files, $matches matches, $archived archived, $left left"
+
+	if [ "$archived" -ne "$matches" ] || [ $((archived + left)) -ne "$files" ]
+	then
+		echo "Run $run lost files; see $CHECK_DIR/run$run.log" >&2
+		failed=1
+	fi
+
+	# Clear out what didn't match, so the next run sees exactly the same files again
+	find "$CHECK_DIR/root1" "$CHECK_DIR/root2" -type f -name '*.sen' -delete
+done
+
+if [ "$failed" -ne 0 ]
+then
+	exit 1
+fi
+
+echo "Every match was archived"
@@ -0,0 +1,416 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "affinity.h"
+#include "compress.h"
+
+#define INFLATE_CHUNK_SIZE 65536	//How much we inflate at a time when streaming
+#define FRAME_MAX_SIZE 65536		//Most bytes a frame takes up, compressed or not
+#define FRAME_HEADER_SIZE 18		//gzip header plus the "BC" extra subfield
+#define FRAME_TRAILER_SIZE 8		//CRC32 and original size
+#define INFLATE_THREADS 4			//Threads used to inflate a large framed file
+#define FRAMES_PER_THREAD 4			//Frames each thread inflates before they're all searched
+#define PARALLEL_MIN_SIZE 1048576	//Framed files smaller than this are just streamed
+
+/* Defines a frame being inflated by one of several threads */
+typedef struct _frame_t {
+	unsigned char *data;		//The compressed frame, pointing into the mapped file
+	size_t len;					//Length of the compressed frame
+	char out[FRAME_MAX_SIZE];	//The inflated frame
+	size_t out_len;				//Length of out
+	int ok;						//1 if the frame inflated cleanly; 0 otherwise
+} frame_t;
+
+/* Defines the frames a single inflating thread is responsible for */
+typedef struct _inflate_job_t {
+	frame_t *frames;			//Every frame in the batch
+	int count;					//Number of frames in the batch
+	int first;					//First frame this thread inflates
+	int step;					//Distance between the frames this thread inflates
+} inflate_job_t;
+
+/* Static function prototypes */
+
+/*
+ * Gets the size of the frame at the start of some data.
+ * Params: data - the data.
+ *         len - the length of the data.
+ * Returns: the size of the frame, or 0 if the data doesn't start with a
+ *          complete frame.
+ */
+static size_t frame_size(unsigned char *data, size_t len);
+
+/*
+ * Inflates a gzip file (one or more members) on a single thread.
+ * Params: data - the compressed file.
+ *         size - the size of the compressed file.
+ *         func - the function to pass each chunk to.
+ *         arg - passed to func as is.
+ * Returns: 0 if the file was inflated (or func asked to stop); nonzero if it's
+ *          corrupt.
+ */
+static int inflate_stream(unsigned char *data, size_t size, chunk_func_t func, void *arg);
+
+/*
+ * Inflates a framed file on several threads, a batch of frames at a time,
+ * passing each batch to func in order once it's inflated. If the file stops
+ * being framed part way through, the rest of it is streamed.
+ * Params: data - the compressed file.
+ *         size - the size of the compressed file.
+ *         func - the function to pass each chunk to.
+ *         arg - passed to func as is.
+ * Returns: 0 if the file was inflated (or func asked to stop); nonzero if it's
+ *          corrupt.
+ */
+static int inflate_parallel(unsigned char *data, size_t size, chunk_func_t func, void *arg);
+
+/*
+ * Inflates every frame of a batch that a single thread is responsible for.
+ * Params: arg - the thread's inflate_job_t.
+ * Returns: NULL
+ */
+static void* inflate_thread_func(void *arg);
+
+/*
+ * Writes an integer in little-endian order.
+ * Params: out - where to write the integer.
+ *         value - the integer.
+ *         bytes - how many bytes of the integer to write.
+ * Returns: nothing
+ */
+static void put_le(unsigned char *out, uint32_t value, int bytes);
+
+/*
+ * Compresses some data into a single frame.
+ * Params: strm - a raw deflate stream to compress with.
+ *         data - the data.
+ *         len - the length of the data (at most FRAME_MAX_DATA).
+ *         out - a buffer of FRAME_MAX_SIZE bytes to write the frame to.
+ * Returns: the size of the frame, or 0 if it couldn't be compressed.
+ */
+static size_t write_frame(z_stream *strm, unsigned char *data, size_t len, unsigned char *out);
+
+/* Compression functions */
+
+int compressed_name_valid(char *filename)
+{
+	int len = strlen(filename), ext_len = strlen(COMPRESSED_EXT);
+	return len > ext_len && !strcmp(filename + len - ext_len, COMPRESSED_EXT);	//Check if filename ends with ".sen.gz"
+}
+
+int inflate_file(char *path, chunk_func_t func, void *arg, chunk_func_t raw_func)
+{
+	int fd = open(path, O_RDONLY);
+	
+	if(fd < 0)
+		return 1;
+	
+	struct stat st;
+	
+	if(fstat(fd, &st) || st.st_size == 0)
+	{
+		close(fd);
+		return 1;
+	}
+	
+	//Map the whole file; the mapping outlives the file descriptor
+	unsigned char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if(data == MAP_FAILED)
+		return 1;
+	
+	//We're going to read it front to back
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	
+	//raw_func gets it as it's stored first; then large framed files can be inflated in parallel, and anything else is streamed
+	int retval;
+	
+	if(raw_func != NULL && raw_func(arg, (char*) data, st.st_size))
+		retval = 0;
+	else if(st.st_size >= PARALLEL_MIN_SIZE && frame_size(data, st.st_size) > 0)
+		retval = inflate_parallel(data, st.st_size, func, arg);
+	else
+		retval = inflate_stream(data, st.st_size, func, arg);
+	
+	munmap(data, st.st_size);
+	return retval;
+}
+
+int compress_file(char *in_path, char *out_path)
+{
+	FILE *in = fopen(in_path, "rb");
+	
+	if(in == NULL)
+		return 1;
+	
+	FILE *out = fopen(out_path, "wb");
+	
+	if(out == NULL)
+	{
+		fclose(in);
+		return 1;
+	}
+	
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	
+	if(deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		fclose(in);
+		fclose(out);
+		return 1;
+	}
+	
+	unsigned char data[FRAME_MAX_DATA], frame[FRAME_MAX_SIZE];
+	size_t len, frame_len;
+	int retval = 0;
+	
+	//Compress the file a frame at a time...
+	while(!retval && (len = fread(data, 1, FRAME_MAX_DATA, in)) > 0)
+	{
+		frame_len = write_frame(&strm, data, len, frame);
+		retval = frame_len == 0 || fwrite(frame, 1, frame_len, out) != frame_len;
+	}
+	
+	//...and end it with an empty frame, like bgzip does
+	if(!retval)
+	{
+		frame_len = write_frame(&strm, data, 0, frame);
+		retval = frame_len == 0 || fwrite(frame, 1, frame_len, out) != frame_len;
+	}
+	
+	retval |= ferror(in);
+	deflateEnd(&strm);
+	fclose(in);
+	
+	if(fclose(out))
+		retval = 1;
+	
+	return retval;
+}
+
+static size_t frame_size(unsigned char *data, size_t len)
+{
+	//It has to be a gzip member with an extra field
+	if(len < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE || data[0] != 0x1f || data[1] != 0x8b || data[2] != Z_DEFLATED || !(data[3] & 0x04))
+		return 0;
+	
+	//Look through the extra field's subfields for "BC", which holds the frame's size minus one
+	size_t xlen = data[10] | (data[11] << 8), pos = 12;
+	
+	while(pos + 4 <= 12 + xlen && pos + 4 <= len)
+	{
+		size_t sub_len = data[pos + 2] | (data[pos + 3] << 8);
+		
+		if(data[pos] == 'B' && data[pos + 1] == 'C' && sub_len == 2 && pos + 6 <= len)
+		{
+			size_t size = (data[pos + 4] | (data[pos + 5] << 8)) + 1;
+			return (size <= len && size >= 12 + xlen + FRAME_TRAILER_SIZE) ? size : 0;
+		}
+		
+		pos += 4 + sub_len;
+	}
+	
+	return 0;
+}
+
+static int inflate_stream(unsigned char *data, size_t size, chunk_func_t func, void *arg)
+{
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	
+	if(inflateInit2(&strm, 15 + 16) != Z_OK)	//15 + 16 means a gzip wrapper with the largest window
+		return 1;
+	
+	char out[INFLATE_CHUNK_SIZE];
+	size_t pos = 0;
+	int ret = Z_OK;
+	
+	while(1)
+	{
+		//Feed zlib the mapped file a piece at a time (avail_in is only 32 bits)
+		if(strm.avail_in == 0)
+		{
+			if(pos == size)
+				break;
+			
+			size_t take = (size - pos < INFLATE_CHUNK_SIZE) ? size - pos : INFLATE_CHUNK_SIZE;
+			strm.next_in = data + pos;
+			strm.avail_in = take;
+			pos += take;
+		}
+		
+		strm.next_out = (unsigned char*) out;
+		strm.avail_out = INFLATE_CHUNK_SIZE;
+		ret = inflate(&strm, Z_NO_FLUSH);
+		
+		if(ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+			break;
+		
+		//Pass along whatever we got, stopping if we've been told to
+		size_t have = INFLATE_CHUNK_SIZE - strm.avail_out;
+		
+		if(have > 0 && func(arg, out, have))
+		{
+			ret = Z_STREAM_END;
+			break;
+		}
+		
+		//Concatenated gzip members (including frames) are just one file
+		if(ret == Z_STREAM_END && (strm.avail_in > 0 || pos < size))
+			inflateReset(&strm);
+	}
+	
+	inflateEnd(&strm);
+	return ret != Z_STREAM_END;
+}
+
+static int inflate_parallel(unsigned char *data, size_t size, chunk_func_t func, void *arg)
+{
+	int batch_size = INFLATE_THREADS * FRAMES_PER_THREAD;
+	frame_t *frames = malloc(sizeof(frame_t) * batch_size);
+	inflate_job_t jobs[INFLATE_THREADS];
+	pthread_t threads[INFLATE_THREADS];
+	size_t pos = 0;
+	int retval = 0, stop = 0;
+	
+	//If we're pinned, keep the helpers on our NUMA node (but free to use its other CPUs), since we read what they inflate
+	pthread_attr_t attr;
+	cpu_set_t domain;
+	pthread_attr_init(&attr);
+	
+	if(!affinity_domain_mask(&domain))
+		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &domain);
+	
+	while(!retval && !stop && pos < size)
+	{
+		//Find the next batch of frames; their headers say where each one ends
+		int count = 0;
+		size_t len;
+		
+		while(count < batch_size && pos < size && (len = frame_size(data + pos, size - pos)) > 0)
+		{
+			frames[count].data = data + pos;
+			frames[count].len = len;
+			count++;
+			pos += len;
+		}
+		
+		//If the rest of the file isn't framed, stream it instead
+		if(count == 0)
+		{
+			retval = inflate_stream(data + pos, size - pos, func, arg);
+			break;
+		}
+		
+		//Inflate the batch, with this thread taking a share
+		int num_threads = (count < INFLATE_THREADS) ? count : INFLATE_THREADS;
+		
+		for(int i = 0; i < num_threads; i++)
+		{
+			jobs[i].frames = frames;
+			jobs[i].count = count;
+			jobs[i].first = i;
+			jobs[i].step = num_threads;
+		}
+		
+		for(int i = 1; i < num_threads; i++)
+			pthread_create(&(threads[i]), &attr, inflate_thread_func, &(jobs[i]));
+		
+		inflate_thread_func(&(jobs[0]));
+		
+		for(int i = 1; i < num_threads; i++)
+			pthread_join(threads[i], NULL);
+		
+		//Then pass the frames along in order
+		for(int i = 0; i < count && !retval && !stop; i++)
+		{
+			if(!frames[i].ok)
+				retval = 1;
+			else if(frames[i].out_len > 0)
+				stop = func(arg, frames[i].out, frames[i].out_len);
+		}
+	}
+	
+	pthread_attr_destroy(&attr);
+	free(frames);
+	return retval;
+}
+
+static void* inflate_thread_func(void *arg)
+{
+	inflate_job_t *job = arg;
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	
+	if(inflateInit2(&strm, 15 + 16) != Z_OK)
+	{
+		for(int i = job->first; i < job->count; i += job->step)
+			job->frames[i].ok = 0;
+		
+		return NULL;
+	}
+	
+	for(int i = job->first; i < job->count; i += job->step)
+	{
+		frame_t *frame = &(job->frames[i]);
+		
+		//Each frame is a whole gzip member, so it inflates in one go
+		inflateReset(&strm);
+		strm.next_in = frame->data;
+		strm.avail_in = frame->len;
+		strm.next_out = (unsigned char*) frame->out;
+		strm.avail_out = FRAME_MAX_SIZE;
+		
+		frame->ok = inflate(&strm, Z_FINISH) == Z_STREAM_END;
+		frame->out_len = FRAME_MAX_SIZE - strm.avail_out;
+	}
+	
+	inflateEnd(&strm);
+	return NULL;
+}
+
+static void put_le(unsigned char *out, uint32_t value, int bytes)
+{
+	for(int i = 0; i < bytes; i++)
+		out[i] = (value >> (8 * i)) & 0xff;
+}
+
+static size_t write_frame(z_stream *strm, unsigned char *data, size_t len, unsigned char *out)
+{
+	//Deflate the data into the space between the header and trailer
+	deflateReset(strm);
+	strm->next_in = data;
+	strm->avail_in = len;
+	strm->next_out = out + FRAME_HEADER_SIZE;
+	strm->avail_out = FRAME_MAX_SIZE - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE;
+	
+	if(deflate(strm, Z_FINISH) != Z_STREAM_END)
+		return 0;
+	
+	size_t size = FRAME_HEADER_SIZE + strm->total_out + FRAME_TRAILER_SIZE;
+	
+	//gzip header: magic, deflate, FEXTRA, no mtime, no extra flags, unknown OS
+	static const unsigned char header[12] = { 0x1f, 0x8b, Z_DEFLATED, 0x04, 0, 0, 0, 0, 0, 0xff, 6, 0 };
+	memcpy(out, header, sizeof(header));
+	
+	//The "BC" subfield holds the size of the whole frame, minus one
+	out[12] = 'B';
+	out[13] = 'C';
+	put_le(out + 14, 2, 2);
+	put_le(out + 16, size - 1, 2);
+	
+	//gzip trailer: CRC32 and length of the original data
+	put_le(out + size - FRAME_TRAILER_SIZE, crc32(crc32(0, Z_NULL, 0), data, len), 4);
+	put_le(out + size - 4, len, 4);
+	return size;
+}
@@ -0,0 +1,65 @@
+#ifndef COMPRESS_H_INCLUDED
+#define COMPRESS_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+ * Compressed .sen files end with ".sen.gz" and come in two flavours, both of
+ * which gunzip reads as an ordinary gzip file:
+ *
+ *   - A plain gzip stream (or several concatenated ones), inflated on one
+ *     thread.
+ *   - A framed ("BGZF") file: a series of independent gzip members, each
+ *     holding at most 64KB of the original file and recording its own
+ *     compressed size in a "BC" extra subfield. Because members can be found
+ *     without inflating anything, large framed files are inflated on several
+ *     threads at once.
+ *
+ * Either way, the inflated data is handed over in chunks as it's produced, so
+ * a file is never decompressed to disk or held in memory all at once.
+ */
+
+#define COMPRESSED_EXT ".sen.gz"	//Extension of a compressed .sen file
+#define FRAME_MAX_DATA 65280		//Most original bytes a frame holds (so the frame fits in 64KB)
+
+/*
+ * Receives the next chunk of an inflated file.
+ * Params: arg - the argument passed to inflate_file().
+ *         data - the chunk.
+ *         len - the length of the chunk.
+ * Returns: nonzero to stop inflating; 0 to keep going.
+ */
+typedef int (*chunk_func_t)(void *arg, char *data, size_t len);
+
+/* Compression functions */
+
+/*
+ * Checks if a file name is a compressed .sen file's.
+ * Params: filename - the name of the file.
+ * Returns: 1 if the file name ends with COMPRESSED_EXT; 0 otherwise.
+ */
+int compressed_name_valid(char *filename);
+
+/*
+ * Inflates a compressed .sen file, passing it to func in order one chunk at a
+ * time until the file ends or func asks to stop.
+ * Params: path - the full path to the file.
+ *         func - the function to pass each chunk to.
+ *         arg - passed to func (and raw_func) as is.
+ *         raw_func - if not NULL, the function to pass the whole file to as
+ *         it's stored, before any of it is inflated (e.g. to hash it without
+ *         reading it again); if it asks to stop, nothing is inflated.
+ * Returns: 0 if the file was inflated (or func or raw_func asked to stop);
+ *          nonzero if it couldn't be read or is corrupt.
+ */
+int inflate_file(char *path, chunk_func_t func, void *arg, chunk_func_t raw_func);
+
+/*
+ * Compresses a file into a framed .sen.gz file.
+ * Params: in_path - the full path to the file to compress.
+ *         out_path - the full path to write the framed file to.
+ * Returns: 0 on success; nonzero if either file couldn't be read or written.
+ */
+int compress_file(char *in_path, char *out_path);
+
+#endif //COMPRESS_H_INCLUDED
@@ -3,6 +3,46 @@
 
 #include "container.h"
 
+#define CATALOG_INITIAL_FILES 1024		//Files a catalog has room for before it first grows
+#define CATALOG_INITIAL_NAMES 65536		//Bytes of names a catalog has room for before it first grows
+
+/* Static function prototypes */
+
+/*
+ * Takes the next file out of a catalog. The catalog's mutex must be held and
+ * there must be a file to take.
+ * Params: catalog - the catalog to take from.
+ *         path - a buffer that will contain the file's full path on return.
+ *         path_len - the size of path.
+ *         file_size - a single int buffer that will contain the size of the
+ *         file on return.
+ *         priority - a single int buffer that will contain the priority of
+ *         the file on return.
+ * Returns: nothing
+ */
+static void take_next(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority);
+
+/*
+ * Stably sorts file indices by priority, highest first, then by location,
+ * lowest first, with a bottom-up merge sort.
+ * Params: order - the indices to sort.
+ *         n - the number of indices.
+ *         priorities - each file's priority, indexed by the indices.
+ *         locations - each file's location, indexed by the indices.
+ * Returns: nothing
+ */
+static void sort_by_priority(int *order, int n, int *priorities, long long *locations);
+
+/*
+ * Checks whether one file should be taken out of a catalog before another.
+ * Params: a - the index of the first file.
+ *         b - the index of the second file.
+ *         priorities - each file's priority.
+ *         locations - each file's location.
+ * Returns: 1 if a comes first or they're tied; 0 if b comes first.
+ */
+static int comes_first(int a, int b, int *priorities, long long *locations);
+
 file_queue_t* init_queue(file_queue_t *queue)
 {
 	//Initialize queue contents to their default values
@@ -10,6 +50,7 @@ file_queue_t* init_queue(file_queue_t *queue)
 	queue->size = 0;
 	queue->sum_file_size = 0;
 	queue->modifying = 0;
+	queue->closed = 0;
 	
 	pthread_mutex_init(&(queue->queue_mutex), NULL);	//Initialize the queue mutex
 	
@@ -37,7 +78,7 @@ int enqueue(file_queue_t *queue, char *filename, int file_size, int priority)
 	
 	//Initialize the node to be added
 	file_node_t *add = malloc(sizeof(file_node_t));
-	add->file = malloc(strlen(filename));
+	add->file = malloc(strlen(filename) + 1);
 	strcpy(add->file, filename);
 	add->file_size = file_size;
 	add->priority = priority;
@@ -123,6 +164,64 @@ char* dequeue(file_queue_t *queue, int *file_size, int *priority)
 	return filename;
 }
 
+char* dequeue_wait(file_queue_t *queue, int *file_size, int *priority)
+{
+	//If the queue is NULL, return NULL
+	if(queue == NULL)
+		return NULL;
+	
+	//Wait for our turn to access the queue and for something to be in it
+	pthread_mutex_lock(&(queue->queue_mutex));
+	
+	while(queue->modifying || (queue->size == 0 && !queue->closed))
+		pthread_cond_wait(&(queue->dequeue_cond), &(queue->queue_mutex));
+	
+	//If we woke up because the queue was closed, there's nothing left to give
+	if(queue->size == 0)
+	{
+		pthread_mutex_unlock(&(queue->queue_mutex));
+		return NULL;
+	}
+	
+	queue->modifying = 1;	//Make sure other threads know we're modifying this
+	
+	//Dequeue the head, because the head always has highest priority
+	file_node_t *oldhead = queue->head;
+	
+	char *filename = oldhead->file;
+	*file_size = oldhead->file_size;
+	*priority = oldhead->priority;
+	
+	//Then make the next node the head
+	queue->head = queue->head->next;
+	queue->size--;
+	queue->sum_file_size -= oldhead->file_size;
+	free(oldhead);
+	
+	queue->modifying = 0;	//We're no longer modifying this
+	
+	//Signal the condition variables and unlock the mutex
+	pthread_cond_signal(&(queue->enqueue_cond));
+	pthread_cond_signal(&(queue->read_cond));
+	pthread_mutex_unlock(&(queue->queue_mutex));
+	
+	return filename;
+}
+
+void close_queue(file_queue_t *queue)
+{
+	//Do nothing if the queue is NULL
+	if(queue == NULL)
+		return;
+	
+	pthread_mutex_lock(&(queue->queue_mutex));
+	queue->closed = 1;
+	
+	//Wake up everyone waiting to dequeue so they can see it's closed
+	pthread_cond_broadcast(&(queue->dequeue_cond));
+	pthread_mutex_unlock(&(queue->queue_mutex));
+}
+
 int queue_size(file_queue_t *queue)
 {
 	//If the queue is NULL, return a size of 0
@@ -148,6 +247,38 @@ int queue_size(file_queue_t *queue)
 	return retval;
 }
 
+int queue_peek(file_queue_t *queue, char **files, int max)
+{
+	//If the queue is NULL, there's nothing to look at
+	if(queue == NULL)
+		return 0;
+	
+	//Wait for our turn to access the queue
+	pthread_mutex_lock(&(queue->queue_mutex));
+	
+	while(queue->modifying)
+		pthread_cond_wait(&(queue->read_cond), &(queue->queue_mutex));
+	
+	//Copy the names, since the files could be dequeued and freed as soon as we let go
+	queue->modifying = 1;
+	int count = 0;
+	
+	for(file_node_t *node = queue->head; node != NULL && count < max; node = node->next)
+	{
+		files[count] = malloc(strlen(node->file) + 1);
+		strcpy(files[count++], node->file);
+	}
+	
+	queue->modifying = 0;
+	
+	//Signal the condition variables and unlock the mutex
+	pthread_cond_signal(&(queue->enqueue_cond));
+	pthread_cond_signal(&(queue->dequeue_cond));
+	pthread_mutex_unlock(&(queue->queue_mutex));
+	
+	return count;
+}
+
 int queue_sum_file_size(file_queue_t *queue)
 {
 	//If the queue is NULL, return a size of 0
@@ -196,3 +327,239 @@ int free_queue(file_queue_t *queue)
 	return 0;
 }
 
+file_catalog_t* init_catalog(file_catalog_t *catalog, char **dirs)
+{
+	//Initialize catalog contents to their default values
+	catalog->dirs = dirs;
+	catalog->capacity = CATALOG_INITIAL_FILES;
+	catalog->dir_ids = malloc(sizeof(unsigned short) * catalog->capacity);
+	catalog->sizes = malloc(sizeof(int) * catalog->capacity);
+	catalog->priorities = malloc(sizeof(int) * catalog->capacity);
+	catalog->locations = malloc(sizeof(long long) * catalog->capacity);
+	catalog->name_offsets = malloc(sizeof(long long) * catalog->capacity);
+	catalog->names_capacity = CATALOG_INITIAL_NAMES;
+	catalog->names = malloc(catalog->names_capacity);
+	catalog->order = NULL;
+	catalog->count = 0;
+	catalog->names_len = 0;
+	catalog->next = 0;
+	catalog->closed = 0;
+	
+	pthread_mutex_init(&(catalog->catalog_mutex), NULL);
+	pthread_cond_init(&(catalog->take_cond), NULL);
+	
+	return catalog;
+}
+
+int catalog_add(file_catalog_t *catalog, int dir_id, char *name, int file_size, int priority, long long location)
+{
+	//Do nothing if the catalog is NULL
+	if(catalog == NULL)
+		return 1;
+	
+	long long name_len = strlen(name) + 1;
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	
+	//Make room for another file if we're out, doubling so growing stays cheap
+	if(catalog->count == catalog->capacity)
+	{
+		catalog->capacity *= 2;
+		catalog->dir_ids = realloc(catalog->dir_ids, sizeof(unsigned short) * catalog->capacity);
+		catalog->sizes = realloc(catalog->sizes, sizeof(int) * catalog->capacity);
+		catalog->priorities = realloc(catalog->priorities, sizeof(int) * catalog->capacity);
+		catalog->locations = realloc(catalog->locations, sizeof(long long) * catalog->capacity);
+		catalog->name_offsets = realloc(catalog->name_offsets, sizeof(long long) * catalog->capacity);
+		
+		if(catalog->order != NULL)
+			catalog->order = realloc(catalog->order, sizeof(int) * catalog->capacity);
+	}
+	
+	//And for its name
+	while(catalog->names_len + name_len > catalog->names_capacity)
+	{
+		catalog->names_capacity *= 2;
+		catalog->names = realloc(catalog->names, catalog->names_capacity);
+	}
+	
+	//Add the file to the end
+	int index = catalog->count++;
+	catalog->dir_ids[index] = dir_id;
+	catalog->sizes[index] = file_size;
+	catalog->priorities[index] = priority;
+	catalog->locations[index] = location;
+	catalog->name_offsets[index] = catalog->names_len;
+	memcpy(catalog->names + catalog->names_len, name, name_len);
+	catalog->names_len += name_len;
+	
+	if(catalog->order != NULL)
+		catalog->order[index] = index;
+	
+	//Signal the condition variable and unlock the mutex
+	pthread_cond_signal(&(catalog->take_cond));
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+	
+	return 0;
+}
+
+void catalog_sort(file_catalog_t *catalog)
+{
+	//Do nothing if the catalog is NULL
+	if(catalog == NULL)
+		return;
+	
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	
+	//Files start out in the order they were added
+	if(catalog->order == NULL)
+	{
+		catalog->order = malloc(sizeof(int) * catalog->capacity);
+		
+		for(int i = 0; i < catalog->count; i++)
+			catalog->order[i] = i;
+	}
+	
+	//Only the files that haven't been taken out yet need sorting
+	sort_by_priority(catalog->order + catalog->next, catalog->count - catalog->next, catalog->priorities, catalog->locations);
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+}
+
+int catalog_take(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority)
+{
+	//If the catalog is NULL, there's nothing to take
+	if(catalog == NULL)
+		return 0;
+	
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	int taken = (catalog->next < catalog->count);
+	
+	if(taken)
+		take_next(catalog, path, path_len, file_size, priority);
+	
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+	return taken;
+}
+
+int catalog_take_wait(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority)
+{
+	//If the catalog is NULL, there's nothing to take
+	if(catalog == NULL)
+		return 0;
+	
+	//Wait for something to take
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	
+	while(catalog->next == catalog->count && !catalog->closed)
+		pthread_cond_wait(&(catalog->take_cond), &(catalog->catalog_mutex));
+	
+	//If we woke up because the catalog was closed, there's nothing left to give
+	int taken = (catalog->next < catalog->count);
+	
+	if(taken)
+		take_next(catalog, path, path_len, file_size, priority);
+	
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+	return taken;
+}
+
+void close_catalog(file_catalog_t *catalog)
+{
+	//Do nothing if the catalog is NULL
+	if(catalog == NULL)
+		return;
+	
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	catalog->closed = 1;
+	
+	//Wake up everyone waiting to take a file so they can see it's closed
+	pthread_cond_broadcast(&(catalog->take_cond));
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+}
+
+int catalog_left(file_catalog_t *catalog)
+{
+	//If the catalog is NULL, there's nothing left
+	if(catalog == NULL)
+		return 0;
+	
+	pthread_mutex_lock(&(catalog->catalog_mutex));
+	int retval = catalog->count - catalog->next;
+	pthread_mutex_unlock(&(catalog->catalog_mutex));
+	
+	return retval;
+}
+
+int free_catalog(file_catalog_t *catalog)
+{
+	free(catalog->dir_ids);
+	free(catalog->sizes);
+	free(catalog->priorities);
+	free(catalog->locations);
+	free(catalog->name_offsets);
+	free(catalog->names);
+	free(catalog->order);
+	
+	pthread_mutex_destroy(&(catalog->catalog_mutex));
+	pthread_cond_destroy(&(catalog->take_cond));
+	
+	free(catalog);	//And free the catalog
+	return 0;
+}
+
+static void take_next(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority)
+{
+	int index = (catalog->order != NULL) ? catalog->order[catalog->next] : catalog->next;
+	catalog->next++;
+	
+	//The full path is the file's directory followed by its name, zeroed past it so it can be sent as is
+	memset(path, 0, path_len);
+	snprintf(path, path_len, "%s%s", catalog->dirs[catalog->dir_ids[index]], catalog->names + catalog->name_offsets[index]);
+	*file_size = catalog->sizes[index];
+	*priority = catalog->priorities[index];
+}
+
+static void sort_by_priority(int *order, int n, int *priorities, long long *locations)
+{
+	int *from = order, *to = malloc(sizeof(int) * (n > 0 ? n : 1));
+	
+	//Merge runs of width files into runs of twice that, until there's one run
+	for(int width = 1; width < n; width *= 2)
+	{
+		for(int start = 0; start < n; start += 2 * width)
+		{
+			int left = start, mid = (start + width < n) ? start + width : n;
+			int right = mid, end = (start + 2 * width < n) ? start + 2 * width : n;
+			int out = start;
+			
+			//Ties go to the left run, which was added first
+			while(left < mid && right < end)
+				to[out++] = comes_first(from[left], from[right], priorities, locations) ? from[left++] : from[right++];
+			
+			while(left < mid)
+				to[out++] = from[left++];
+			
+			while(right < end)
+				to[out++] = from[right++];
+		}
+		
+		int *temp = from;
+		from = to;
+		to = temp;
+	}
+	
+	//If the last merge went into the temporary buffer, copy it back
+	if(from != order)
+	{
+		memcpy(order, from, sizeof(int) * n);
+		to = from;
+	}
+	
+	free(to);
+}
+
+static int comes_first(int a, int b, int *priorities, long long *locations)
+{
+	if(priorities[a] != priorities[b])
+		return priorities[a] > priorities[b];	//Highest priority first
+	
+	return locations[a] <= locations[b];	//Then lowest location
+}
@@ -18,12 +18,41 @@ typedef struct _file_queue_t {
 	int size;						//Number of files in queue
 	int sum_file_size;				//Sum of file sizes of all files in queue
 	int modifying;					//1 if this queue is being modified; 0 otherwise
+	int closed;						//1 if nothing else will be enqueued; 0 otherwise
 	pthread_mutex_t queue_mutex;	//Mutex for thread safety
 	pthread_cond_t enqueue_cond;	//Enqueue condition variable
 	pthread_cond_t dequeue_cond;	//Dequeue condition variable
 	pthread_cond_t read_cond;		//General purpose read condition variable
 } file_queue_t;
 
+/*
+ * Defines a thread-safe catalog of files, for keeping track of a lot of them
+ * at once. Each file's size, priority, location and where its name starts are
+ * kept in arrays of their own, along with which of the catalog's directories
+ * it's in, and every name is kept in one blob relative to that directory, so a
+ * file costs its name and 26 bytes rather than two allocations and its full
+ * path. Files are taken out in the order they were added, or by priority then
+ * location once the catalog has been sorted.
+ */
+typedef struct _file_catalog_t {
+	char **dirs;					//Directories names are relative to
+	unsigned short *dir_ids;		//Which directory each file is in
+	int *sizes;						//Each file's size
+	int *priorities;				//Each file's priority
+	long long *locations;			//Where each file is on disk, for ordering files with the same priority
+	long long *name_offsets;		//Where each file's name starts in names
+	char *names;					//Every file's name, each terminated
+	int *order;						//The order files are taken out in, or NULL for the order they were added
+	int count;						//Number of files added
+	int capacity;					//Number of files there's room for
+	long long names_len;			//Bytes of names used
+	long long names_capacity;		//Bytes of names there's room for
+	int next;						//Index (into order if there is one) of the next file to take out
+	int closed;						//1 if nothing else will be added; 0 otherwise
+	pthread_mutex_t catalog_mutex;	//Mutex for thread safety
+	pthread_cond_t take_cond;		//Signaled when a file is added or the catalog is closed
+} file_catalog_t;
+
 /* QUEUE STUFF */
 
 /*
@@ -57,6 +86,27 @@ int enqueue(file_queue_t *queue, char *filename, int file_size, int priority);
  */
 char* dequeue(file_queue_t *queue, int *file_size, int *priority);
 
+/*
+ * Dequeues a file like dequeue(), but blocks while the queue is empty until
+ * either a file is enqueued or the queue is closed.
+ * Params: queue - the file to dequeue from.
+ *         file_size - a single int buffer that will contain the size of the
+ *         file dequeued on return.
+ *         priority - a single int buffer that will contain the priority of
+ *         the file dequeued on return.
+ * Returns: the name of the file that was dequeued, or NULL if the queue is
+ *          closed and empty.
+ */
+char* dequeue_wait(file_queue_t *queue, int *file_size, int *priority);
+
+/*
+ * Closes a queue, waking up everyone blocked in dequeue_wait(). Files already
+ * in the queue can still be dequeued.
+ * Params: queue - the queue to close.
+ * Returns: nothing
+ */
+void close_queue(file_queue_t *queue);
+
 /*
  * Gets the number of files in the queue.
  * Params: queue - the queue whose number of files should be returned.
@@ -64,6 +114,16 @@ char* dequeue(file_queue_t *queue, int *file_size, int *priority);
  */
 int queue_size(file_queue_t *queue);
 
+/*
+ * Gets the names of the files at the front of the queue without dequeueing
+ * them, in the order they'd be dequeued.
+ * Params: queue - the queue to look at.
+ *         files - a buffer for up to max file names, each malloc()'d.
+ *         max - the most file names to get.
+ * Returns: the number of file names put in files.
+ */
+int queue_peek(file_queue_t *queue, char **files, int max);
+
 /*
  * Gets the sum of all file sizes in the queue.
  * Params: queue - the queue whose sum of file sizes should be returned.
@@ -78,5 +138,90 @@ int queue_sum_file_size(file_queue_t *queue);
  */
 int free_queue(file_queue_t *queue);
 
+/* CATALOG STUFF */
+
+/*
+ * Initializes a catalog.
+ * Params: catalog - a file catalog that has already been allocated via
+ *         malloc().
+ *         dirs - the directories files can be in, each ending with '/'. The
+ *         catalog doesn't copy them, so they have to outlive it.
+ * Returns: catalog, after it's been initialized.
+ */
+file_catalog_t* init_catalog(file_catalog_t *catalog, char **dirs);
+
+/*
+ * Adds a file to the end of a catalog.
+ * Params: catalog - the catalog to add to.
+ *         dir_id - the index of the directory the file is in.
+ *         name - the file's name, relative to that directory.
+ *         file_size - the size of the file.
+ *         priority - the priority of the file.
+ *         location - where the file is on disk, or 0 if it doesn't matter.
+ * Returns: 0 if adding was successful; a nonzero value otherwise.
+ */
+int catalog_add(file_catalog_t *catalog, int dir_id, char *name, int file_size, int priority, long long location);
+
+/*
+ * Sorts the files that haven't been taken out yet by priority. When there are
+ * two or more files with the same priority level, the one with the lowest
+ * location is taken out first, then the one that was added first, like with a
+ * file queue.
+ * Params: catalog - the catalog to sort.
+ * Returns: nothing
+ */
+void catalog_sort(file_catalog_t *catalog);
+
+/*
+ * Takes the next file out of a catalog.
+ * Params: catalog - the catalog to take from.
+ *         path - a buffer that will contain the file's full path on return.
+ *         path_len - the size of path.
+ *         file_size - a single int buffer that will contain the size of the
+ *         file on return.
+ *         priority - a single int buffer that will contain the priority of
+ *         the file on return.
+ * Returns: 1 if a file was taken out; 0 if there's nothing to take.
+ */
+int catalog_take(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority);
+
+/*
+ * Takes the next file out of a catalog like catalog_take(), but blocks while
+ * there's nothing to take until either a file is added or the catalog is
+ * closed.
+ * Params: catalog - the catalog to take from.
+ *         path - a buffer that will contain the file's full path on return.
+ *         path_len - the size of path.
+ *         file_size - a single int buffer that will contain the size of the
+ *         file on return.
+ *         priority - a single int buffer that will contain the priority of
+ *         the file on return.
+ * Returns: 1 if a file was taken out; 0 if the catalog is closed and every
+ *          file has been taken.
+ */
+int catalog_take_wait(file_catalog_t *catalog, char *path, int path_len, int *file_size, int *priority);
+
+/*
+ * Closes a catalog, waking up everyone blocked in catalog_take_wait(). Files
+ * already in the catalog can still be taken.
+ * Params: catalog - the catalog to close.
+ * Returns: nothing
+ */
+void close_catalog(file_catalog_t *catalog);
+
+/*
+ * Gets the number of files in a catalog that haven't been taken out yet.
+ * Params: catalog - the catalog whose number of files should be returned.
+ * Returns: the number of files left in the catalog.
+ */
+int catalog_left(file_catalog_t *catalog);
+
+/*
+ * Finalizes a catalog.
+ * Params: catalog - the catalog that should be finalized.
+ * Returns: 0 if finalization was successful; a nonzero value otherwise.
+ */
+int free_catalog(file_catalog_t *catalog);
+
 #endif //QUEUE_H_INCLUDED
 
@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dedup.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Defines a file in the seen set */
+typedef struct _dedup_entry_t {
+	uint64_t hash;		//Hash of the file's contents
+	uint64_t len;		//Length of the file's contents
+	int state;			//What a claim finds (DEDUP_NEW means the entry is empty)
+} dedup_entry_t;
+
+/* Defines one shard of the seen set */
+typedef struct _dedup_shard_t {
+	dedup_entry_t *entries;		//The shard, open addressed with linear probing
+	uint32_t cap;				//Number of entries allocated, always a power of two
+	uint32_t size;				//Number of files
+	pthread_mutex_t mutex;		//Protects the shard
+} dedup_shard_t;
+
+/* Static function prototypes */
+
+/*
+ * Rotates a 64-bit value left.
+ * Params: x - the value.
+ *         r - how far to rotate it.
+ * Returns: the rotated value.
+ */
+static uint64_t rotl64(uint64_t x, int r);
+
+/*
+ * Reads a little-endian 64-bit value that might not be aligned.
+ * Params: p - where to read it from.
+ * Returns: the value.
+ */
+static uint64_t read64(const unsigned char *p);
+
+/*
+ * Mixes 8 bytes of input into an XXH64 accumulator.
+ * Params: acc - the accumulator.
+ *         input - the input.
+ * Returns: the new accumulator.
+ */
+static uint64_t xxh_round(uint64_t acc, uint64_t input);
+
+/*
+ * Mixes a 32 byte stripe of input into the four XXH64 accumulators.
+ * Params: acc - the accumulators.
+ *         p - the stripe.
+ * Returns: nothing
+ */
+static void xxh_stripe(uint64_t *acc, const unsigned char *p);
+
+/*
+ * Finds a file's entry in a shard, adding an empty one if it isn't there.
+ * Grows the shard first if it's getting full. The shard has to be locked.
+ * Params: shard - the shard.
+ *         hash - the hash of the file's contents.
+ *         len - the length of the file's contents.
+ * Returns: the file's entry.
+ */
+static dedup_entry_t* find_entry(dedup_shard_t *shard, uint64_t hash, uint64_t len);
+
+/* dedup.h extern variables */
+int dedup_enabled = 0;
+long long dedup_duplicates = 0;
+
+/* Static variables */
+static dedup_shard_t shards[DEDUP_SHARDS];		//The seen set
+
+uint64_t dedup_hash(const void *data, size_t len)
+{
+	dedup_hasher_t hasher;
+	dedup_hash_start(&hasher);
+	dedup_hash_add(&hasher, data, len);
+	return dedup_hash_end(&hasher);
+}
+
+void dedup_hash_start(dedup_hasher_t *hasher)
+{
+	hasher->acc[0] = PRIME64_1 + PRIME64_2;
+	hasher->acc[1] = PRIME64_2;
+	hasher->acc[2] = 0;
+	hasher->acc[3] = -PRIME64_1;
+	hasher->total = 0;
+	hasher->rest_len = 0;
+}
+
+void dedup_hash_add(dedup_hasher_t *hasher, const void *data, size_t len)
+{
+	const unsigned char *p = data, *end = p + len;
+	hasher->total += len;
+	
+	//Finish the stripe the last piece left off in first
+	if(hasher->rest_len > 0)
+	{
+		size_t take = (len < 32 - hasher->rest_len) ? len : 32 - hasher->rest_len;
+		memcpy(hasher->rest + hasher->rest_len, p, take);
+		hasher->rest_len += take;
+		p += take;
+		
+		if(hasher->rest_len < 32)
+			return;
+		
+		xxh_stripe(hasher->acc, hasher->rest);
+		hasher->rest_len = 0;
+	}
+	
+	//Then go through the four accumulators, 32 bytes at a time
+	for(; p + 32 <= end; p += 32)
+		xxh_stripe(hasher->acc, p);
+	
+	//And keep what's left for the next piece
+	memcpy(hasher->rest, p, end - p);
+	hasher->rest_len = end - p;
+}
+
+uint64_t dedup_hash_end(dedup_hasher_t *hasher)
+{
+	const unsigned char *p = hasher->rest, *end = p + hasher->rest_len;
+	uint64_t *acc = hasher->acc, hash;
+	
+	//Long inputs went through the accumulators
+	if(hasher->total >= 32)
+	{
+		hash = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+		
+		for(int i = 0; i < 4; i++)
+			hash = (hash ^ xxh_round(0, acc[i])) * PRIME64_1 + PRIME64_4;
+	}
+	else
+		hash = PRIME64_5;
+	
+	hash += hasher->total;
+	
+	//Then whatever's left, 8, 4 and 1 bytes at a time
+	for(; p + 8 <= end; p += 8)
+		hash = rotl64(hash ^ xxh_round(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+	
+	if(p + 4 <= end)
+	{
+		uint64_t word = (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24);
+		hash = rotl64(hash ^ (word * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	
+	for(; p < end; p++)
+		hash = rotl64(hash ^ (*p * PRIME64_5), 11) * PRIME64_1;
+	
+	//And mix it all together
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+void dedup_init()
+{
+	for(int i = 0; i < DEDUP_SHARDS; i++)
+	{
+		shards[i].cap = DEDUP_INITIAL_CAP;
+		shards[i].size = 0;
+		shards[i].entries = calloc(shards[i].cap, sizeof(dedup_entry_t));
+		pthread_mutex_init(&(shards[i].mutex), NULL);
+	}
+}
+
+int dedup_set_claim(uint64_t hash, uint64_t len)
+{
+	//The top bits pick the shard, since the owner was picked with the bottom ones
+	dedup_shard_t *shard = &(shards[hash >> 60 & (DEDUP_SHARDS - 1)]);
+	pthread_mutex_lock(&(shard->mutex));
+	
+	dedup_entry_t *entry = find_entry(shard, hash, len);
+	int state = entry->state;
+	
+	if(state == DEDUP_NEW)
+		entry->state = DEDUP_PENDING;	//Whoever claimed it first processes it
+	
+	pthread_mutex_unlock(&(shard->mutex));
+	return state;
+}
+
+void dedup_set_report(uint64_t hash, uint64_t len, int matched)
+{
+	dedup_shard_t *shard = &(shards[hash >> 60 & (DEDUP_SHARDS - 1)]);
+	pthread_mutex_lock(&(shard->mutex));
+	find_entry(shard, hash, len)->state = matched ? DEDUP_MATCHED : DEDUP_UNMATCHED;
+	pthread_mutex_unlock(&(shard->mutex));
+}
+
+void dedup_cleanup()
+{
+	for(int i = 0; i < DEDUP_SHARDS; i++)
+	{
+		free(shards[i].entries);
+		shards[i].entries = NULL;
+		pthread_mutex_destroy(&(shards[i].mutex));
+	}
+}
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p)
+{
+	uint64_t value = 0;
+	
+	for(int i = 7; i >= 0; i--)
+		value = (value << 8) | p[i];
+	
+	return value;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	return rotl64(acc + input * PRIME64_2, 31) * PRIME64_1;
+}
+
+static void xxh_stripe(uint64_t *acc, const unsigned char *p)
+{
+	for(int i = 0; i < 4; i++)
+		acc[i] = xxh_round(acc[i], read64(p + 8 * i));
+}
+
+static dedup_entry_t* find_entry(dedup_shard_t *shard, uint64_t hash, uint64_t len)
+{
+	//Keep the shard under 70% full so probes stay short
+	if((shard->size + 1) * 10 > shard->cap * 7)
+	{
+		dedup_shard_t bigger = *shard;
+		bigger.cap = shard->cap * 2;
+		bigger.size = 0;
+		bigger.entries = calloc(bigger.cap, sizeof(dedup_entry_t));
+		
+		for(uint32_t i = 0; i < shard->cap; i++)
+			if(shard->entries[i].state != DEDUP_NEW)
+				*find_entry(&bigger, shard->entries[i].hash, shard->entries[i].len) = shard->entries[i];
+		
+		free(shard->entries);
+		shard->entries = bigger.entries;
+		shard->cap = bigger.cap;
+		shard->size = bigger.size;
+	}
+	
+	//The hash is already well mixed; its bottom bits picked the owner and its top bits the shard, so probe from the middle
+	uint32_t i = (uint32_t) (hash >> 24) & (shard->cap - 1);
+	
+	while(shard->entries[i].state != DEDUP_NEW && (shard->entries[i].hash != hash || shard->entries[i].len != len))
+		i = (i + 1) & (shard->cap - 1);
+	
+	if(shard->entries[i].state == DEDUP_NEW)
+	{
+		//Empty, so it's the file's entry from now on (the caller sets its state before letting go of the shard)
+		shard->entries[i].hash = hash;
+		shard->entries[i].len = len;
+		shard->size++;
+	}
+	
+	return &(shard->entries[i]);
+}
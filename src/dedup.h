@@ -0,0 +1,116 @@
+#ifndef DEDUP_H_INCLUDED
+#define DEDUP_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * With -dedup, sensors' retransmissions are only parsed once. As each file is
+ * read, its contents are hashed (XXH64), and the hash and length are claimed
+ * in a set of every file seen so far. What the claim finds decides what
+ * happens to the file:
+ *   - nothing: it's the first copy, so it's processed as usual and the set is
+ *     told whether it matched
+ *   - a copy that matched: it isn't parsed or printed, just archived
+ *   - a copy that didn't match: it's skipped
+ *   - a copy still being processed: it's parsed to see if it should be
+ *     archived, but isn't printed again
+ *
+ * The set is split into shards by hash, each behind its own lock. In fsch,
+ * every node owns the hashes that are its share of the nodes (hash modulo the
+ * number of nodes), and claims for hashes it doesn't own are sent to their
+ * owner. Segment records are hashed on their own; compressed files are hashed
+ * as they're stored, since retransmissions are byte-identical.
+ */
+
+#define DEDUP_SHARDS 16				//Locks the seen set is split between
+#define DEDUP_INITIAL_CAP 1024		//Entries each shard starts out with
+
+/* What a claim finds */
+enum {
+	DEDUP_NEW,			//Nobody had seen it; the claimer processes it
+	DEDUP_PENDING,		//Somebody else is still processing it
+	DEDUP_MATCHED,		//Somebody else processed it, and it matched
+	DEDUP_UNMATCHED		//Somebody else processed it, and it didn't match
+};
+
+/* Defines an XXH64 hash worked out a piece at a time, as data is read */
+typedef struct _dedup_hasher_t {
+	uint64_t acc[4];			//Accumulators, one per 8 bytes of each 32 byte stripe
+	uint64_t total;				//Bytes hashed so far
+	unsigned char rest[32];		//Bytes that haven't made up a whole stripe yet
+	size_t rest_len;			//Number of bytes in rest
+} dedup_hasher_t;
+
+/* Dedup variables */
+extern int dedup_enabled;				//1 if duplicate files are skipped; 0 otherwise
+extern long long dedup_duplicates;		//Number of duplicates this rank skipped parsing or printing
+
+/* Dedup functions */
+
+/*
+ * Hashes some data with XXH64 (seed 0).
+ * Params: data - the data.
+ *         len - the length of the data.
+ * Returns: the hash.
+ */
+uint64_t dedup_hash(const void *data, size_t len);
+
+/*
+ * Starts hashing data that comes a piece at a time. The hash is the same as
+ * dedup_hash() gives for all of the data at once.
+ * Params: hasher - the hasher to start.
+ * Returns: nothing
+ */
+void dedup_hash_start(dedup_hasher_t *hasher);
+
+/*
+ * Hashes the next piece of data.
+ * Params: hasher - the hasher.
+ *         data - the piece.
+ *         len - the length of the piece.
+ * Returns: nothing
+ */
+void dedup_hash_add(dedup_hasher_t *hasher, const void *data, size_t len);
+
+/*
+ * Finishes hashing.
+ * Params: hasher - the hasher.
+ * Returns: the hash of everything added.
+ */
+uint64_t dedup_hash_end(dedup_hasher_t *hasher);
+
+/*
+ * Initializes the seen set.
+ * Params: nothing
+ * Returns: nothing
+ */
+void dedup_init();
+
+/*
+ * Claims a file in this rank's share of the seen set, marking it as being
+ * processed if it's new.
+ * Params: hash - the hash of the file's contents.
+ *         len - the length of the file's contents.
+ * Returns: what the claim found (DEDUP_NEW if it's the first copy).
+ */
+int dedup_set_claim(uint64_t hash, uint64_t len);
+
+/*
+ * Records whether the first copy of a file matched, for the copies that come
+ * after it.
+ * Params: hash - the hash of the file's contents.
+ *         len - the length of the file's contents.
+ *         matched - 1 if it matched; 0 otherwise.
+ * Returns: nothing
+ */
+void dedup_set_report(uint64_t hash, uint64_t len, int matched);
+
+/*
+ * Frees the seen set.
+ * Params: nothing
+ * Returns: nothing
+ */
+void dedup_cleanup();
+
+#endif //DEDUP_H_INCLUDED
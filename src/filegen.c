@@ -0,0 +1,543 @@
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PRINT_USAGE() fprintf(stderr, \
+	  "******************************************** \
+	 \n** MATH 4777 Project Native File Generator ** \
+	 \n******************************************** \
+	 \nUsage: ./filegen <#files> <directory> [options] \
+	 \n Options: \
+	 \n   -s <chance>        = Chance of skipping each key (default: 0) \
+	 \n   -g <chance>        = Chance of garbage lines after each key (default: 0) \
+	 \n   -gm <lines>        = Max number of garbage lines after a key (default: 10) \
+	 \n   -gd <distribution> = Garbage line count distribution: uniform (default) or pareto \
+	 \n   -size <bytes>      = Pad files with garbage to this mean size (default: no padding) \
+	 \n   -sd <distribution> = File size distribution: fixed (default), uniform or pareto \
+	 \n   -alpha <alpha>     = Pareto shape; smaller is heavier-tailed (default: 1.5) \
+	 \n   -seed <seed>       = Random seed; same seed and time give the same files (default: time) \
+	 \n   -time <unix time>  = Time the newest file was written (default: now) \
+	 \n   -j <threads>       = Number of writer threads (default: one per core)\n")
+
+#define NUM_KEYS 13
+#define NUM_SENSORS 26
+#define NUM_LANGUAGES 13
+#define GARBAGE_LINE_LEN 18	//Two 8-character hex strings, '=' and '\n'
+#define MAX_PARETO_FACTOR 1000	//Pareto sizes are capped at this many times the mean
+
+/* Distributions for file sizes and garbage line counts */
+enum {
+	FIXED_DIST,
+	UNIFORM_DIST,
+	PARETO_DIST
+};
+
+/* Value types, matching keystypes in filegen.py */
+enum {
+	SENSORNAME_TYPE,
+	FIRMWARE_TYPE,
+	TIMESTAMP_TYPE,
+	UNIXTIMESTAMP_TYPE,
+	INT_TYPE,
+	MACHINEIP_TYPE,
+	LANGUAGE_TYPE
+};
+
+/* Defines a key and the type of value it holds */
+typedef struct _key_type_t {
+	char *key;
+	int type;
+} key_type_t;
+
+/* Defines a growable buffer a file's contents are built in */
+typedef struct _buffer_t {
+	char *data;		//Buffer contents
+	size_t len;		//Number of bytes used
+	size_t cap;		//Number of bytes allocated
+} buffer_t;
+
+/* Static function prototypes */
+
+/*
+ * The function each writer thread should run. Generates every file whose
+ * index is congruent to the thread's number modulo the number of threads.
+ * Params: arg - a pointer to the thread's number.
+ * Returns: NULL every time.
+ */
+static void* writer_thread_func(void *arg);
+
+/*
+ * Generates and writes a single file. Every random choice comes from a
+ * generator seeded from the global seed and the file's index, so the output
+ * doesn't depend on the number of threads.
+ * Params: index - the index of the file, in [0, # of files).
+ *         buf - a buffer to build the file's contents in.
+ * Returns: the number of bytes written, or -1 if the file couldn't be written.
+ */
+static long generate_file(long index, buffer_t *buf);
+
+/*
+ * Gets the next number from a splitmix64 generator.
+ * Params: state - the generator's state.
+ * Returns: a uniformly distributed 64-bit number.
+ */
+static uint64_t next_rand(uint64_t *state);
+
+/*
+ * Gets a random number in [low, high), like Python's random.randrange().
+ * Params: state - the generator's state.
+ *         low - the lowest number that can be returned.
+ *         high - one more than the highest number that can be returned.
+ * Returns: a random number in [low, high).
+ */
+static long rand_range(uint64_t *state, long low, long high);
+
+/*
+ * Gets a random number in [0, 1).
+ * Params: state - the generator's state.
+ * Returns: a random number in [0, 1).
+ */
+static double rand_unit(uint64_t *state);
+
+/*
+ * Draws a value from a distribution with a given mean.
+ * Params: state - the generator's state.
+ *         dist - the distribution to draw from.
+ *         mean - the mean of the distribution.
+ *         max - the largest value that can be returned.
+ * Returns: a value in [1, max].
+ */
+static long rand_dist(uint64_t *state, int dist, double mean, long max);
+
+/*
+ * Appends formatted text to a buffer, growing it if needed.
+ * Params: buf - the buffer to append to.
+ *         fmt - a printf() format string, followed by its arguments.
+ * Returns: nothing
+ */
+static void buf_printf(buffer_t *buf, const char *fmt, ...);
+
+/*
+ * Appends one random garbage key/value line to a buffer.
+ * Params: buf - the buffer to append to.
+ *         state - the generator's state.
+ * Returns: nothing
+ */
+static void append_garbage(buffer_t *buf, uint64_t *state);
+
+/*
+ * Parses a distribution name.
+ * Params: name - the name of the distribution.
+ * Returns: the distribution, or -1 if the name isn't valid.
+ */
+static int parse_dist(char *name);
+
+/* Constants, matching filegen.py */
+static key_type_t keys[NUM_KEYS] = {
+	{ "sensorname", SENSORNAME_TYPE },
+	{ "firmware", FIRMWARE_TYPE },
+	{ "timestamp", TIMESTAMP_TYPE },
+	{ "unixtimestamp", UNIXTIMESTAMP_TYPE },
+	{ "bytecount", INT_TYPE },
+	{ "packetcount", INT_TYPE },
+	{ "malwarecount", INT_TYPE },
+	{ "uptime", INT_TYPE },
+	{ "machineip", MACHINEIP_TYPE },
+	{ "language", LANGUAGE_TYPE },
+	{ "ipv4count", INT_TYPE },
+	{ "ipv6count", INT_TYPE },
+	{ "threatlevel", INT_TYPE }
+};
+
+static int sensors[NUM_SENSORS] = { 1, 2, 11, 12, 17, 18, 21, 23, 24, 27, 28, 40,
+	41, 42, 44, 45, 46, 48, 50, 54, 56, 57, 60, 61, 63, 64 };
+
+static char *sensornames[NUM_SENSORS - 1] = { "Alfa", "Bravo", "Charlie", "Delta",
+	"Echo", "Foxtrot", "Golf", "Hotel", "India", "Juliett", "Kilo", "Lima", "Mike",
+	"November", "Oscar", "Papa", "Quebec", "Romeo", "Sierra", "Tango", "Uniform",
+	"Victor", "Whiskey", "Xray", "Zulu" };
+
+static char *languages[NUM_LANGUAGES] = { "English", "Spanish", "French", "Italian",
+	"Afrikaans", "Korean", "Chinese", "Japanese", "Dutch", "German", "Greek",
+	"Portuguese", "Russian" };
+
+/* Options */
+static char *directory;				//Directory to write files to
+static long num_files;				//Number of files to write
+static double skip_chance = 0;		//Chance of skipping each key
+static double garbage_chance = 0;	//Chance of garbage lines after each key
+static long garbage_max = 10;		//Max number of garbage lines after a key
+static int garbage_dist = UNIFORM_DIST;	//Garbage line count distribution
+static long target_size = 0;		//Mean file size to pad to, or 0 for no padding
+static int size_dist = FIXED_DIST;	//File size distribution
+static double alpha = 1.5;			//Pareto shape
+static uint64_t seed;				//Random seed
+static long base_time;				//Time the newest file was written
+static int num_threads;				//Number of writer threads
+
+/* Results, one slot per thread */
+static long *files_written;
+static long *bytes_written;
+
+int main(int argc, char *argv[])
+{
+	//Make sure we have a number of files and a directory to work with
+	if(argc < 3)
+	{
+		PRINT_USAGE();
+		return -1;
+	}
+	
+	num_files = atol(argv[1]);
+	
+	//Set the directory to work with, appending a '/' if it doesn't end with one
+	int dir_len = strlen(argv[2]);
+	directory = malloc(dir_len + 2);
+	strcpy(directory, argv[2]);
+	
+	if(dir_len == 0 || directory[dir_len - 1] != '/')
+		strcat(directory, "/");
+	
+	//Set the defaults that aren't constant
+	base_time = (long) time(NULL);
+	seed = (uint64_t) base_time;
+	num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	
+	//Then go through whatever options the user specified
+	for(int i = 3; i < argc; i++)
+	{
+		if(i + 1 >= argc)
+		{
+			PRINT_USAGE();
+			return -1;
+		}
+		
+		char *opt = argv[i], *val = argv[++i];
+		
+		if(!strcmp(opt, "-s"))
+			skip_chance = atof(val);
+		else if(!strcmp(opt, "-g"))
+			garbage_chance = atof(val);
+		else if(!strcmp(opt, "-gm"))
+			garbage_max = atol(val);
+		else if(!strcmp(opt, "-gd"))
+			garbage_dist = parse_dist(val);
+		else if(!strcmp(opt, "-size"))
+			target_size = atol(val);
+		else if(!strcmp(opt, "-sd"))
+			size_dist = parse_dist(val);
+		else if(!strcmp(opt, "-alpha"))
+			alpha = atof(val);
+		else if(!strcmp(opt, "-seed"))
+			seed = strtoull(val, NULL, 10);
+		else if(!strcmp(opt, "-time"))
+			base_time = atol(val);
+		else if(!strcmp(opt, "-j"))
+			num_threads = atoi(val);
+		else
+		{
+			PRINT_USAGE();
+			return -1;
+		}
+	}
+	
+	//Make sure the options make sense
+	if(num_files < 0 || garbage_max < 2 || garbage_dist == -1 || size_dist == -1 || alpha <= 1 || num_threads < 1)
+	{
+		PRINT_USAGE();
+		return -1;
+	}
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);	//Get the start time
+	
+	//Start the writer threads and wait for them to finish
+	pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+	int *thread_ids = malloc(sizeof(int) * num_threads);
+	files_written = calloc(num_threads, sizeof(long));
+	bytes_written = calloc(num_threads, sizeof(long));
+	
+	for(int i = 0; i < num_threads; i++)
+	{
+		thread_ids[i] = i;
+		pthread_create(&threads[i], NULL, writer_thread_func, &thread_ids[i]);
+	}
+	
+	long total_files = 0, total_bytes = 0;
+	
+	for(int i = 0; i < num_threads; i++)
+	{
+		pthread_join(threads[i], NULL);
+		total_files += files_written[i];
+		total_bytes += bytes_written[i];
+	}
+	
+	//Get the total time this ran for
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+	printf("Wrote %ld files (%ld bytes) to %s in %f seconds\n", total_files, total_bytes, directory, seconds);
+	
+	free(threads);
+	free(thread_ids);
+	free(files_written);
+	free(bytes_written);
+	free(directory);
+	
+	return (total_files == num_files) ? 0 : 1;
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* writer_thread_func(void *arg)
+{
+	int id = *((int*) arg);
+	buffer_t buf = { malloc(4096), 0, 4096 };
+	
+	for(long i = id; i < num_files; i += num_threads)
+	{
+		long written = generate_file(i, &buf);
+		
+		if(written < 0)
+		{
+			fprintf(stderr, "Couldn't write file %ld to %s\n", i, directory);
+			break;
+		}
+		
+		files_written[id]++;
+		bytes_written[id] += written;
+	}
+	
+	free(buf.data);
+	return NULL;	//We actually don't return anything useful
+}
+
+static long generate_file(long index, buffer_t *buf)
+{
+	//Seed this file's generator from the global seed and the file's index
+	uint64_t state = seed ^ ((uint64_t) index * 0x9E3779B97F4A7C15ULL);
+	next_rand(&state);
+	
+	int sensor = rand_range(&state, 0, NUM_SENSORS - 1);
+	long rand_time = rand_range(&state, base_time / 1000, base_time);
+	
+	//Shuffle the keys
+	int order[NUM_KEYS];
+	
+	for(int i = 0; i < NUM_KEYS; i++)
+		order[i] = i;
+	
+	for(int i = NUM_KEYS - 1; i > 0; i--)
+	{
+		int j = rand_range(&state, 0, i + 1);
+		int temp = order[i];
+		order[i] = order[j];
+		order[j] = temp;
+	}
+	
+	//If we're padding files, figure out how many garbage lines to spread between the keys
+	long padding[NUM_KEYS + 1];
+	memset(padding, 0, sizeof(padding));
+	
+	if(target_size > 0)
+	{
+		long size = rand_dist(&state, size_dist, target_size, target_size * MAX_PARETO_FACTOR);
+		long lines = size / GARBAGE_LINE_LEN;
+		
+		for(long i = 0; i < lines; i++)
+			padding[rand_range(&state, 0, NUM_KEYS + 1)]++;
+	}
+	
+	buf->len = 0;
+	
+	for(long i = 0; i < padding[NUM_KEYS]; i++)
+		append_garbage(buf, &state);
+	
+	for(int i = 0; i < NUM_KEYS; i++)
+	{
+		key_type_t *key = &keys[order[i]];
+		
+		//Maybe skip this key
+		if(skip_chance > 0 && rand_unit(&state) < skip_chance)
+			continue;
+		
+		buf_printf(buf, "%s=", key->key);
+		
+		switch(key->type)
+		{
+			case SENSORNAME_TYPE:
+				buf_printf(buf, "%s", sensornames[sensor]);
+				break;
+			case FIRMWARE_TYPE:
+			{
+				long f1 = rand_range(&state, 1, 7);
+				long f2 = rand_range(&state, 11, 99);
+				long f3 = rand_range(&state, 1111, 9999);
+				buf_printf(buf, "%ld.%ld.%ld", f1, f2, f3);
+			} break;
+			case TIMESTAMP_TYPE:
+			{
+				time_t t = (time_t) rand_time;
+				struct tm tm;
+				char stamp[32];
+				localtime_r(&t, &tm);
+				strftime(stamp, sizeof(stamp), "%Y-%m-%d-%H-%M-%S", &tm);
+				buf_printf(buf, "%s", stamp);
+			} break;
+			case UNIXTIMESTAMP_TYPE:
+				buf_printf(buf, "%ld", rand_time);
+				break;
+			case INT_TYPE:
+				buf_printf(buf, "%llu", (unsigned long long) (next_rand(&state) >> 1));
+				break;
+			case MACHINEIP_TYPE:
+			{
+				long ip1 = rand_range(&state, 0, 255);
+				long ip2 = rand_range(&state, 0, 255);
+				long ip3 = rand_range(&state, 0, 255);
+				long ip4 = rand_range(&state, 0, 255);
+				buf_printf(buf, "%ld.%ld.%ld.%ld", ip1, ip2, ip3, ip4);
+			} break;
+			case LANGUAGE_TYPE:
+				buf_printf(buf, "%s", languages[rand_range(&state, 0, NUM_LANGUAGES - 1)]);
+				break;
+		}
+		
+		buf_printf(buf, "\n");
+		
+		//Maybe add some garbage after it
+		if(garbage_chance > 0 && rand_unit(&state) < garbage_chance)
+		{
+			long lines = (garbage_dist == PARETO_DIST) ?
+				rand_dist(&state, PARETO_DIST, 2, garbage_max - 1) :
+				rand_range(&state, 1, garbage_max);
+			
+			for(long j = 0; j < lines; j++)
+				append_garbage(buf, &state);
+		}
+		
+		for(long j = 0; j < padding[i]; j++)
+			append_garbage(buf, &state);
+	}
+	
+	//Name the file after its sensor and the time it was written, newest first
+	char filename[FILENAME_MAX];
+	snprintf(filename, FILENAME_MAX, "%s%d_%ld.sen", directory, sensors[sensor], base_time - index);
+	
+	//And write the whole thing at once
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	
+	if(fd < 0)
+		return -1;
+	
+	size_t done = 0;
+	
+	while(done < buf->len)
+	{
+		ssize_t ret = write(fd, buf->data + done, buf->len - done);
+		
+		if(ret <= 0)
+		{
+			close(fd);
+			return -1;
+		}
+		
+		done += ret;
+	}
+	
+	close(fd);
+	return (long) buf->len;
+}
+
+static uint64_t next_rand(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static long rand_range(uint64_t *state, long low, long high)
+{
+	return low + (long) (next_rand(state) % (uint64_t) (high - low));
+}
+
+static double rand_unit(uint64_t *state)
+{
+	return (next_rand(state) >> 11) * (1.0 / 9007199254740992.0);	//53 random bits
+}
+
+static long rand_dist(uint64_t *state, int dist, double mean, long max)
+{
+	double value;
+	
+	switch(dist)
+	{
+		case UNIFORM_DIST:
+			value = 1 + rand_unit(state) * (2 * mean - 1);
+			break;
+		case PARETO_DIST:
+		{
+			//Pick the Pareto scale so the distribution has the mean we want
+			double scale = mean * (alpha - 1) / alpha;
+			value = scale / pow(1 - rand_unit(state), 1 / alpha);
+		} break;
+		default:
+			value = mean;
+			break;
+	}
+	
+	if(value < 1)
+		return 1;
+	
+	return (value > max) ? max : (long) value;
+}
+
+static void buf_printf(buffer_t *buf, const char *fmt, ...)
+{
+	va_list args;
+	
+	//Try to print into what's left of the buffer
+	va_start(args, fmt);
+	int len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+	va_end(args);
+	
+	//If it didn't fit, grow the buffer and try again
+	if(buf->len + len + 1 > buf->cap)
+	{
+		while(buf->len + len + 1 > buf->cap)
+			buf->cap *= 2;
+		
+		buf->data = realloc(buf->data, buf->cap);
+		
+		va_start(args, fmt);
+		vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+		va_end(args);
+	}
+	
+	buf->len += len;
+}
+
+static void append_garbage(buffer_t *buf, uint64_t *state)
+{
+	uint64_t bits = next_rand(state);
+	buf_printf(buf, "%08x=%08x\n", (unsigned int) (bits >> 32), (unsigned int) (bits & 0xFFFFFFFF));
+}
+
+static int parse_dist(char *name)
+{
+	if(!strcmp(name, "fixed"))
+		return FIXED_DIST;
+	else if(!strcmp(name, "uniform"))
+		return UNIFORM_DIST;
+	else if(!strcmp(name, "pareto"))
+		return PARETO_DIST;
+	
+	return -1;
+}
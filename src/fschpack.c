@@ -0,0 +1,269 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compress.h"
+#include "segment.h"
+
+#define MAX_SEGMENT_NAMES 1000	//Names we try for a segment before giving up
+
+#define PRINT_USAGE() fprintf(stderr, \
+	  "************************************** \
+	 \n** MATH 4777 Project Segment Packer  ** \
+	 \n************************************** \
+	 \nUsage: ./fschpack <input directory> <output directory> [options] \
+	 \n Packs every .sen file in the input directory into segments, oldest first. \
+	 \n Options: \
+	 \n   -n <records> = Records per segment (default: 10000) \
+	 \n   -rm          = Remove each .sen file once it's been packed \
+	 \n   -z           = Compress each .sen file into a framed .sen.gz file instead\n")
+
+/* Defines a .sen file waiting to be packed */
+typedef struct _pack_file_t {
+	char *name;		//File name, without its directory
+	long time;		//Timestamp from the file name
+	int packed;		//1 once the file has been written to a segment; 0 until then
+} pack_file_t;
+
+/* Static function prototypes */
+
+/*
+ * Compares two files by timestamp, for qsort().
+ * Params: a - the first file.
+ *         b - the second file.
+ * Returns: a negative, zero or positive value if a is older, as old or newer
+ *          than b.
+ */
+static int compare_files(const void *a, const void *b);
+
+/*
+ * Reads a whole file into memory.
+ * Params: path - the full path to the file.
+ *         len - a single size_t buffer that will contain the length of the
+ *         file on return.
+ * Returns: a malloc()'d buffer with the file's contents, or NULL if it couldn't
+ *          be read.
+ */
+static char* read_file(char *path, size_t *len);
+
+int main(int argc, char *argv[])
+{
+	//Make sure we have input and output directories to work with
+	if(argc < 3)
+	{
+		PRINT_USAGE();
+		return -1;
+	}
+	
+	char *in_dir = argv[1], *out_dir = argv[2];
+	int per_segment = 10000, remove_files = 0, compress = 0;
+	
+	//Then go through whatever options the user specified
+	for(int i = 3; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-n") && i + 1 < argc)
+			per_segment = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-rm"))
+			remove_files = 1;
+		else if(!strcmp(argv[i], "-z"))
+			compress = 1;
+		else
+		{
+			PRINT_USAGE();
+			return -1;
+		}
+	}
+	
+	if(per_segment < 1)
+	{
+		PRINT_USAGE();
+		return -1;
+	}
+	
+	//Find every .sen file in the input directory
+	DIR *dir = opendir(in_dir);
+	
+	if(dir == NULL)
+	{
+		fprintf(stderr, "Couldn't open %s\n", in_dir);
+		return 1;
+	}
+	
+	pack_file_t *files = NULL;
+	int num_files = 0, cap = 0;
+	struct dirent *entry;
+	
+	while((entry = readdir(dir)) != NULL)
+	{
+		int len = strlen(entry->d_name);
+		
+		if(entry->d_name[0] == '.' || len < 4 || strcmp(entry->d_name + len - 4, ".sen"))
+			continue;
+		
+		if(num_files == cap)
+		{
+			cap = (cap == 0) ? 1024 : cap * 2;
+			files = realloc(files, sizeof(pack_file_t) * cap);
+		}
+		
+		char *underscore = strchr(entry->d_name, '_');
+		files[num_files].name = strdup(entry->d_name);
+		files[num_files].time = (underscore != NULL) ? atol(underscore + 1) : 0;
+		files[num_files].packed = 0;
+		num_files++;
+	}
+	
+	closedir(dir);
+	
+	//Pack them oldest first, so each segment covers a stretch of time
+	qsort(files, num_files, sizeof(pack_file_t), compare_files);
+	
+	int num_segments = 0, num_packed = 0;
+	
+	//Compressing is file by file, so there are no segments to fill
+	for(int i = 0; compress && i < num_files; i++)
+	{
+		char path[FILENAME_MAX], out_path[FILENAME_MAX];
+		snprintf(path, FILENAME_MAX, "%s/%s", in_dir, files[i].name);
+		snprintf(out_path, FILENAME_MAX, "%s/%s.gz", out_dir, files[i].name);
+		
+		if(compress_file(path, out_path))
+		{
+			fprintf(stderr, "Couldn't compress %s\n", path);
+			unlink(out_path);
+			continue;
+		}
+		
+		num_packed++;
+		
+		if(remove_files)
+			unlink(path);
+	}
+	
+	if(compress)
+		printf("Compressed %d files into %s\n", num_packed, out_dir);
+	
+	for(int first = 0; !compress && first < num_files; first += per_segment)
+	{
+		int last = (first + per_segment < num_files) ? first + per_segment : num_files;
+		
+		//Name the segment after its oldest record so -op still works on it
+		char seg_path[FILENAME_MAX];
+		snprintf(seg_path, FILENAME_MAX, "%s/pack_%ld_%d.seg", out_dir, files[first].time, num_segments);
+		seg_writer_t *writer = segment_writer_open(seg_path);
+		
+		//A segment that's already there (say, from packing into the same directory before) is never written over
+		for(int n = 1; writer == NULL && errno == EEXIST && n <= MAX_SEGMENT_NAMES; n++)
+		{
+			snprintf(seg_path, FILENAME_MAX, "%s/pack_%ld_%d-%d.seg", out_dir, files[first].time, num_segments, n);
+			writer = segment_writer_open(seg_path);
+		}
+		
+		if(writer == NULL)
+		{
+			fprintf(stderr, "Couldn't write %s\n", seg_path);
+			return 1;
+		}
+		
+		for(int i = first; i < last; i++)
+		{
+			char path[FILENAME_MAX];
+			size_t len;
+			snprintf(path, FILENAME_MAX, "%s/%s", in_dir, files[i].name);
+			
+			char *data = read_file(path, &len);
+			
+			if(data == NULL || segment_writer_add(writer, files[i].name, data, len))
+				fprintf(stderr, "Couldn't pack %s\n", path);
+			else
+			{
+				files[i].packed = 1;
+				num_packed++;
+			}
+			
+			free(data);
+		}
+		
+		if(segment_writer_close(writer))
+		{
+			fprintf(stderr, "Couldn't write %s\n", seg_path);
+			return 1;
+		}
+		
+		//Only remove the originals once their segment is safely written
+		if(remove_files)
+		{
+			for(int i = first; i < last; i++)
+			{
+				if(!files[i].packed)
+					continue;
+				
+				char path[FILENAME_MAX];
+				snprintf(path, FILENAME_MAX, "%s/%s", in_dir, files[i].name);
+				unlink(path);
+			}
+		}
+		
+		num_segments++;
+	}
+	
+	if(!compress)
+		printf("Packed %d files into %d segments in %s\n", num_packed, num_segments, out_dir);
+	
+	for(int i = 0; i < num_files; i++)
+		free(files[i].name);
+	
+	free(files);
+	return 0;
+}
+
+static int compare_files(const void *a, const void *b)
+{
+	long ta = ((pack_file_t*) a)->time, tb = ((pack_file_t*) b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+static char* read_file(char *path, size_t *len)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	
+	if(fd < 0)
+		return NULL;
+	
+	if(fstat(fd, &st))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	char *data = malloc(st.st_size + 1);
+	size_t done = 0;
+	
+	while(done < (size_t) st.st_size)
+	{
+		ssize_t ret = read(fd, data + done, st.st_size - done);
+		
+		if(ret <= 0)
+			break;
+		
+		done += ret;
+	}
+	
+	close(fd);
+	
+	//If we couldn't read all of it, don't pack half a file
+	if(done < (size_t) st.st_size)
+	{
+		free(data);
+		return NULL;
+	}
+	
+	*len = done;
+	return data;
+}
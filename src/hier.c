@@ -0,0 +1,240 @@
+#include <mpi.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+#include "central.h"
+#include "hier.h"
+#include "node.h"
+#include "timing.h"
+#include "trace.h"
+
+/* Static function prototypes */
+
+/*
+ * The function a sub-coordinator's archive thread should run. Listens for
+ * messages from the rest of its group.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time
+ */
+static void* leader_archive_thread_func(void *nothing);
+
+/* hier.h extern variables */
+MPI_Comm group_comm = MPI_COMM_NULL;
+int group_rank = 0;
+int group_size = 0;
+int is_leader = 0;
+int num_leaders = 0;
+
+/* Static variables */
+static int *group_ids = NULL;				//Each group rank's rank in MPI_COMM_WORLD
+static pthread_t leader_archive_thread;		//Sub-coordinator's thread that listens to its group
+
+void init_hier()
+{
+	//Group the nodes by host; the central machine stays out of every group
+	MPI_Comm host_comm;
+	MPI_Comm_split_type(MPI_COMM_WORLD, (proc_id == CENTRAL) ? MPI_UNDEFINED : MPI_COMM_TYPE_SHARED, proc_id, MPI_INFO_NULL, &host_comm);
+	
+	if(proc_id != CENTRAL)
+	{
+		//Split big hosts into smaller groups if we were asked to
+		if(hier_group_max > 0)
+		{
+			int host_rank;
+			MPI_Comm_rank(host_comm, &host_rank);
+			MPI_Comm_split(host_comm, host_rank / hier_group_max, host_rank, &group_comm);
+			MPI_Comm_free(&host_comm);
+		}
+		else
+			group_comm = host_comm;
+		
+		MPI_Comm_rank(group_comm, &group_rank);
+		MPI_Comm_size(group_comm, &group_size);
+		is_leader = (group_rank == 0);
+		
+		group_ids = malloc(sizeof(int) * group_size);
+		MPI_Allgather(&proc_id, 1, MPI_INT, group_ids, 1, MPI_INT, group_comm);
+		
+		//Sub-coordinators archive for themselves; everyone else reports to theirs
+		parent_comm = is_leader ? MPI_COMM_NULL : group_comm;
+		parent_rank = 0;
+		parent_id = group_ids[0];
+	}
+	
+	//The central machine needs to know how many sub-coordinators will ask it for files
+	MPI_Allreduce(&is_leader, &num_leaders, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+	
+	if(is_leader)
+	{
+		//Our targets are our group, with group rank r as target r + 1
+		target_count = group_size;
+		
+		if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
+			node_stats = calloc(group_size + 1, sizeof(int));
+		
+		if(reports_done())
+			init_estimates();
+		
+		pthread_create(&leader_archive_thread, NULL, leader_archive_thread_func, NULL);
+	}
+}
+
+void hier_central_work()
+{
+	start_scan();	//Start finding files, so we can hand them out as they're found
+	trace_thread_name("dispatch");
+	
+	chunk_entry_t *chunk = malloc(sizeof(chunk_entry_t) * hier_chunk);
+	int leaders_left = num_leaders;
+	
+	//Keep handing out chunks until every sub-coordinator has been told there are no more
+	while(leaders_left > 0)
+	{
+		//Wait for a sub-coordinator to ask for more
+		int request;
+		MPI_Status status;
+		MPI_Recv(&request, 1, MPI_INT, MPI_ANY_SOURCE, CHUNK_REQUEST_TAG, MPI_COMM_WORLD, &status);
+		
+		long long start = timing_start();
+		int count = 0;
+		
+		//Fill a chunk with the best files we have left, waiting for the first if they're still being found
+		int taken = catalog_take_wait(all_files, chunk[0].name, FILE_NAME_LEN, &(chunk[0].file_size), &(chunk[0].priority));
+		
+		//Never hand a group more than its share of what's left, so a small batch still goes to every group
+		int limit = (catalog_left(all_files) + num_leaders) / num_leaders;	//The first file has already been taken out
+		
+		if(limit > hier_chunk)
+			limit = hier_chunk;
+		
+		while(taken)
+		{
+			trace_instant(DISPATCHED_EVENT, chunk[count].name, status.MPI_SOURCE);
+			count++;
+			
+			//The rest of the chunk is whatever's been found already
+			taken = (count < limit) && catalog_take(all_files, chunk[count].name, FILE_NAME_LEN, &(chunk[count].file_size), &(chunk[count].priority));
+		}
+		
+		//An empty chunk tells the sub-coordinator there are no more files
+		long long send_start = trace_now();
+		MPI_Send(chunk, count * sizeof(chunk_entry_t), MPI_BYTE, status.MPI_SOURCE, FILE_CHUNK_TAG, MPI_COMM_WORLD);
+		trace_span(MPI_SEND_EVENT, (count > 0) ? chunk[0].name : "", status.MPI_SOURCE, send_start);
+		files_dispatched += count;
+		timing_stop(DISPATCH_PHASE, start);
+		
+		if(count == 0)
+			leaders_left--;
+	}
+	
+	finish_scan();
+	free(chunk);
+}
+
+void leader_work()
+{
+	trace_thread_name("dispatch");
+	chunk_entry_t *chunk = malloc(sizeof(chunk_entry_t) * hier_chunk);
+	int count;
+	
+	do
+	{
+		//Ask the central machine for more files
+		int request = 1, bytes;
+		MPI_Status status;
+		long long recv_start = trace_now();
+		MPI_Send(&request, 1, MPI_INT, CENTRAL, CHUNK_REQUEST_TAG, MPI_COMM_WORLD);
+		MPI_Recv(chunk, hier_chunk * sizeof(chunk_entry_t), MPI_BYTE, CENTRAL, FILE_CHUNK_TAG, MPI_COMM_WORLD, &status);
+		MPI_Get_count(&status, MPI_BYTE, &bytes);
+		count = bytes / sizeof(chunk_entry_t);
+		trace_span(MPI_RECV_EVENT, (count > 0) ? chunk[0].name : "", CENTRAL, recv_start);
+		
+		set_files_per_proc(count);	//Block scheduling splits each chunk across the group
+		
+		//Hand out every file in the chunk
+		for(int i = 0; i < count; i++)
+		{
+			long long start = timing_start();
+			trace_instant(RECEIVED_EVENT, chunk[i].name, CENTRAL);
+			
+			//Our own queue's data is right here; the rest of the group sends theirs
+			if(sched_type == QUEUE_SIZE)
+				node_stats[1] = queue_sum_file_size(file_queue);
+			else if(sched_type == QUEUE_LENGTH)
+				node_stats[1] = queue_size(file_queue);
+			
+			int best = get_best_proc(chunk[i].file_size) - 1;	//Target t is group rank t - 1
+			
+			if(best == 0)
+				enqueue(file_queue, chunk[i].name, chunk[i].file_size, chunk[i].priority);
+			else
+			{
+				long long send_start = trace_now();
+				MPI_Send(chunk[i].name, FILE_NAME_LEN, MPI_CHAR, best, FILE_NAME_TAG, group_comm);
+				MPI_Send(&(chunk[i].file_size), 1, MPI_INT, best, FILE_SIZE_TAG, group_comm);
+				MPI_Send(&(chunk[i].priority), 1, MPI_INT, best, FILE_PRIORITY_TAG, group_comm);
+				trace_span(MPI_SEND_EVENT, chunk[i].name, group_ids[best], send_start);
+			}
+			
+			trace_instant(DISPATCHED_EVENT, chunk[i].name, group_ids[best]);
+			timing_stop(DISPATCH_PHASE, start);
+		}
+	} while(count > 0);
+	
+	//Tell the rest of the group there's no more files left
+	int stop = 1;
+	
+	for(int i = 1; i < group_size; i++)
+		MPI_Send(&stop, 1, MPI_INT, i, STOP_TAG, group_comm);
+	
+	free(chunk);
+}
+
+void leader_archive_file(char *filepath)
+{
+	//Our archive thread moves files for the rest of the group, so take turns
+	pthread_mutex_lock(&archive_mutex);
+	long long start = timing_start(), move_start = trace_now();
+	move_file(filepath);
+	trace_span(ARCHIVE_EVENT, filepath, -1, move_start);
+	timing_stop(ARCHIVE_PHASE, start);
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+void leader_archive_record(char *segpath, int index)
+{
+	//Same as leader_archive_file(), but for a single record of a segment
+	pthread_mutex_lock(&archive_mutex);
+	long long start = timing_start(), move_start = trace_now();
+	move_record(segpath, index);
+	trace_span(ARCHIVE_EVENT, segpath, -1, move_start);
+	timing_stop(ARCHIVE_PHASE, start);
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+void leader_cleanup()
+{
+	pthread_join(leader_archive_thread, NULL);	//Wait for the rest of the group to stop
+	finish_archive();	//Finish any archive segments we were writing
+	
+	if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
+		free(node_stats);
+	
+	if(reports_done())
+		free_estimates();
+	
+	free(group_ids);
+	MPI_Comm_free(&group_comm);
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* leader_archive_thread_func(void *nothing)
+{
+	//We don't actually use the parameter for anything
+	affinity_bind(0);	//We share a CPU with the other communication threads
+	trace_thread_name("archive");
+	archive_listener(group_comm, group_ids, 1);	//Group rank r is target r + 1
+	return NULL;	//And we actually don't return anything useful
+}
@@ -0,0 +1,89 @@
+#ifndef HIER_H_INCLUDED
+#define HIER_H_INCLUDED
+
+#include <mpi.h>
+#include "univ.h"
+
+/*
+ * In hierarchical mode (-hier), the nodes are split into groups, one per host
+ * (or smaller, with -group). The lowest rank in each group is its
+ * sub-coordinator: it asks the central machine for a chunk of files at a time,
+ * hands each one to the best node in its group with get_best_proc(), and
+ * archives for its group. Sub-coordinators process files too. A chunk is
+ * never more than an even share of the files left between the groups, so
+ * every group gets work even when there are fewer files than a chunk per
+ * group.
+ *
+ * The central machine only ever talks to sub-coordinators, once per chunk, so
+ * its load grows with the number of groups rather than the number of nodes.
+ * Nodes report to their sub-coordinator on a communicator of their own, so
+ * none of their messages reach the central machine.
+ */
+
+/* Defines a file in a chunk the central machine hands a sub-coordinator */
+typedef struct _chunk_entry_t {
+	char name[FILE_NAME_LEN];	//Full path to the file
+	int file_size;				//Size of the file
+	int priority;				//Priority of the file
+} chunk_entry_t;
+
+/* Hierarchy variables */
+extern MPI_Comm group_comm;		//Communicator of our group, or MPI_COMM_NULL on the central machine
+extern int group_rank;			//Our rank in group_comm; 0 is the sub-coordinator
+extern int group_size;			//Number of nodes in our group
+extern int is_leader;			//1 if we're our group's sub-coordinator; 0 otherwise
+extern int num_leaders;			//Number of sub-coordinators (and groups)
+
+/* Hierarchy functions */
+
+/*
+ * Splits the nodes into groups and works out who reports to whom. Every rank
+ * has to call this, before init_central() or init_node(). Sub-coordinators
+ * also start listening for their group's messages.
+ * Params: nothing
+ * Returns: nothing
+ */
+void init_hier();
+
+/*
+ * Does the central machine's work in hierarchical mode: scans the file
+ * directory, then hands out chunks of files to whichever sub-coordinator asks
+ * for one next, until every one of them has been told there are no more.
+ * Params: nothing
+ * Returns: nothing
+ */
+void hier_central_work();
+
+/*
+ * Does a sub-coordinator's work: asks the central machine for chunks of files
+ * and hands each file to the best node in the group (possibly ourselves),
+ * until there are no more. Then tells the rest of the group to stop.
+ * Params: nothing
+ * Returns: nothing
+ */
+void leader_work();
+
+/*
+ * Archives a file a sub-coordinator processed itself.
+ * Params: filepath - the full path to the file.
+ * Returns: nothing
+ */
+void leader_archive_file(char *filepath);
+
+/*
+ * Archives a single record of a segment a sub-coordinator processed itself.
+ * Params: segpath - the full path to the segment.
+ *         index - the index of the record in the segment.
+ * Returns: nothing
+ */
+void leader_archive_record(char *segpath, int index);
+
+/*
+ * Finalizes a sub-coordinator, waiting for the rest of its group to stop and
+ * finishing its archive. Call after node_cleanup().
+ * Params: nothing
+ * Returns: nothing
+ */
+void leader_cleanup();
+
+#endif //HIER_H_INCLUDED
@@ -1,173 +1,154 @@
 #include <mpi.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "affinity.h"
+#include "agg.h"
 #include "central.h"
+#include "dedup.h"
+#include "hier.h"
 #include "node.h"
+#include "result.h"
+#include "rma.h"
+#include "shmq.h"
+#include "sla.h"
+#include "spec.h"
+#include "status.h"
+#include "timing.h"
+#include "trace.h"
 #include "univ.h"
-
-#define PRINT_USAGE() fprintf(stderr, \
-	  "************************************** \
-	 \n** MATH 4777 Project File Scheduler ** \
-	 \n************************************** \
-	 \nUsage: ./fsch <file directory> <archive directory> <search key> [scheduling algorithm] [priority options] \
-	 \n Scheduling algorithms: \
-	 \n   -c  = Cyclic distribution (default) \
-	 \n   -b  = Block distribution \
-	 \n   -r  = Random distribution \
-	 \n   -qs = Queue size distribution \
-	 \n   -ql = Queue length distribution \
-	 \n Priority options: \
-	 \n   -n  = No priority (default) \
-	 \n   -op = Oldest files given priority\n")
+#include "walk.h"
 
 /* Static unction prototypes */
 static void central_work();
 static void node_work();
-
-/* univ.h extern variables */
-char *file_dir_str;
-char *archive_dir_str;
-char *search_key;
-int proc_count;
-int proc_id;
-int sched_type;
-int priority_option;
+static void report_timing();
+static void report_trace();
+static void report_aggregates();
+static void report_sla();
 
 int main(int argc, char *argv[])
 {
-	//Make sure we have file and archive directories and search key to work with
-    if(argc < 4)
-    {
-    	PRINT_USAGE();
-        return -1;
-    }
-    
-    //Initialize MPI
-	MPI_Init(&argc, &argv);
+    //Initialize MPI; the archive and process threads make MPI calls too, so we need full thread support
+	int provided;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
 	MPI_Comm_size(MPI_COMM_WORLD, &proc_count);
 	MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+	target_count = proc_count - 1;	//Every node is a target
 	
-	srand(time(NULL));	//Seed the generator
-    
-	//Set the file directory to work with
-	int file_len = strlen(argv[1]);
-	file_dir_str = malloc(file_len);
-	strcpy(file_dir_str, argv[1]);
+	if(provided < MPI_THREAD_MULTIPLE && proc_id == CENTRAL)
+		fprintf(stderr, "Warning: this MPI doesn't support MPI_THREAD_MULTIPLE, so threads may step on each other\n");
 	
-	//If the directory doesn't end with '/', we need to append it
-	if(file_dir_str[file_len - 1] != '/')
+	//Get the directories, search key and options we're working with
+	if(parse_args(argc, argv))
 	{
-		//So allocate an additional spot for it
-		file_dir_str = realloc(file_dir_str, file_len + 1);
-		strcat(file_dir_str, "/");
+		MPI_Finalize();
+		return -1;
 	}
 	
-	//Set the archive directory to work with
-	int archive_len = strlen(argv[2]);
-	archive_dir_str = malloc(archive_len);
-	strcpy(archive_dir_str, argv[2]);
+	srand(time(NULL));	//Seed the generator
+	
+	double start = MPI_Wtime();	//Get the start time
 	
-	//If the directory doesn't end with '/', we need to append it it
-	if(archive_dir_str[archive_len - 1] != '/')
+	//If we're pinning threads, split this host's CPUs between the ranks on it before anyone starts a thread
+	if(bind_mode != BIND_NONE)
 	{
-		//So allocate an additional spot for it
-		archive_dir_str = realloc(archive_dir_str, archive_len + 1);
-		strcat(archive_dir_str, "/");
+		MPI_Comm host_comm;
+		int host_rank, host_size;
+		MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, proc_id, MPI_INFO_NULL, &host_comm);
+		MPI_Comm_rank(host_comm, &host_rank);
+		MPI_Comm_size(host_comm, &host_size);
+		MPI_Comm_free(&host_comm);
+		
+		if(affinity_init(host_rank, host_size))
+			fprintf(stderr, "%d couldn't work out which CPUs to use, so it won't pin anything\n", proc_id);
+		
+		affinity_bind(0);	//This thread receives or dispatches files
+		affinity_print(proc_id);
 	}
 	
-	//Get the word to search for
-	search_key = malloc(strlen(argv[3]));
-	strcpy(search_key, argv[3]);
+	//If we're skipping duplicates, the nodes need a communicator of their own to claim files on
+	if(dedup_enabled)
+		MPI_Comm_split(MPI_COMM_WORLD, (proc_id == CENTRAL) ? MPI_UNDEFINED : 0, proc_id, &dedup_comm);
 	
-	//First, set the default scheduling algorithm and priority option
-	sched_type = CYCLIC;
-	priority_option = NO_PRIORITY;
-
-	//If the user specified a priority option, use it
-	if(argc >= 6)
-	{
-		switch(argv[5][1])
-		{
-			case 'n':
-				priority_option = NO_PRIORITY;
-				break;
-			case 'o':
-				switch(argv[5][2])
-				{
-					case 'p':
-						priority_option = OLDEST_FILE_PRIORITY;
-						break;
-					default:
-						PRINT_USAGE();
-						return -1;
-				}
-				
-				break;
-			default:
-				PRINT_USAGE();
-				return -1;
-		}
-	}
+	if(hier_enabled)
+		init_hier();	//Split the nodes into groups before anyone starts listening for messages
 	
-	//If the user specified a scheduling algorithm, use it
-	if(argc >= 5)
-	{
-		switch(argv[4][1])
-		{
-			case 'c':
-				sched_type = CYCLIC;
-				break;
-			case 'b':
-				sched_type = BLOCK;
-				break;
-			case 'r':
-				sched_type = RANDOM;
-				break;
-			case 'q':
-				switch(argv[4][2])
-				{
-					case 's':
-						sched_type = QUEUE_SIZE;
-						break;
-					case 'l':
-						sched_type = QUEUE_LENGTH;
-						break;
-					default:
-						PRINT_USAGE();
-						return -1;
-				}
-				
-				break;
-			default:
-				PRINT_USAGE();
-				return -1;
-		}
-	}
+	if(shm_enabled)
+		init_shm();	//Set up each host's shared queue, and make the hosts the central machine's targets
 	
-	clock_t start = clock();	//Get the start time
+	if(speculate_pct > 0)
+		spec_start();	//Start keeping track of every node before anyone starts a file
 	
 	if(proc_id == CENTRAL)
 		init_central();	//If we're the central machine, initialize us as the central machine
 	else
 		init_node();	//Otherwise, initialize us as a node
 	
+	if(status_path != NULL)
+		status_start();	//Start answering (or feeding) status connections
+	
+	//Every node writes its results to a file of its own (the central machine never finds a match)
+	if(proc_id != CENTRAL && result_init(proc_id))
+		fprintf(stderr, "%d couldn't open %s.%d, so it won't write results\n", proc_id, result_path, proc_id);
+	
 	MPI_Barrier(MPI_COMM_WORLD);	//Wait for everyone to finish initializing before continuing
+	trace_start_clock();	//Everyone leaves the barrier together, so start the trace clock now
 	
-    if(proc_id == CENTRAL)
+    if(proc_id == CENTRAL && hier_enabled)
+    	hier_central_work();	//If we're the central machine with sub-coordinators, hand them chunks of files
+    else if(proc_id == CENTRAL && rma_enabled)
+    	rma_central_work();	//If we're the central machine and nodes claim their own files, publish them
+    else if(proc_id == CENTRAL)
         central_work();	//If we're the central machine, do central machine work
+    else if(is_leader)
+    	leader_work();	//If we're a sub-coordinator, hand our group its files
+    else if(rma_enabled)
+    	rma_node_work();	//If we claim our own files, let our process thread claim them
     else
         node_work();	//Otherwise, do node work
     
     MPI_Barrier(MPI_COMM_WORLD);	//Wait for everyone to finish doing what they're doing
     
+    if(status_path != NULL)
+    	status_stop();	//Stop reporting while our queues are still around to report on
+    
     if(proc_id == CENTRAL)
     	central_cleanup();	//If we're the central machine, finalize us as the central machine
     else
+    {
     	node_cleanup();	//Otherwise, finalize us as a node
+    	
+    	if(is_leader)
+    		leader_cleanup();	//And as a sub-coordinator if we are one
+    }
+    
+    result_cleanup();	//Our process thread is done, so write out whatever results it has left
+    
+    if(speculate_pct > 0)
+    	spec_stop();
+    
+    if(shm_enabled)
+    	shm_cleanup();
+    
+    //Gather how much work every node did so we can see how balanced it was
+    long long work[3] = { files_processed, bytes_processed, dedup_duplicates };
+    long long *all_work = (proc_id == CENTRAL) ? malloc(sizeof(work) * proc_count) : NULL;
+    MPI_Gather(work, 3, MPI_LONG_LONG, all_work, 3, MPI_LONG_LONG, CENTRAL, MPI_COMM_WORLD);
+    
+    if(timing_enabled)
+    	report_timing();
+    
+    if(trace_enabled)
+    	report_trace();
+    
+    if(agg_key != NULL)
+    	report_aggregates();
     
     //Free all strings we malloc()'d
+    walk_cleanup();
     free(file_dir_str);
     free(archive_dir_str);
     free(search_key);
@@ -177,38 +158,72 @@ int main(int argc, char *argv[])
     //If we're the central machine, we should be the last to exit, so get the total time this ran for
     if(proc_id == CENTRAL)
     {
-    	clock_t now = clock();
-    	int diff = (int) (now - start);
-    	float seconds = (float) diff / CLOCKS_PER_SEC;
-    	printf("TOTAL RUNTIME: %f seconds!\n", seconds);
+    	double seconds = MPI_Wtime() - start;
+    	result_log(VERBOSE_QUIET, "TOTAL RUNTIME: %f seconds!\n", seconds);
+    	
+    	long long duplicates = 0;
+    	
+    	for(int i = 1; i < proc_count; i++)
+    	{
+    		result_log(VERBOSE_QUIET, "NODE %d PROCESSED: %lld files, %lld bytes\n", i, all_work[3 * i], all_work[3 * i + 1]);
+    		duplicates += all_work[3 * i + 2];
+    	}
+    	
+    	if(dedup_enabled)
+    		result_log(VERBOSE_QUIET, "DUPLICATES SKIPPED: %lld\n", duplicates);
+    	
+    	if(speculate_pct > 0)
+    		result_log(VERBOSE_QUIET, "STRAGGLERS COPIED: %lld (%lld finished first)\n", spec_copies, spec_wins);
+    	
+    	free(all_work);
     }
     
+    if(sla_seconds > 0)
+    	report_sla();
+    
+    affinity_cleanup();
     MPI_Finalize();
     return 0;
 }
 
 static void central_work()
 {
-	int total_files = enqueue_all_files();	//Get the total number of files we found
-	files_per_proc = (proc_count > 1) ? total_files / (proc_count - 1) : 1;	//Get the number of files per node for block scheduling
-	
-	//Adjust so we don't accidentally leave any nodes out
-	if(total_files % (proc_count - 1) != 0)
-		files_per_proc--;
+	start_scan();	//Start finding files, so we can send them out as they're found
+	trace_thread_name("dispatch");
 	
 	//For each file we found...
-    while(queue_size(all_files) > 0)
+	int file_size, priority;
+	char name_buf[FILE_NAME_LEN];
+	
+    while(catalog_take_wait(all_files, name_buf, FILE_NAME_LEN, &file_size, &priority))	//Get the file...
     {	
-    	int file_size, priority;
-    	char *filename = dequeue(all_files, &file_size, &priority);	//Get the file...
-	    int best_proc = get_best_proc();	//...and get the best node to send this to
+    	long long start = timing_start();
+	    int best_proc = get_best_proc(file_size);	//...and get the best node to send this to
+	    
+	    //With shared queues, the target is a host, and its leader takes the file for it
+	    if(shm_enabled)
+	    	best_proc = host_leaders[best_proc];
+	    
+	    //With -speculate, keep track of how many files each node has left, so we can tell when one is stuck on one
+	    if(speculate_pct > 0)
+	    	spec_dispatched(best_proc);
 	    
 	    //And send the node all of its information
-	    MPI_Send(filename, FILE_NAME_LEN, MPI_CHAR, best_proc, FILE_NAME_TAG, MPI_COMM_WORLD);
+	    long long send_start = trace_now();
+	    MPI_Send(name_buf, FILE_NAME_LEN, MPI_CHAR, best_proc, FILE_NAME_TAG, MPI_COMM_WORLD);
 	    MPI_Send(&file_size, 1, MPI_INT, best_proc, FILE_SIZE_TAG, MPI_COMM_WORLD);
 	    MPI_Send(&priority, 1, MPI_INT, best_proc, FILE_PRIORITY_TAG, MPI_COMM_WORLD);
+	    trace_span(MPI_SEND_EVENT, name_buf, best_proc, send_start);
+	    trace_instant(DISPATCHED_EVENT, name_buf, best_proc);
+	    files_dispatched++;
+	    timing_stop(DISPATCH_PHASE, start);
     }
     
+    finish_scan();
+    
+    if(speculate_pct > 0)
+    	spec_tail();	//Copy stragglers onto idle nodes until every file is done
+    
     //Tell everyone else there's no more files left
     int stop = 1;
     
@@ -219,13 +234,15 @@ static void central_work()
 static void node_work()
 {
 	int out_of_files = 0;
+	trace_thread_name("receive");
 	
-	//While the central machine is still sending us files...
+	//Files come from whoever we report to: the central machine, or our sub-coordinator
+	//While they're still sending us files...
     while(!out_of_files)
     {
     	//See what kind of message we're getting
     	MPI_Status status;
-		MPI_Probe(CENTRAL, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		MPI_Probe(parent_rank, MPI_ANY_TAG, parent_comm, &status);
 		
 		switch(status.MPI_TAG)
 		{
@@ -234,13 +251,20 @@ static void node_work()
 				//Get the file's information
 				char filename[FILE_NAME_LEN];
 				int file_size, priority;
-				MPI_Recv(filename, FILE_NAME_LEN, MPI_CHAR, CENTRAL, FILE_NAME_TAG, MPI_COMM_WORLD, &status);
-				MPI_Recv(&file_size, 1, MPI_INT, CENTRAL, FILE_SIZE_TAG, MPI_COMM_WORLD, &status);
-				MPI_Recv(&priority, 1, MPI_INT, CENTRAL, FILE_PRIORITY_TAG, MPI_COMM_WORLD, &status);
+				long long recv_start = trace_now();
+				MPI_Recv(filename, FILE_NAME_LEN, MPI_CHAR, parent_rank, FILE_NAME_TAG, parent_comm, &status);
+				MPI_Recv(&file_size, 1, MPI_INT, parent_rank, FILE_SIZE_TAG, parent_comm, &status);
+				MPI_Recv(&priority, 1, MPI_INT, parent_rank, FILE_PRIORITY_TAG, parent_comm, &status);
+				trace_span(MPI_RECV_EVENT, filename, parent_id, recv_start);
+				trace_instant(RECEIVED_EVENT, filename, parent_id);
 				
-				enqueue(file_queue, filename, file_size, priority);	//And then enqueue it
+				//And then enqueue it, in our host's queue if we share one
+				if(shm_enabled)
+					shm_push(filename, file_size, priority);
+				else
+					enqueue(file_queue, filename, file_size, priority);
 				
-				//If we're using a scheduling algorithm that depends on node data, send it to the central machine
+				//If we're using a scheduling algorithm that depends on node data, send it to whoever we report to
 				if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
 				{
 					int data;
@@ -248,25 +272,222 @@ static void node_work()
 					switch(sched_type)
 					{
 						case QUEUE_SIZE:
-							data = file_queue->sum_file_size;
+							data = shm_enabled ? shm_bytes() : file_queue->sum_file_size;
 							break;
 						case QUEUE_LENGTH:
-							data = file_queue->size;
+							data = shm_enabled ? shm_length() : file_queue->size;
 							break;
 						default:
 							data = -1;	//Something went really wrong
 							break;
 					}
 
-					printf("%d is sending data...\n", proc_id);
-					MPI_Send(&data, 1, MPI_INT, CENTRAL, QUEUE_DATA_TAG, MPI_COMM_WORLD);
-					printf("%d sent data!\n", proc_id);
+					result_log(VERBOSE_FILES, "%d is sending data...\n", proc_id);
+					MPI_Send(&data, 1, MPI_INT, parent_rank, QUEUE_DATA_TAG, parent_comm);
+					result_log(VERBOSE_FILES, "%d sent data!\n", proc_id);
 				}
 			} break;
 			case STOP_TAG:	//Break us out of this loop
-				MPI_Recv(&out_of_files, 1, MPI_INT, CENTRAL, STOP_TAG, MPI_COMM_WORLD, &status);
+				MPI_Recv(&out_of_files, 1, MPI_INT, parent_rank, STOP_TAG, parent_comm, &status);
 				break;
 		}
     }
 }
 
+//Reduces every rank's phase timings to the central machine, which writes them out
+static void report_timing()
+{
+	//Merge the timings of every thread on this rank
+	timing_t *local = malloc(sizeof(timing_t));
+	timing_t *all = malloc(sizeof(timing_t));
+	init_timing(local);
+	init_timing(all);
+	timing_merge_threads(local);
+	
+	//Gather each rank's total time per phase so we can see how balanced they were
+	long long totals[NUM_PHASES];
+	
+	for(int i = 0; i < NUM_PHASES; i++)
+		totals[i] = local->phases[i].total_ns;
+	
+	long long *rank_totals = (proc_id == CENTRAL) ? malloc(sizeof(totals) * proc_count) : NULL;
+	MPI_Gather(totals, NUM_PHASES, MPI_LONG_LONG, rank_totals, NUM_PHASES, MPI_LONG_LONG, CENTRAL, MPI_COMM_WORLD);
+	
+	//Then reduce every phase's stats (count and total_ns are next to each other, so they go together)
+	for(int i = 0; i < NUM_PHASES; i++)
+	{
+		phase_stats_t *from = &(local->phases[i]), *to = &(all->phases[i]);
+		MPI_Reduce(&(from->count), &(to->count), 2, MPI_LONG_LONG, MPI_SUM, CENTRAL, MPI_COMM_WORLD);
+		MPI_Reduce(&(from->min_ns), &(to->min_ns), 1, MPI_LONG_LONG, MPI_MIN, CENTRAL, MPI_COMM_WORLD);
+		MPI_Reduce(&(from->max_ns), &(to->max_ns), 1, MPI_LONG_LONG, MPI_MAX, CENTRAL, MPI_COMM_WORLD);
+		MPI_Reduce(from->buckets, to->buckets, TIMING_BUCKETS, MPI_LONG_LONG, MPI_SUM, CENTRAL, MPI_COMM_WORLD);
+	}
+	
+	//The central machine writes the summary
+	if(proc_id == CENTRAL)
+	{
+		FILE *file = strcmp(timing_path, "-") ? fopen(timing_path, "w") : stdout;
+		
+		if(file != NULL)
+		{
+			timing_write_json(file, all, rank_totals, proc_count);
+			
+			if(file != stdout)
+				fclose(file);
+		}
+		else
+			fprintf(stderr, "Couldn't write timings to %s\n", timing_path);
+		
+		free(rank_totals);
+	}
+	
+	free(local);
+	free(all);
+	timing_cleanup();
+}
+
+//Gathers every rank's traced events to the central machine, which writes them out as one trace
+static void report_trace()
+{
+	//Render this rank's events
+	size_t len;
+	char *events = trace_render(proc_id, &len);
+	int my_len = (int) len;
+	
+	//Gather how long everyone's events are, then the events themselves
+	int *lens = NULL, *displs = NULL;
+	char *all_events = NULL;
+	
+	if(proc_id == CENTRAL)
+		lens = malloc(sizeof(int) * proc_count);
+	
+	MPI_Gather(&my_len, 1, MPI_INT, lens, 1, MPI_INT, CENTRAL, MPI_COMM_WORLD);
+	
+	if(proc_id == CENTRAL)
+	{
+		displs = malloc(sizeof(int) * proc_count);
+		int total = 0;
+		
+		for(int i = 0; i < proc_count; i++)
+		{
+			displs[i] = total;
+			total += lens[i];
+		}
+		
+		all_events = malloc(total);
+	}
+	
+	MPI_Gatherv(events, my_len, MPI_CHAR, all_events, lens, displs, MPI_CHAR, CENTRAL, MPI_COMM_WORLD);
+	
+	//The central machine writes the trace
+	if(proc_id == CENTRAL)
+	{
+		FILE *file = fopen(trace_path, "w");
+		
+		if(file != NULL)
+		{
+			trace_write(file, all_events, lens, proc_count);
+			fclose(file);
+		}
+		else
+			fprintf(stderr, "Couldn't write trace to %s\n", trace_path);
+		
+		free(lens);
+		free(displs);
+		free(all_events);
+	}
+	
+	free(events);
+	trace_cleanup();
+}
+
+//Merges every rank's aggregates up a binomial tree to the central machine, which prints the final table
+static void report_aggregates()
+{
+	//Merge the tables of every thread on this rank
+	agg_table_t table;
+	agg_init_table(&table);
+	agg_merge_threads(&table);
+	
+	//Use our own communicator, since the central machine's archive thread may still be probing for any tag on MPI_COMM_WORLD
+	MPI_Comm agg_comm;
+	MPI_Comm_dup(MPI_COMM_WORLD, &agg_comm);
+	
+	//At each step, every rank that's an odd multiple of the step sends its table to the rank one step below and drops out
+	for(int step = 1; step < proc_count; step <<= 1)
+	{
+		if(proc_id & step)
+		{
+			int count;
+			agg_entry_t *groups = agg_pack(&table, &count);
+			MPI_Send(groups, count * sizeof(agg_entry_t), MPI_BYTE, proc_id - step, AGG_TAG, agg_comm);
+			free(groups);
+			break;
+		}
+		else if(proc_id + step < proc_count)
+		{
+			//We don't know how many groups are coming until they're here
+			MPI_Status status;
+			int bytes;
+			MPI_Probe(proc_id + step, AGG_TAG, agg_comm, &status);
+			MPI_Get_count(&status, MPI_BYTE, &bytes);
+			
+			agg_entry_t *groups = malloc(bytes + sizeof(agg_entry_t));	//+ 1 entry so an empty table still gets a buffer
+			MPI_Recv(groups, bytes, MPI_BYTE, proc_id + step, AGG_TAG, agg_comm, &status);
+			agg_merge_entries(&table, groups, bytes / sizeof(agg_entry_t));
+			free(groups);
+		}
+	}
+	
+	MPI_Comm_free(&agg_comm);
+	
+	//The central machine ends up with everything
+	if(proc_id == CENTRAL)
+		agg_write(stdout, &table);
+	
+	agg_free_table(&table);
+	agg_cleanup();
+}
+
+//Gathers how late every file was to the central machine, which reports how many missed their deadline
+static void report_sla()
+{
+	int count;
+	double *lateness = sla_latenesses(&count);
+	
+	//Gather how many files everyone processed, then how late they were
+	int *counts = NULL, *displs = NULL;
+	double *all_lateness = NULL;
+	int total = 0;
+	
+	if(proc_id == CENTRAL)
+		counts = malloc(sizeof(int) * proc_count);
+	
+	MPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, CENTRAL, MPI_COMM_WORLD);
+	
+	if(proc_id == CENTRAL)
+	{
+		displs = malloc(sizeof(int) * proc_count);
+		
+		for(int i = 0; i < proc_count; i++)
+		{
+			displs[i] = total;
+			total += counts[i];
+		}
+		
+		all_lateness = malloc(sizeof(double) * (total + 1));
+	}
+	
+	MPI_Gatherv(lateness, count, MPI_DOUBLE, all_lateness, counts, displs, MPI_DOUBLE, CENTRAL, MPI_COMM_WORLD);
+	
+	//The central machine writes the report
+	if(proc_id == CENTRAL)
+	{
+		sla_write(stdout, all_lateness, total);
+		free(counts);
+		free(displs);
+		free(all_lateness);
+	}
+	
+	sla_cleanup();
+}
@@ -0,0 +1,354 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "affinity.h"
+#include "agg.h"
+#include "dedup.h"
+#include "prefetch.h"
+#include "process.h"
+#include "result.h"
+#include "sched.h"
+#include "sla.h"
+#include "timing.h"
+#include "trace.h"
+#include "univ.h"
+#include "walk.h"
+
+/* Static function prototypes */
+
+/*
+ * Scans the file directory and hands every file to the best worker according
+ * to the scheduling algorithm, just like the central machine does in fsch.
+ * Params: nothing
+ * Returns: nothing
+ */
+static void central_work();
+
+/*
+ * Refreshes node_stats from the workers' queues for the scheduling algorithms
+ * that depend on node data. Workers share our memory, so we just read their
+ * queues instead of waiting for them to tell us.
+ * Params: nothing
+ * Returns: nothing
+ */
+static void update_node_stats();
+
+/*
+ * The function each worker thread should run. Dequeues files from the
+ * worker's queue and calls process() on them.
+ * Params: arg - a pointer to the worker's number, in [1, proc_count).
+ * Returns: NULL every time.
+ */
+static void* worker_thread_func(void *arg);
+
+/* Static variables */
+static file_queue_t **worker_queues;	//Each worker's file queue, indexed like node ranks (0 is unused)
+static pthread_t *worker_threads;		//Each worker's thread, indexed like worker_queues
+static int *worker_ids;					//Each worker's number, passed to its thread
+static long long *worker_files;			//Number of files each worker has processed
+static long long *worker_bytes;			//Number of bytes each worker has processed
+static pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;	//Serializes archiving like the central machine does
+
+int main(int argc, char *argv[])
+{
+	//Get the directories, search key and options we're working with
+	if(parse_args(argc, argv))
+		return -1;
+	
+	//We're the central machine, and every worker thread is a node
+	proc_count = thread_count + 1;
+	proc_id = CENTRAL;
+	target_count = thread_count;
+	
+	srand(time(NULL));	//Seed the generator
+	
+	//If we're pinning threads, we have every CPU to ourselves; this thread dispatches, and worker i takes CPU i
+	if(affinity_init(0, 1))
+		fprintf(stderr, "Couldn't work out which CPUs to use, so nothing will be pinned\n");
+	
+	affinity_bind(0);
+	affinity_print(CENTRAL);
+	
+	if(result_init(-1))
+		fprintf(stderr, "Couldn't open %s, so results won't be written\n", result_path);
+	
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);	//Get the start time
+	trace_start_clock();
+	
+	//Every worker claims files in the same seen set
+	if(dedup_enabled)
+		dedup_init();
+	
+	//Initialize the file catalog
+	all_files = init_catalog(malloc(sizeof(file_catalog_t)), walk_roots);
+	
+	//If we're using a scheduling algorithm that requires node stats, initialize the node stats array
+	if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
+	{
+		node_stats = malloc(sizeof(int) * proc_count);
+		memset(node_stats, 0, sizeof(int) * proc_count);
+	}
+	
+	//If we schedule by deadline or credits, initialize the estimates of how much work each worker has left
+	if(reports_done())
+		init_estimates();
+	
+	//Initialize every worker's queue and start the workers
+	worker_queues = malloc(sizeof(file_queue_t*) * proc_count);
+	worker_threads = malloc(sizeof(pthread_t) * proc_count);
+	worker_ids = malloc(sizeof(int) * proc_count);
+	worker_files = calloc(proc_count, sizeof(long long));
+	worker_bytes = calloc(proc_count, sizeof(long long));
+	worker_queues[CENTRAL] = NULL;
+	
+	for(int i = 1; i < proc_count; i++)
+	{
+		worker_queues[i] = init_queue(malloc(sizeof(file_queue_t)));
+		worker_ids[i] = i;
+		pthread_create(&worker_threads[i], NULL, worker_thread_func, &worker_ids[i]);
+	}
+	
+	central_work();	//Do central machine work
+	
+	//Tell every worker there's no more files left and wait for them to finish
+	for(int i = 1; i < proc_count; i++)
+		close_queue(worker_queues[i]);
+	
+	for(int i = 1; i < proc_count; i++)
+	{
+		pthread_join(worker_threads[i], NULL);
+		free_queue(worker_queues[i]);
+	}
+	
+	result_cleanup();	//Write out whatever results the workers have left
+	
+	//Free everything we malloc()'d
+	if(sched_type == QUEUE_SIZE || sched_type == QUEUE_LENGTH)
+		free(node_stats);
+	
+	if(reports_done())
+		free_estimates();
+	
+	finish_archive();	//Finish any archive segments we were writing
+	free_catalog(all_files);
+	free(worker_queues);
+	free(worker_threads);
+	free(worker_ids);
+	walk_cleanup();
+	free(file_dir_str);
+	free(archive_dir_str);
+	free(search_key);
+	
+	//Get the total time this ran for
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double seconds = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+	result_log(VERBOSE_QUIET, "TOTAL RUNTIME: %f seconds!\n", seconds);
+	
+	for(int i = 1; i < proc_count; i++)
+		result_log(VERBOSE_QUIET, "NODE %d PROCESSED: %lld files, %lld bytes\n", i, worker_files[i], worker_bytes[i]);
+	
+	if(dedup_enabled)
+	{
+		result_log(VERBOSE_QUIET, "DUPLICATES SKIPPED: %lld\n", dedup_duplicates);
+		dedup_cleanup();
+	}
+	
+	if(sla_seconds > 0)
+	{
+		int count;
+		double *lateness = sla_latenesses(&count);
+		sla_write(stdout, lateness, count);
+		sla_cleanup();
+	}
+	
+	//Write the per-phase timings if we were asked to
+	if(timing_enabled)
+	{
+		timing_t *timing = malloc(sizeof(timing_t));
+		init_timing(timing);
+		timing_merge_threads(timing);
+		
+		long long totals[NUM_PHASES];
+		
+		for(int i = 0; i < NUM_PHASES; i++)
+			totals[i] = timing->phases[i].total_ns;
+		
+		FILE *file = strcmp(timing_path, "-") ? fopen(timing_path, "w") : stdout;
+		
+		if(file != NULL)
+		{
+			timing_write_json(file, timing, totals, 1);
+			
+			if(file != stdout)
+				fclose(file);
+		}
+		else
+			fprintf(stderr, "Couldn't write timings to %s\n", timing_path);
+		
+		free(timing);
+		timing_cleanup();
+	}
+	
+	//Write the trace if we were asked to
+	if(trace_enabled)
+	{
+		size_t len;
+		char *events = trace_render(CENTRAL, &len);
+		int lens = (int) len;
+		FILE *file = fopen(trace_path, "w");
+		
+		if(file != NULL)
+		{
+			trace_write(file, events, &lens, 1);
+			fclose(file);
+		}
+		else
+			fprintf(stderr, "Couldn't write trace to %s\n", trace_path);
+		
+		free(events);
+		trace_cleanup();
+	}
+	
+	//Print the aggregates if we were asked to; every thread's table just gets merged
+	if(agg_key != NULL)
+	{
+		agg_table_t table;
+		agg_init_table(&table);
+		agg_merge_threads(&table);
+		agg_write(stdout, &table);
+		agg_free_table(&table);
+		agg_cleanup();
+	}
+	
+	free(worker_files);
+	free(worker_bytes);
+	affinity_cleanup();
+	return 0;
+}
+
+static void central_work()
+{
+	trace_thread_name("dispatch");
+	start_scan();	//Start finding files, so we can hand them out as they're found
+	
+	//For each file we found...
+	int file_size, priority;
+	char filename[FILE_NAME_LEN];
+	
+	while(catalog_take_wait(all_files, filename, FILE_NAME_LEN, &file_size, &priority))	//Get the file...
+	{
+		long long start = timing_start();
+		
+		update_node_stats();
+		int best_proc = get_best_proc(file_size);	//...and get the best worker to give this to
+		
+		enqueue(worker_queues[best_proc], filename, file_size, priority);	//And give it to them
+		trace_instant(DISPATCHED_EVENT, filename, best_proc);
+		timing_stop(DISPATCH_PHASE, start);
+	}
+	
+	finish_scan();
+}
+
+static void update_node_stats()
+{
+	switch(sched_type)
+	{
+		case QUEUE_SIZE:
+			for(int i = 1; i < proc_count; i++)
+				node_stats[i] = queue_sum_file_size(worker_queues[i]);
+			break;
+		case QUEUE_LENGTH:
+			for(int i = 1; i < proc_count; i++)
+				node_stats[i] = queue_size(worker_queues[i]);
+			break;
+		default:
+			break;	//Nothing else needs node data
+	}
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* worker_thread_func(void *arg)
+{
+	int id = *((int*) arg);
+	affinity_bind(id);	//Pin us before we touch any buffers, so they end up on our node
+	char name[32];
+	snprintf(name, sizeof(name), "worker %d", id);
+	trace_thread_name(name);
+	int file_size, priority;
+	char *file;
+	
+	long long start = timing_start();
+	
+	//Block for files until our queue is closed and there are no more files to process
+	while((file = dequeue_wait(worker_queues[id], &file_size, &priority)) != NULL)
+	{
+		start = timing_stop(QUEUE_WAIT_PHASE, start);
+		trace_instant(DEQUEUED_EVENT, file, -1);
+		prefetch_queued(worker_queues[id]);	//Get the next files coming while we work on this one
+		
+		long long parse_start = trace_now(), busy_start = now_ns();
+		process(file, id);
+		trace_span(PARSE_EVENT, file, -1, parse_start);
+		
+		if(reports_done())
+			sched_file_done(id, file_size, now_ns() - busy_start);	//Give our credits back and tell the dispatcher how fast we're going
+		
+		sla_record(file);
+		free(file);
+		start = timing_stop(PARSE_PHASE, start);
+		
+		worker_files[id]++;
+		worker_bytes[id] += file_size;
+	}
+	
+	timing_stop(QUEUE_WAIT_PHASE, start);
+	return NULL;	//We actually don't return anything useful
+}
+
+void archive_file(char *filepath)
+{
+	//Every worker shares one archive path, so take turns moving files into it
+	pthread_mutex_lock(&archive_mutex);
+	long long start = timing_start(), move_start = trace_now();
+	move_file(filepath);
+	trace_span(ARCHIVE_EVENT, filepath, -1, move_start);
+	timing_stop(ARCHIVE_PHASE, start);
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+void archive_record(char *segpath, int index)
+{
+	//Same as archive_file(), but for a single record of a segment
+	pthread_mutex_lock(&archive_mutex);
+	long long start = timing_start(), move_start = trace_now();
+	move_record(segpath, index);
+	trace_span(ARCHIVE_EVENT, segpath, -1, move_start);
+	timing_stop(ARCHIVE_PHASE, start);
+	pthread_mutex_unlock(&archive_mutex);
+}
+
+int claim_result(char *filename)
+{
+	return 1;	//Every file is only handed to one worker, so nobody else could have published it
+}
+
+int file_cancelled(char *filename)
+{
+	return 0;	//Nothing is ever copied, so nothing is ever cancelled
+}
+
+int dedup_claim(uint64_t hash, uint64_t len)
+{
+	return dedup_set_claim(hash, len);	//Every worker shares our set, so there's nobody else to ask
+}
+
+void dedup_report(uint64_t hash, uint64_t len, int matched)
+{
+	dedup_set_report(hash, len, matched);
+}
@@ -3,23 +3,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "affinity.h"
+#include "dedup.h"
+#include "hier.h"
 #include "node.h"
+#include "prefetch.h"
+#include "rma.h"
+#include "sched.h"
+#include "shmq.h"
+#include "sla.h"
+#include "spec.h"
+#include "timing.h"
+#include "trace.h"
 #include "univ.h"
 
 /* Static function prototypes */
 
-/*
- * Read a line from an MPI file.
- * Params: file - the MPI file to read from.
- *         from - the position at the file to start reading from.
- *         buffer - a char array with enough space allocated to read a line
- *         from the file.
- *         status - a status struct to record status to.
- * Returns: the new position of the file pointer, or -1 if we reached the end of
- *          the file.
- */
-static int read_line(MPI_File file, int from, char *buffer, MPI_Status status);
-
 /*
  * The function the process thread should run. Dequeues files from the file
  * queue and calls process() on them.
@@ -29,34 +28,72 @@ static int read_line(MPI_File file, int from, char *buffer, MPI_Status status);
 static void* process_thread_func(void *nothing);
 
 /*
- * Takes a line with a key/value pair and forms a key/value pair struct
- * out of it.
- * Params: line - the line containing the key/value pair.
- * Returns: a key/value pair containing the key and value in the line.
+ * The function the dedup thread should run with -dedup. Answers claims for
+ * the hashes we own until every node has said it's done claiming.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time.
  */
-static kv_pair_t get_kv_pair(char *line);
+static void* dedup_thread_func(void *nothing);
 
 /*
- * Burns a specified number of processor cycles. Essentially just a for-loop
- * that runs for a specific number of iterations and does nothing else.
- * Params: num_cycles - the number of cycles that should be burned.
- * Returns: nothing.
+ * Tells whoever schedules our files that we finished one, so it knows how much
+ * work we have left and how fast we're going, and gets our credits for it
+ * back. Only used if reports_done().
+ * Params: file_size - the size of the file.
+ *         busy_ns - how long we took to process it.
+ * Returns: nothing
  */
-static void burn_cycles(int num_cycles);
+static void report_done(int file_size, long long busy_ns);
+
+/* Message types sent on dedup_comm */
+enum {
+	CLAIM_MSG,		//Claim a hash; the owner replies with what it found
+	REPORT_MSG,		//Record whether a hash's first copy matched
+	DONE_MSG		//The sender won't claim anything else
+};
+
+/* Defines a message sent on dedup_comm */
+typedef struct _dedup_msg_t {
+	int type;			//What kind of message it is
+	int state;			//What a claim found, in a reply; whether it matched, in a report
+	uint64_t hash;		//Hash of the contents
+	uint64_t len;		//Length of the contents
+} dedup_msg_t;
 
 /* node.h extern variables */
 file_queue_t *file_queue;
 pthread_t process_thread;
+long long files_processed = 0;
+long long bytes_processed = 0;
+MPI_Comm parent_comm;
+int parent_rank = CENTRAL;
+int parent_id = CENTRAL;
+MPI_Comm dedup_comm = MPI_COMM_NULL;
 
 /* Static variables */
-static int do_process = 1;	//Boolean value that tells us when to stop waiting for more files to process
+static pthread_t dedup_thread;		//Thread that answers claims for the hashes we own
+static int dedup_rank;				//Our rank in dedup_comm
+static int dedup_size;				//Number of nodes in dedup_comm
 
 void init_node()
 {	
+	//Unless we're in a group, we report to the central machine
+	if(!hier_enabled)
+		parent_comm = MPI_COMM_WORLD;
+	
 	//Initialize our queue
 	file_queue = malloc(sizeof(file_queue_t));
 	file_queue = init_queue(file_queue);
 	
+	//If we're skipping duplicates, start answering claims for our share of the hashes
+	if(dedup_enabled)
+	{
+		MPI_Comm_rank(dedup_comm, &dedup_rank);
+		MPI_Comm_size(dedup_comm, &dedup_size);
+		dedup_init();
+		pthread_create(&dedup_thread, NULL, dedup_thread_func, NULL);
+	}
+	
 	pthread_create(&process_thread, NULL, process_thread_func, NULL);	//Create our process() thread
 }
 
@@ -64,128 +101,207 @@ void init_node()
 static void* process_thread_func(void *nothing)
 {
 	//We don't actually use the parameter for anything
+	affinity_bind(1);	//Pin us before we touch any buffers, so they end up on our node
+	trace_thread_name("process");
+	int file_size, priority;
+	char *file;
+	
+	long long start = timing_start();
+	rma_refill(file_queue);	//Claim our first files if we're claiming our own
 	
-	//We want to keep doing this while we can still expect files, or while there are still files to process
-	while(do_process || queue_size(file_queue) > 0)
+	//Block for files until the queue is closed and there are no more files to process
+	while((file = shm_enabled ? shm_pop(&file_size, &priority) : dequeue_wait(file_queue, &file_size, &priority)) != NULL)
 	{
-		int file_size, priority;
-		char *file = dequeue(file_queue, &file_size, &priority);	//Dequeue a file
+		start = timing_stop(QUEUE_WAIT_PHASE, start);
+		trace_instant(DEQUEUED_EVENT, file, -1);
+		rma_refill(file_queue);	//Claim more before we run out
+		
+		//Get the next files coming while we work on this one (with -shm, they're coming from our host's queue)
+		if(shm_enabled && prefetch_max > 0)
+		{
+			char *ahead[PREFETCH_MAX_DEPTH];
+			prefetch_files(ahead, shm_peek(ahead, prefetch_depth()));
+		}
+		else
+			prefetch_queued(file_queue);
+		
+		long long parse_start = trace_now(), busy_start = now_ns();
+		
+		//A copy of a straggler that already finished somewhere else doesn't need to be started, and one that's
+		//stopped partway (or loses to the other copy) doesn't count as processed
+		int cancelled = speculate_pct > 0 && spec_begin(file, file_size, priority);
+		
+		if(!cancelled)
+			cancelled = process(file, proc_id);
+		
+		trace_span(PARSE_EVENT, file, -1, parse_start);
+		
+		//With -speculate, the central machine hears about every file, passes it on to the scheduler, and decides
+		//which copy of a copied file counts
+		if(speculate_pct > 0)
+			cancelled |= !spec_done(file, file_size, cancelled ? -1 : now_ns() - busy_start);
+		else if(reports_done())
+			report_done(file_size, now_ns() - busy_start);
 		
-		//If the file's not NULL, process it
-		if(file != NULL)
-			process(file);
+		if(!cancelled)
+		{
+			sla_record(file);
+			files_processed++;
+			bytes_processed += file_size;
+		}
+		
+		free(file);
+		start = timing_stop(PARSE_PHASE, start);
 	}
 	
+	timing_stop(QUEUE_WAIT_PHASE, start);
 	return NULL;	//We actually don't return anything useful
 }
 
-void process(char *filename)
+void archive_file(char *filepath)
 {
-	//Open the file for reading
-	MPI_File file;
-	MPI_File_open(MPI_COMM_SELF, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
-    
-    char line[LINE_NUM_CHARS];
-    int start = 0;
-    MPI_Status status;
-	
-	//Keep going until we reach the end of the file
-    while(start != -1)
-    {
-    	//Read a line
-    	memset(line, 0, LINE_NUM_CHARS);
-    	start = read_line(file, start, line, status);
-    	
-    	//If we didn't encounter an EOF while reading the line...
-    	if(start != -1)
-    	{
-			kv_pair_t kv_pair = get_kv_pair(line);	//Get a key/value pair from it
-			
-			//If the key matches the key we want...
-			if(!strcmp(kv_pair.key, search_key))
-			{
-				printf("\n%d found value from %s! Original: %s, Key=%s, Value=%s\n", proc_id, filename, line, kv_pair.key, kv_pair.value);
-				MPI_Send(filename, strlen(filename), MPI_CHAR, CENTRAL, ARCHIVE_TAG, MPI_COMM_WORLD);	//Archive it
-				burn_cycles(500);	//Instead of doing actual database stuff, just burn 500 cycles to simulate writing
-				
-				//And get us out of here, because we've finished our job
-				free(kv_pair.key);
-				free(kv_pair.value);
-				break;
-			}
-				
-			free(kv_pair.key);
-			free(kv_pair.value);
-    	}
-    }
-    
-    printf("\n");
-    MPI_File_close(&file);	//Close the file
+	//If we're a sub-coordinator, we archive for our group, including ourselves
+	if(parent_comm == MPI_COMM_NULL)
+	{
+		leader_archive_file(filepath);
+		return;
+	}
+	
+	long long start = trace_now();
+	MPI_Send(filepath, strlen(filepath), MPI_CHAR, parent_rank, ARCHIVE_TAG, parent_comm);	//Tell whoever we report to to archive it
+	trace_span(MPI_SEND_EVENT, filepath, parent_id, start);
 }
 
-void node_cleanup()
+void archive_record(char *segpath, int index)
 {
-	do_process = 0;	//Tell us to stop expecting new files
-	pthread_join(process_thread, NULL);	//Join the process thraed
-	free_queue(file_queue);	//Free our file queue
+	if(parent_comm == MPI_COMM_NULL)
+	{
+		leader_archive_record(segpath, index);
+		return;
+	}
 	
-	//Tell the central machine we've stopped
-	int stop = 1;
-	MPI_Send(&stop, 1, MPI_INT, CENTRAL, STOP_TAG, MPI_COMM_WORLD);
+	//Send the segment's path and the record's index together
+	char msg[FILE_NAME_LEN + sizeof(int)];
+	memset(msg, 0, FILE_NAME_LEN);
+	strcpy(msg, segpath);
+	memcpy(msg + FILE_NAME_LEN, &index, sizeof(int));
+	
+	long long start = trace_now();
+	MPI_Send(msg, sizeof(msg), MPI_CHAR, parent_rank, ARCHIVE_RECORD_TAG, parent_comm);	//Tell whoever we report to to archive it
+	trace_span(MPI_SEND_EVENT, segpath, parent_id, start);
 }
 
-static int read_line(MPI_File file, int from, char *buffer, MPI_Status status)
+static void report_done(int file_size, long long busy_ns)
 {
-	int count = 0;	//Counting variable
-	
-	//Character to append and read status
-	char append;
-	int num_read;
-
-	//Read a character and get the number of characters read	
-	MPI_File_read(file, &append, 1, MPI_CHAR, &status);
-	MPI_Get_count(&status, MPI_CHAR, &num_read);
-	
-	//Build string as long as we're getting successful reads and stop when we hit a newline
-	while(num_read >= 1 && append != '\n')
+	//If we're a sub-coordinator, we schedule for our group, and we're its first target
+	if(parent_comm == MPI_COMM_NULL)
 	{
-		buffer[count++] = append;	//Add it to the buffer
-		
-		//Read a character and get the number of characters read
-		MPI_File_read(file, &append, 1, MPI_CHAR, &status);
-		MPI_Get_count(&status, MPI_CHAR, &num_read);
+		sched_file_done(1, file_size, busy_ns);
+		return;
 	}
 	
-	//If we reached the end of the file, return -1; otherwise, return the position of the file pointer
-	return (num_read < 1) ? -1 : (from + count);
+	long long msg[2] = { file_size, busy_ns };
+	MPI_Send(msg, 2, MPI_LONG_LONG, parent_rank, FILE_DONE_TAG, parent_comm);
+}
+
+int claim_result(char *filename)
+{
+	return speculate_pct == 0 || spec_claim(filename);	//Only files that might have been copied have to be claimed
+}
+
+int file_cancelled(char *filename)
+{
+	return speculate_pct > 0 && spec_cancelled(filename);
 }
 
-static kv_pair_t get_kv_pair(char *line)
+int dedup_claim(uint64_t hash, uint64_t len)
 {
-	int line_len = strlen(line);	//Get the length of the line
-	int equals_index = strcspn(line, "=");	//Get the index of the '=' separating the key and value
-	int value_len = line_len - equals_index;	//Get the length of the value
+	//Claims for our own hashes don't need to go anywhere
+	int owner = hash % dedup_size;
 	
-	kv_pair_t retval;
+	if(owner == dedup_rank)
+		return dedup_set_claim(hash, len);
 	
-	//Copy the key into the key/value pair we'll return
-	retval.key = malloc(equals_index + 1);
-	strncpy(retval.key, line, equals_index);
-	retval.key[equals_index] = '\0';
+	dedup_msg_t msg = { CLAIM_MSG, DEDUP_NEW, hash, len };
+	MPI_Send(&msg, sizeof(msg), MPI_BYTE, owner, DEDUP_TAG, dedup_comm);
+	MPI_Recv(&msg, sizeof(msg), MPI_BYTE, owner, DEDUP_REPLY_TAG, dedup_comm, MPI_STATUS_IGNORE);
+	return msg.state;
+}
+
+void dedup_report(uint64_t hash, uint64_t len, int matched)
+{
+	int owner = hash % dedup_size;
 	
-	//Copy the value into the key/value pair and we'll return
-	retval.value = malloc(value_len + 1);
-	strncpy(retval.value, line + equals_index + 1, value_len);
-	retval.value[value_len] = '\0';
+	if(owner == dedup_rank)
+	{
+		dedup_set_report(hash, len, matched);
+		return;
+	}
 	
-	return retval;
+	dedup_msg_t msg = { REPORT_MSG, matched, hash, len };
+	MPI_Send(&msg, sizeof(msg), MPI_BYTE, owner, DEDUP_TAG, dedup_comm);
 }
 
-static void burn_cycles(int num_cycles)
+//This returns void* and takes in void* because pthread needs it to
+static void* dedup_thread_func(void *nothing)
 {
-	volatile int i;	//Volatile means GCC won't optimize this function away
-	printf("Inserting into database!");
+	//We don't actually use the parameter for anything
+	affinity_bind(0);	//We share a CPU with the other communication threads
+	trace_thread_name("dedup");
+	int done = 0;
 	
-	for(i = 0; i < num_cycles; i++);	//Just waste iterations
+	//Messages from one node arrive in the order it sent them, so once every node is done, nothing else is coming
+	while(done < dedup_size)
+	{
+		dedup_msg_t msg;
+		MPI_Status status;
+		MPI_Recv(&msg, sizeof(msg), MPI_BYTE, MPI_ANY_SOURCE, DEDUP_TAG, dedup_comm, &status);
+		
+		switch(msg.type)
+		{
+			case CLAIM_MSG:
+				msg.state = dedup_set_claim(msg.hash, msg.len);
+				MPI_Send(&msg, sizeof(msg), MPI_BYTE, status.MPI_SOURCE, DEDUP_REPLY_TAG, dedup_comm);
+				break;
+			case REPORT_MSG:
+				dedup_set_report(msg.hash, msg.len, msg.state);
+				break;
+			case DONE_MSG:
+				done++;
+				break;
+		}
+	}
+	
+	return NULL;	//We actually don't return anything useful
 }
 
+void node_cleanup()
+{
+	close_queue(file_queue);	//Tell us to stop expecting new files
+	
+	//If we take files for our host, tell the whole host to stop expecting them
+	if(shm_enabled && is_host_leader)
+		shm_close();
+	
+	pthread_join(process_thread, NULL);	//Join the process thraed
+	free_queue(file_queue);	//Free our file queue
+	
+	//If we're skipping duplicates, tell every node we won't claim anything else, then wait for them to say the same
+	if(dedup_enabled)
+	{
+		dedup_msg_t msg = { DONE_MSG, 0, 0, 0 };
+		
+		for(int i = 0; i < dedup_size; i++)
+			MPI_Send(&msg, sizeof(msg), MPI_BYTE, i, DEDUP_TAG, dedup_comm);
+		
+		pthread_join(dedup_thread, NULL);
+		dedup_cleanup();
+		MPI_Comm_free(&dedup_comm);
+	}
+	
+	//Tell whoever we report to we've stopped (sub-coordinators don't report to anyone)
+	int stop = 1;
+	
+	if(parent_comm != MPI_COMM_NULL)
+		MPI_Send(&stop, 1, MPI_INT, parent_rank, STOP_TAG, parent_comm);
+}
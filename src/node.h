@@ -1,11 +1,19 @@
 #ifndef NODE_H_INCLUDED
 #define NODE_H_INCLUDED
 
+#include <mpi.h>
 #include "container.h"
+#include "process.h"
 
 /* Node variables */
 extern file_queue_t *file_queue;	//This node's file queue
 extern pthread_t process_thread;	//This node's thread to run process() independently of enqueueing
+extern long long files_processed;	//Number of files this node has processed
+extern long long bytes_processed;	//Number of bytes this node has processed
+extern MPI_Comm parent_comm;		//Communicator we get files from and report to, or MPI_COMM_NULL if we archive ourselves
+extern int parent_rank;				//Rank in parent_comm we get files from and report to
+extern int parent_id;				//That rank's rank in MPI_COMM_WORLD, for tracing
+extern MPI_Comm dedup_comm;			//Communicator of every node, for claiming files with -dedup
 
 /* Node functions */
 
@@ -16,18 +24,9 @@ extern pthread_t process_thread;	//This node's thread to run process() independe
  */
 void init_node();
 
-/*
- * Process a file. Search for a specific key, and if the file contains a
- * key/value pair with that key, insert it into a database and archive it.
- * Params: filename - full path to the file that should be processed
- * Returns: nothing
- */
-void process(char *filename);
-
 /*
  * Finalize us as a node.
  */
 void node_cleanup();
 
 #endif //NODE_H_INCLUDED
-
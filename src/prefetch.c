@@ -0,0 +1,129 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "prefetch.h"
+#include "timing.h"
+#include "trace.h"
+#include "univ.h"
+
+/* Static function prototypes */
+
+/*
+ * Hashes a file's name, so we can remember which files we've read ahead
+ * without keeping their names around.
+ * Params: filename - the file's name.
+ * Returns: the hash.
+ */
+static uint64_t name_hash(char *filename);
+
+/*
+ * Tells the kernel to read a whole file into the page cache in the
+ * background.
+ * Params: filename - full path to the file.
+ * Returns: nothing
+ */
+static void advise_file(char *filename);
+
+/* prefetch.h extern variables */
+int prefetch_max = 0;
+
+/* Static variables */
+static __thread int depth = 1;								//Files this thread is looking ahead
+static __thread int calm = 0;								//Files in a row that came in without stalling
+static __thread uint64_t advised[PREFETCH_MAX_DEPTH];		//Hashes of the files this thread read ahead last
+static __thread int next_advised = 0;						//Where the next hash goes in advised
+
+long long prefetch_now()
+{
+	if(prefetch_max <= 0)
+		return 0;
+	
+	return now_ns();
+}
+
+void prefetch_queued(file_queue_t *queue)
+{
+	if(prefetch_max <= 0)
+		return;
+	
+	char *files[PREFETCH_MAX_DEPTH];
+	prefetch_files(files, queue_peek(queue, files, depth));
+}
+
+void prefetch_files(char **files, int count)
+{
+	long long start = timing_start();
+	
+	for(int i = 0; i < count; i++)
+	{
+		//Skip the files we've already read ahead; the queue only moves forward by one each time
+		uint64_t hash = name_hash(files[i]);
+		int seen = 0;
+		
+		for(int j = 0; j < PREFETCH_MAX_DEPTH && !seen; j++)
+			seen = (advised[j] == hash);
+		
+		if(!seen)
+		{
+			advise_file(files[i]);
+			trace_instant(PREFETCH_EVENT, files[i], -1);
+			
+			advised[next_advised] = hash;
+			next_advised = (next_advised + 1) % PREFETCH_MAX_DEPTH;
+		}
+		
+		free(files[i]);
+	}
+	
+	timing_stop(PREFETCH_PHASE, start);
+}
+
+int prefetch_depth()
+{
+	return (prefetch_max > 0) ? depth : 0;
+}
+
+void prefetch_report(long long io_ns, long long scan_ns)
+{
+	if(prefetch_max <= 0)
+		return;
+	
+	//If reading still held us up, we aren't looking far enough ahead
+	if(io_ns > scan_ns && io_ns > PREFETCH_STALL_NS)
+	{
+		depth = (depth * 2 < prefetch_max) ? depth * 2 : prefetch_max;
+		calm = 0;
+	}
+	else if(++calm >= depth && depth > 1)
+	{
+		//If a whole window's worth came in on time, see if we can get away with looking less far ahead
+		depth--;
+		calm = 0;
+	}
+}
+
+static uint64_t name_hash(char *filename)
+{
+	//FNV-1a; 0 is left for empty slots of advised
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	
+	for(char *c = filename; *c != '\0'; c++)
+		hash = (hash ^ (unsigned char) *c) * 0x100000001b3ULL;
+	
+	return (hash != 0) ? hash : 1;
+}
+
+static void advise_file(char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	
+	//If it's gone, whoever processes it will find out
+	if(fd < 0)
+		return;
+	
+	//The kernel starts reading in the background, and keeps going once we close it
+	posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+}
@@ -0,0 +1,67 @@
+#ifndef PREFETCH_H_INCLUDED
+#define PREFETCH_H_INCLUDED
+
+#include "container.h"
+
+/*
+ * With -prefetch <max>, every time a thread takes a file off its queue, it
+ * tells the kernel to start reading the next few files in the queue
+ * (posix_fadvise(POSIX_FADV_WILLNEED)), so they're on their way into the page
+ * cache while the current one is scanned.
+ *
+ * How many files ahead each thread looks adapts as it goes. It starts at one;
+ * whenever reading a file still stalls (takes longer than scanning it and more
+ * than PREFETCH_STALL_NS), it doubles, up to <max>; once that many files in a
+ * row have come in without stalling, it drops by one.
+ */
+
+#define PREFETCH_MAX_DEPTH 64		//Most files a thread can look ahead
+#define PREFETCH_STALL_NS 20000		//Reads shorter than this came from the page cache
+
+/* Prefetch variables */
+extern int prefetch_max;	//Most files a thread looks ahead, or 0 if we're not prefetching
+
+/* Prefetch functions */
+
+/*
+ * Gets the current time, if we're prefetching.
+ * Params: nothing
+ * Returns: the current time in nanoseconds, or 0 if we're not prefetching.
+ */
+long long prefetch_now();
+
+/*
+ * Tells the kernel to read ahead the files at the front of a queue that
+ * haven't been read ahead yet. Call it from the thread that dequeues from the
+ * queue, right after it dequeues a file.
+ * Params: queue - the queue.
+ * Returns: nothing
+ */
+void prefetch_queued(file_queue_t *queue);
+
+/*
+ * Same as prefetch_queued(), for files the caller already took from the front
+ * of a queue prefetch_queued() can't look into (like -shm's shared queue).
+ * Params: files - the files' full paths, each malloc()'d; they're freed.
+ *         count - the number of files.
+ * Returns: nothing
+ */
+void prefetch_files(char **files, int count);
+
+/*
+ * Gets how many files the calling thread is looking ahead right now.
+ * Params: nothing
+ * Returns: the number of files, or 0 if we're not prefetching.
+ */
+int prefetch_depth();
+
+/*
+ * Tells the calling thread how long its last file took to read and to scan,
+ * so it can decide how far ahead it should be looking.
+ * Params: io_ns - time spent opening and reading the file.
+ *         scan_ns - time spent scanning what was read.
+ * Returns: nothing
+ */
+void prefetch_report(long long io_ns, long long scan_ns);
+
+#endif //PREFETCH_H_INCLUDED
@@ -0,0 +1,523 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "agg.h"
+#include "compress.h"
+#include "dedup.h"
+#include "prefetch.h"
+#include "process.h"
+#include "query.h"
+#include "result.h"
+#include "segment.h"
+#include "trace.h"
+#include "univ.h"
+
+#define READ_CHUNK_SIZE 65536	//How much of a file we read at a time
+
+/* Defines the state of a search through a file that's read in chunks */
+typedef struct _search_t {
+	char *filename;				//File being searched, for printing
+	int id;						//Rank or worker number doing the searching
+	char line[LINE_NUM_CHARS];	//Start of a line that was split between chunks
+	int line_len;				//Length of line
+	char found[LINE_NUM_CHARS];	//Line holding the search key
+	int found_len;				//Length of found, or -1 if we haven't found the search key
+	int done;					//1 once we've seen everything we need to decide; 0 until then
+	int matched;				//1 if the file matched; 0 otherwise (only set by search_finish())
+	int quiet;					//1 if a match shouldn't be printed or aggregated (it's a duplicate); 0 otherwise
+	int claim;					//1 if a match has to be claimed before it's published (it might have been copied); 0 otherwise
+	int dedup_state;			//What dedup_begin() found with -dedup, or -1 if the file hasn't been claimed
+	uint64_t hash;				//Hash of the file's contents, once it's been claimed
+	uint64_t hash_len;			//Length of the file's contents, once it's been claimed
+	query_values_t values;		//Values of the keys the query mentions, if there's a query
+} search_t;
+
+/* Static function prototypes */
+
+/*
+ * Processes a plain .sen file, reading it in chunks.
+ * Params: filename - full path to the file that should be processed.
+ *         id - the rank or worker number doing the processing.
+ * Returns: 1 if another copy of the file finished first; 0 otherwise.
+ */
+static int process_file(char *filename, int id);
+
+/*
+ * Processes a plain .sen file with -dedup, hashing it as it's read. A file
+ * that fits in one chunk is claimed before it's searched; a bigger one is
+ * searched as it's hashed, and claimed once it's all been read. Either way,
+ * nothing is published until the claim says how.
+ * Params: filename - full path to the file that should be processed.
+ *         id - the rank or worker number doing the processing.
+ * Returns: nothing
+ */
+static void process_file_dedup(char *filename, int id);
+
+/*
+ * Processes a segment, searching and archiving each record that hasn't been
+ * archived yet on its own.
+ * Params: filename - full path to the segment that should be processed.
+ *         id - the rank or worker number doing the processing.
+ * Returns: nothing
+ */
+static void process_segment(char *filename, int id);
+
+/*
+ * Processes a compressed .sen file, searching it as it's inflated.
+ * Params: filename - full path to the file that should be processed.
+ *         id - the rank or worker number doing the processing.
+ * Returns: nothing
+ */
+static void process_compressed(char *filename, int id);
+
+/*
+ * Claims a file's contents with -dedup, deciding how it should be handled. A
+ * copy of something still being processed is searched quietly.
+ * Params: search - the search, already initialized.
+ *         hash - the hash of the contents.
+ *         len - the length of the contents.
+ * Returns: what the claim found; with DEDUP_MATCHED or DEDUP_UNMATCHED, the
+ *          file doesn't need to be searched at all.
+ */
+static int dedup_begin(search_t *search, uint64_t hash, uint64_t len);
+
+/*
+ * Finishes a search with -dedup, telling the seen set the outcome if this was
+ * the first copy. A file that never got claimed is just searched as usual.
+ * Params: search - the search.
+ * Returns: 1 if the file matches; 0 otherwise.
+ */
+static int dedup_finish(search_t *search);
+
+/*
+ * Claims a compressed file with -dedup by hashing it as it's stored, before
+ * it's inflated (copies are byte-identical). A chunk_func_t for
+ * inflate_file()'s raw_func.
+ * Params: arg - the search.
+ *         data - the whole compressed file.
+ *         len - the length of the file.
+ * Returns: 1 if the file doesn't need to be inflated at all; 0 otherwise.
+ */
+static int claim_compressed(void *arg, char *data, size_t len);
+
+/*
+ * Initializes a search.
+ * Params: search - the search to initialize.
+ *         filename - the file being searched, for printing.
+ *         id - the rank or worker number doing the searching.
+ * Returns: nothing
+ */
+static void init_search(search_t *search, char *filename, int id);
+
+/*
+ * Searches the next chunk of a file for the search key, one line at a time.
+ * A line split between this chunk and the next is carried over.
+ * Params: search - the search.
+ *         data - the chunk.
+ *         len - the length of the chunk.
+ * Returns: 1 if we've seen everything we need to decide if the file matches
+ *          (so the rest of it can be skipped); 0 otherwise.
+ */
+static int search_chunk(search_t *search, char *data, size_t len);
+
+/*
+ * Searches the next inflated chunk of a compressed file. A chunk_func_t for
+ * inflate_file().
+ * Params: arg - the search.
+ *         data - the chunk.
+ *         len - the length of the chunk.
+ * Returns: 1 if we've seen everything we need to decide if the file matches
+ *          (so inflating can stop); 0 otherwise.
+ */
+static int search_inflated(void *arg, char *data, size_t len);
+
+/*
+ * Finishes a search, checking the last line if the file didn't end with a
+ * newline, then decides if the file matches and prints (or aggregates) it if
+ * it does, unless the search is quiet. A file matches if it has the search
+ * key and satisfies the query, if there is one.
+ * Params: search - the search.
+ * Returns: 1 if the file matches; 0 otherwise.
+ */
+static int search_finish(search_t *search);
+
+/*
+ * Checks if a single line holds the search key, and records its value if it
+ * holds a key the query mentions. Lines aren't null-terminated, so they can be
+ * checked in place.
+ * Params: search - the search.
+ *         line - the line, without its newline.
+ *         len - the length of the line.
+ * Returns: 1 if we've now seen everything we need to decide if the file
+ *          matches; 0 otherwise.
+ */
+static int search_line(search_t *search, char *line, int len);
+
+/*
+ * Burns a specified number of processor cycles. Essentially just a for-loop
+ * that runs for a specific number of iterations and does nothing else.
+ * Params: num_cycles - the number of cycles that should be burned.
+ * Returns: nothing.
+ */
+static void burn_cycles(int num_cycles);
+
+int process(char *filename, int id)
+{
+	if(segment_name_valid(filename))
+		process_segment(filename, id);
+	else if(compressed_name_valid(filename))
+		process_compressed(filename, id);
+	else if(dedup_enabled)
+		process_file_dedup(filename, id);
+	else
+		return process_file(filename, id);	//Only plain files are ever copied, so only they can be cancelled
+	
+	return 0;
+}
+
+static int process_file(char *filename, int id)
+{
+	//Open the file for reading
+	long long start = prefetch_now();
+	int fd = open(filename, O_RDONLY);
+	
+	//If it's gone (e.g. somebody else archived it, maybe another copy), there's nothing to do
+	if(fd < 0)
+		return file_cancelled(filename);
+	
+	char chunk[READ_CHUNK_SIZE];
+	ssize_t len;
+	search_t search;
+	init_search(&search, filename, id);
+	search.claim = 1;
+	long long scan_ns = 0;
+	int cancelled = 0;
+	
+	//Keep going until we reach the end of the file or find the key, unless another copy finishes first
+	while(!search.done && !(cancelled = file_cancelled(filename)) && (len = read(fd, chunk, READ_CHUNK_SIZE)) > 0)
+	{
+		long long scan_start = prefetch_now();
+		search_chunk(&search, chunk, len);
+		scan_ns += prefetch_now() - scan_start;
+	}
+	
+	close(fd);	//Close the file
+	prefetch_report(prefetch_now() - start - scan_ns, scan_ns);	//Whatever wasn't scanning was waiting on the disk
+	
+	if(cancelled)
+		return 1;
+	
+	if(search_finish(&search))
+	{
+		archive_file(filename);	//Archive it
+		burn_cycles(500);	//Instead of doing actual database stuff, just burn 500 cycles to simulate writing
+	}
+	
+	//If another copy won while we were finishing (including by claiming the match first), this one doesn't count
+	return file_cancelled(filename);
+}
+
+static void process_file_dedup(char *filename, int id)
+{
+	long long start = prefetch_now();
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	
+	if(fd < 0)
+		return;
+	
+	if(fstat(fd, &st))
+	{
+		close(fd);
+		return;
+	}
+	
+	//Small files (nearly all of them) are read whole into the chunk, so they can be claimed before they're searched
+	char chunk[READ_CHUNK_SIZE];
+	size_t size = (size_t) st.st_size, total = 0;
+	int whole = size <= READ_CHUNK_SIZE;
+	dedup_hasher_t hasher;
+	dedup_hash_start(&hasher);
+	search_t search;
+	init_search(&search, filename, id);
+	long long scan_ns = 0;
+	
+	while(total < size)
+	{
+		char *data = whole ? chunk + total : chunk;
+		ssize_t len = read(fd, data, (size - total < READ_CHUNK_SIZE) ? size - total : READ_CHUNK_SIZE);
+		
+		if(len <= 0)
+			break;
+		
+		long long scan_start = prefetch_now();
+		dedup_hash_add(&hasher, data, len);
+		
+		//Bigger ones are searched a chunk at a time as they're hashed, which publishes nothing until they're claimed
+		if(!whole)
+			search_chunk(&search, data, len);
+		
+		total += len;
+		scan_ns += prefetch_now() - scan_start;
+	}
+	
+	close(fd);
+	
+	//See if it's been seen before, and if it fit in the chunk, only search it if it has to be
+	long long scan_start = prefetch_now();
+	int state = dedup_begin(&search, dedup_hash_end(&hasher), total);
+	
+	if(whole && state != DEDUP_MATCHED && state != DEDUP_UNMATCHED)
+		search_chunk(&search, chunk, total);
+	
+	scan_ns += prefetch_now() - scan_start;
+	prefetch_report(prefetch_now() - start - scan_ns, scan_ns);	//Whatever wasn't scanning was waiting on the disk
+	
+	if(dedup_finish(&search))
+	{
+		archive_file(filename);	//Archive it, even if it's a duplicate
+		
+		if(!search.quiet)
+			burn_cycles(500);	//Instead of doing actual database stuff, just burn 500 cycles to simulate writing
+	}
+}
+
+static void process_segment(char *filename, int id)
+{
+	segment_t seg;
+	
+	if(segment_open(&seg, filename))
+		return;
+	
+	//Search every record that hasn't already been archived
+	for(uint32_t i = 0; i < seg.count; i++)
+	{
+		seg_entry_t *entry = &(seg.index[i]);
+		
+		if((entry->flags & SEG_ARCHIVED) || entry->offset + entry->length > seg.size)
+			continue;
+		
+		//Print the record as "<segment>:<record>"
+		char name[FILE_NAME_LEN + SEG_NAME_LEN + 1];
+		snprintf(name, sizeof(name), "%s:%.*s", filename, SEG_NAME_LEN, entry->name);
+		
+		search_t search;
+		init_search(&search, name, id);
+		int matched;
+		
+		//With -dedup, every record is hashed and claimed on its own
+		if(dedup_enabled)
+		{
+			int state = dedup_begin(&search, dedup_hash(seg.data + entry->offset, entry->length), entry->length);
+			
+			if(state != DEDUP_MATCHED && state != DEDUP_UNMATCHED)
+				search_chunk(&search, seg.data + entry->offset, entry->length);
+			
+			matched = dedup_finish(&search);
+		}
+		else
+		{
+			search_chunk(&search, seg.data + entry->offset, entry->length);
+			matched = search_finish(&search);
+		}
+		
+		if(matched)
+		{
+			archive_record(filename, i);	//Archive just this record
+			
+			if(!search.quiet)
+				burn_cycles(500);	//Instead of doing actual database stuff, just burn 500 cycles to simulate writing
+		}
+	}
+	
+	segment_close(&seg);
+}
+
+static void process_compressed(char *filename, int id)
+{
+	search_t search;
+	init_search(&search, filename, id);
+	
+	//Search it as it's inflated (with -dedup, claiming it first); a corrupt file is just one that didn't match
+	if(inflate_file(filename, search_inflated, &search, dedup_enabled ? claim_compressed : NULL))
+		fprintf(stderr, "%d couldn't inflate %s\n", id, filename);
+	
+	if(dedup_enabled ? dedup_finish(&search) : search_finish(&search))
+	{
+		archive_file(filename);	//Archive it
+		
+		if(!search.quiet)
+			burn_cycles(500);	//Instead of doing actual database stuff, just burn 500 cycles to simulate writing
+	}
+}
+
+static void init_search(search_t *search, char *filename, int id)
+{
+	search->filename = filename;
+	search->id = id;
+	search->line_len = 0;
+	search->found_len = -1;
+	search->done = 0;
+	search->matched = 0;
+	search->quiet = 0;
+	search->claim = 0;
+	search->dedup_state = -1;
+	
+	if(search_query != NULL)
+		query_reset(search_query, &(search->values));
+}
+
+static int dedup_begin(search_t *search, uint64_t hash, uint64_t len)
+{
+	search->hash = hash;
+	search->hash_len = len;
+	search->dedup_state = dedup_claim(hash, len);
+	
+	//Only the first copy gets printed
+	if(search->dedup_state != DEDUP_NEW)
+	{
+		search->quiet = 1;
+		__atomic_add_fetch(&dedup_duplicates, 1, __ATOMIC_RELAXED);
+	}
+	
+	return search->dedup_state;
+}
+
+static int dedup_finish(search_t *search)
+{
+	//Copies of something that's already been processed go the same way it did
+	if(search->dedup_state == DEDUP_MATCHED || search->dedup_state == DEDUP_UNMATCHED)
+		return search->matched = (search->dedup_state == DEDUP_MATCHED);
+	
+	int matched = search_finish(search);
+	
+	if(search->dedup_state == DEDUP_NEW)
+		dedup_report(search->hash, search->hash_len, matched);
+	
+	return matched;
+}
+
+static int claim_compressed(void *arg, char *data, size_t len)
+{
+	int state = dedup_begin((search_t*) arg, dedup_hash(data, len), len);
+	return state == DEDUP_MATCHED || state == DEDUP_UNMATCHED;
+}
+
+static int search_chunk(search_t *search, char *data, size_t len)
+{
+	char *end = data + len;
+	
+	while(!search->done && data < end)
+	{
+		char *newline = memchr(data, '\n', end - data);
+		char *line_end = (newline != NULL) ? newline : end;
+		
+		//If nothing was carried over and the whole line is here, check it in place
+		if(search->line_len == 0 && newline != NULL)
+			search_line(search, data, line_end - data);
+		else
+		{
+			//Otherwise, add what we have to the carried over line (its start is all that matters)
+			int room = LINE_NUM_CHARS - 1 - search->line_len;
+			int take = (line_end - data < room) ? line_end - data : room;
+			memcpy(search->line + search->line_len, data, take);
+			search->line_len += take;
+			
+			//And check it once we have the whole thing
+			if(newline != NULL)
+			{
+				search_line(search, search->line, search->line_len);
+				search->line_len = 0;
+			}
+		}
+		
+		data = (newline != NULL) ? newline + 1 : end;
+	}
+	
+	return search->done;
+}
+
+static int search_inflated(void *arg, char *data, size_t len)
+{
+	return search_chunk((search_t*) arg, data, len);
+}
+
+static int search_finish(search_t *search)
+{
+	if(!search->done && search->line_len > 0)
+		search_line(search, search->line, search->line_len);
+	
+	search->line_len = 0;
+	search->matched = search->found_len >= 0 && (search_query == NULL || query_eval(search_query, &(search->values)));
+	
+	//If another copy of the file already published its match, this one has nothing left to do
+	if(search->matched && search->claim && !claim_result(search->filename))
+		search->matched = 0;
+	
+	if(search->matched && search->quiet)
+		trace_instant(MATCHED_EVENT, search->filename, -1);	//Duplicates aren't printed or aggregated again
+	else if(search->matched && agg_key != NULL)
+	{
+		//When aggregating, matches go into this thread's table instead of being printed
+		int slot = agg_value_slot();
+		trace_instant(MATCHED_EVENT, search->filename, -1);
+		
+		if(search->values.len[slot] >= 0)
+			agg_add_value(search->filename, search->values.value[slot], search->values.len[slot]);
+	}
+	else if(search->matched)
+	{
+		//Split the line holding the search key into its key and value for printing
+		char *equals = memchr(search->found, '=', search->found_len);
+		int key_len = (equals != NULL) ? equals - search->found : search->found_len;
+		int value_len = (equals != NULL) ? search->found_len - key_len - 1 : 0;
+		
+		char *value = (equals != NULL) ? equals + 1 : search->found;
+		
+		trace_instant(MATCHED_EVENT, search->filename, -1);
+		result_match(search->id, search->filename, search->found, key_len, value, value_len);
+		result_log(VERBOSE_MATCHES, "%d found value from %s! Original: %.*s, Key=%.*s, Value=%.*s\n", search->id, search->filename,
+			search->found_len, search->found, key_len, search->found, value_len, value);
+	}
+	
+	return search->matched;
+}
+
+static int search_line(search_t *search, char *line, int len)
+{
+	//Get the index of the '=' separating the key and value
+	char *equals = memchr(line, '=', len);
+	int key_len = (equals != NULL) ? equals - line : len;
+	
+	//If the query mentions the key, hang on to its value
+	if(search_query != NULL && equals != NULL)
+	{
+		int slot = query_key_slot(search_query, line, key_len);
+		
+		if(slot >= 0)
+			query_set(search_query, &(search->values), slot, equals + 1, len - key_len - 1);
+	}
+	
+	//If the key matches the key we want, hang on to the line for printing
+	if(search->found_len < 0 && key_len == (int) strlen(search_key) && !memcmp(line, search_key, key_len))
+	{
+		search->found_len = (len < LINE_NUM_CHARS) ? len : LINE_NUM_CHARS;
+		memcpy(search->found, line, search->found_len);
+	}
+	
+	//Without a query, finding the key is enough; with one, we also need every key it mentions
+	search->done = search->found_len >= 0 && (search_query == NULL || search->values.num_seen == search_query->num_keys);
+	return search->done;
+}
+
+static void burn_cycles(int num_cycles)
+{
+	volatile int i;	//Volatile means GCC won't optimize this function away
+	result_log(VERBOSE_FILES, "Inserting into database!\n");
+	
+	for(i = 0; i < num_cycles; i++);	//Just waste iterations
+}
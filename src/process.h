@@ -0,0 +1,77 @@
+#ifndef PROCESS_H_INCLUDED
+#define PROCESS_H_INCLUDED
+
+#include <stdint.h>
+
+/* Processing functions (shared by every build that processes files) */
+
+/*
+ * Process a file. Search for a specific key, and if the file contains a
+ * key/value pair with that key, insert it into a database and archive it.
+ * Segments are processed record by record, archiving each matching record.
+ * Params: filename - full path to the file that should be processed
+ *         id - the rank or worker number doing the processing.
+ * Returns: 1 if the file was cancelled because another copy of it finished
+ *          first (only with -speculate), so this copy shouldn't be counted; 0
+ *          otherwise.
+ */
+int process(char *filename, int id);
+
+/*
+ * Archives a file that process() matched. Every build that links process.o
+ * defines this: fsch sends it to the central machine, fsch_threads moves it
+ * directly.
+ * Params: filepath - the full path to the file.
+ * Returns: nothing
+ */
+void archive_file(char *filepath);
+
+/*
+ * Archives a single record of a segment that process() matched. Every build
+ * that links process.o defines this, just like archive_file().
+ * Params: segpath - the full path to the segment.
+ *         index - the index of the record in the segment.
+ * Returns: nothing
+ */
+void archive_record(char *segpath, int index);
+
+/*
+ * Claims the right to publish a plain file's match, since with -speculate
+ * (see spec.h) another copy of it might be running somewhere else. Every build
+ * that links process.o defines this: fsch asks the central machine if the file
+ * was copied, fsch_threads never copies a file, so it always has the right.
+ * Params: filename - the full path to the file.
+ * Returns: 1 if the match should be published; 0 if another copy already was.
+ */
+int claim_result(char *filename);
+
+/*
+ * Checks whether a plain file being read has been cancelled, because another
+ * copy of it already finished. Every build that links process.o defines this,
+ * just like claim_result().
+ * Params: filename - the full path to the file.
+ * Returns: 1 if it has; 0 otherwise.
+ */
+int file_cancelled(char *filename);
+
+/*
+ * Claims a file's contents in the seen set with -dedup (see dedup.h). Every
+ * build that links process.o defines this: fsch asks whichever node owns the
+ * hash, fsch_threads looks in its own set.
+ * Params: hash - the hash of the contents.
+ *         len - the length of the contents.
+ * Returns: what the claim found (DEDUP_NEW if it's the first copy).
+ */
+int dedup_claim(uint64_t hash, uint64_t len);
+
+/*
+ * Tells the seen set whether the first copy of some contents matched. Every
+ * build that links process.o defines this, just like dedup_claim().
+ * Params: hash - the hash of the contents.
+ *         len - the length of the contents.
+ *         matched - 1 if it matched; 0 otherwise.
+ * Returns: nothing
+ */
+void dedup_report(uint64_t hash, uint64_t len, int matched);
+
+#endif //PROCESS_H_INCLUDED
@@ -0,0 +1,393 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "container.h"
+
+#define PRINT_USAGE() fprintf(stderr, \
+	  "****************************************** \
+	 \n** MATH 4777 Project Queue Benchmark    ** \
+	 \n****************************************** \
+	 \nUsage: ./qbench [options] \
+	 \n Options: \
+	 \n   -p <threads>       = Number of threads enqueueing (default: 1) \
+	 \n   -c <threads>       = Number of threads dequeueing (default: 1) \
+	 \n   -s <threads>       = Number of threads polling queue_size() meanwhile, like the dispatcher does (default: 0) \
+	 \n   -n <files>         = Files each enqueueing thread enqueues (default: 20000) \
+	 \n   -d <files>         = Files already in the queue when we start (default: 0) \
+	 \n   -dist <priorities> = Priority distribution: uniform (default), equal, increasing or decreasing (like -op on a sorted directory) \
+	 \n   -seed <seed>       = Random seed (default: time)\n")
+
+#define FILE_NAME "/data/in/11_1792346974.sen"	//What every file we enqueue is called
+#define MAX_POLLS (1 << 20)							//Most queue_size() calls each polling thread times
+
+/* Priority distributions */
+enum {
+	UNIFORM_PRIORITY,		//Random priorities
+	EQUAL_PRIORITY,			//Every file has the same priority, like the default
+	INCREASING_PRIORITY,	//Every file has a higher priority than the last
+	DECREASING_PRIORITY		//Every file has a lower priority than the last, like -op on a sorted directory
+};
+
+/* Defines what one thread measured */
+typedef struct _thread_stats_t {
+	long long *latencies;		//Nanoseconds each operation took
+	long ops;					//Number of operations
+	long allocations;			//Number of malloc() calls during them
+	int id;						//The thread's number among threads of its kind
+} thread_stats_t;
+
+/* Static function prototypes */
+
+/*
+ * The function each enqueueing thread should run.
+ * Params: arg - the thread's thread_stats_t.
+ * Returns: NULL every time.
+ */
+static void* producer_thread_func(void *arg);
+
+/*
+ * The function each dequeueing thread should run. Dequeues until the queue is
+ * closed and empty.
+ * Params: arg - the thread's thread_stats_t.
+ * Returns: NULL every time.
+ */
+static void* consumer_thread_func(void *arg);
+
+/*
+ * The function each polling thread should run. Calls queue_size() until the
+ * enqueueing threads are done.
+ * Params: arg - the thread's thread_stats_t.
+ * Returns: NULL every time.
+ */
+static void* poller_thread_func(void *arg);
+
+/*
+ * Gets a file's priority according to the priority distribution.
+ * Params: state - the thread's random state.
+ *         index - how many files the thread has enqueued so far.
+ *         id - the thread's number.
+ * Returns: the priority.
+ */
+static int next_priority(uint64_t *state, long index, int id);
+
+/*
+ * Gets the time.
+ * Params: nothing
+ * Returns: the monotonic time in nanoseconds.
+ */
+static long long now_ns();
+
+/*
+ * Prints the throughput, latency percentiles and allocations per operation of
+ * one kind of operation.
+ * Params: name - the name of the operation.
+ *         stats - what each thread doing it measured.
+ *         count - the number of threads doing it.
+ *         seconds - how long the benchmark ran for.
+ * Returns: nothing
+ */
+static void report(char *name, thread_stats_t *stats, int count, double seconds);
+
+/*
+ * Compares two latencies, for qsort().
+ * Params: a - the first latency.
+ *         b - the second latency.
+ * Returns: a negative, zero or positive value if a is less than, equal to or
+ *          greater than b.
+ */
+static int compare_latencies(const void *a, const void *b);
+
+/* Wrapped allocator, linked with -Wl,--wrap=malloc */
+void* __real_malloc(size_t size);
+void* __wrap_malloc(size_t size);
+
+/* Static variables */
+static file_queue_t *queue;					//The queue being benchmarked
+static int num_producers = 1;				//Number of threads enqueueing
+static int num_consumers = 1;				//Number of threads dequeueing
+static int num_pollers = 0;					//Number of threads calling queue_size()
+static long files_each = 20000;				//Files each enqueueing thread enqueues
+static long depth = 0;						//Files in the queue when we start
+static int dist = UNIFORM_PRIORITY;			//Priority distribution
+static uint64_t seed;						//Random seed
+static int producing = 1;					//1 while the enqueueing threads are running; 0 after
+static pthread_mutex_t producing_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects producing
+static __thread long thread_allocations = 0;	//malloc() calls this thread has made
+
+int main(int argc, char *argv[])
+{
+	seed = (uint64_t) time(NULL);
+	
+	//Go through whatever options the user specified
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 >= argc)
+		{
+			PRINT_USAGE();
+			return -1;
+		}
+		
+		char *opt = argv[i], *val = argv[++i];
+		
+		if(!strcmp(opt, "-p"))
+			num_producers = atoi(val);
+		else if(!strcmp(opt, "-c"))
+			num_consumers = atoi(val);
+		else if(!strcmp(opt, "-s"))
+			num_pollers = atoi(val);
+		else if(!strcmp(opt, "-n"))
+			files_each = atol(val);
+		else if(!strcmp(opt, "-d"))
+			depth = atol(val);
+		else if(!strcmp(opt, "-seed"))
+			seed = strtoull(val, NULL, 10);
+		else if(!strcmp(opt, "-dist") && !strcmp(val, "uniform"))
+			dist = UNIFORM_PRIORITY;
+		else if(!strcmp(opt, "-dist") && !strcmp(val, "equal"))
+			dist = EQUAL_PRIORITY;
+		else if(!strcmp(opt, "-dist") && !strcmp(val, "increasing"))
+			dist = INCREASING_PRIORITY;
+		else if(!strcmp(opt, "-dist") && !strcmp(val, "decreasing"))
+			dist = DECREASING_PRIORITY;
+		else
+		{
+			PRINT_USAGE();
+			return -1;
+		}
+	}
+	
+	if(num_producers < 1 || num_consumers < 1 || num_pollers < 0 || files_each < 0 || depth < 0)
+	{
+		PRINT_USAGE();
+		return -1;
+	}
+	
+	//Fill the queue to the starting depth, as if another thread had enqueued them just before
+	queue = init_queue(malloc(sizeof(file_queue_t)));
+	uint64_t state = seed;
+	
+	for(long i = 0; i < depth; i++)
+		enqueue(queue, FILE_NAME, 256, next_priority(&state, i - depth, num_producers));
+	
+	//Every thread's latencies are allocated up front, so they don't count as the queue's allocations
+	thread_stats_t *producers = calloc(num_producers, sizeof(thread_stats_t));
+	thread_stats_t *consumers = calloc(num_consumers, sizeof(thread_stats_t));
+	thread_stats_t *pollers = calloc(num_pollers > 0 ? num_pollers : 1, sizeof(thread_stats_t));
+	long max_dequeues = depth + files_each * num_producers;
+	
+	for(int i = 0; i < num_producers; i++)
+	{
+		producers[i].latencies = malloc(sizeof(long long) * (files_each > 0 ? files_each : 1));
+		producers[i].id = i;
+	}
+	
+	for(int i = 0; i < num_consumers; i++)
+	{
+		consumers[i].latencies = malloc(sizeof(long long) * (max_dequeues > 0 ? max_dequeues : 1));
+		consumers[i].id = i;
+	}
+	
+	for(int i = 0; i < num_pollers; i++)
+	{
+		pollers[i].latencies = malloc(sizeof(long long) * MAX_POLLS);
+		pollers[i].id = i;
+	}
+	
+	//Run everything at once
+	pthread_t *threads = malloc(sizeof(pthread_t) * (num_producers + num_consumers + num_pollers));
+	long long start = now_ns();
+	
+	for(int i = 0; i < num_consumers; i++)
+		pthread_create(&threads[num_producers + i], NULL, consumer_thread_func, &consumers[i]);
+	
+	for(int i = 0; i < num_pollers; i++)
+		pthread_create(&threads[num_producers + num_consumers + i], NULL, poller_thread_func, &pollers[i]);
+	
+	for(int i = 0; i < num_producers; i++)
+		pthread_create(&threads[i], NULL, producer_thread_func, &producers[i]);
+	
+	//Once everything's been enqueued, let the dequeueing threads finish what's left and stop polling
+	for(int i = 0; i < num_producers; i++)
+		pthread_join(threads[i], NULL);
+	
+	close_queue(queue);
+	pthread_mutex_lock(&producing_mutex);
+	producing = 0;
+	pthread_mutex_unlock(&producing_mutex);
+	
+	for(int i = num_producers; i < num_producers + num_consumers + num_pollers; i++)
+		pthread_join(threads[i], NULL);
+	
+	double seconds = (now_ns() - start) / 1e9;
+	
+	//Report what we measured
+	char *dist_names[] = { "uniform", "equal", "increasing", "decreasing" };
+	printf("QUEUE BENCHMARK: %d enqueueing, %d dequeueing, %d polling, %ld files each, depth %ld, %s priorities\n",
+		num_producers, num_consumers, num_pollers, files_each, depth, dist_names[dist]);
+	printf("TOTAL RUNTIME: %f seconds!\n", seconds);
+	report("enqueue", producers, num_producers, seconds);
+	report("dequeue_wait", consumers, num_consumers, seconds);
+	
+	if(num_pollers > 0)
+		report("queue_size", pollers, num_pollers, seconds);
+	
+	//Free everything we malloc()'d
+	for(int i = 0; i < num_producers; i++)
+		free(producers[i].latencies);
+	
+	for(int i = 0; i < num_consumers; i++)
+		free(consumers[i].latencies);
+	
+	for(int i = 0; i < num_pollers; i++)
+		free(pollers[i].latencies);
+	
+	free(producers);
+	free(consumers);
+	free(pollers);
+	free(threads);
+	free_queue(queue);
+	return 0;
+}
+
+void* __wrap_malloc(size_t size)
+{
+	thread_allocations++;
+	return __real_malloc(size);
+}
+
+static void* producer_thread_func(void *arg)
+{
+	thread_stats_t *stats = arg;
+	uint64_t state = seed + stats->id + 1;
+	long allocations = thread_allocations;
+	
+	for(long i = 0; i < files_each; i++)
+	{
+		int priority = next_priority(&state, i, stats->id);
+		long long start = now_ns();
+		enqueue(queue, FILE_NAME, 256, priority);
+		stats->latencies[stats->ops++] = now_ns() - start;
+	}
+	
+	stats->allocations = thread_allocations - allocations;
+	return NULL;
+}
+
+static void* consumer_thread_func(void *arg)
+{
+	thread_stats_t *stats = arg;
+	long allocations = thread_allocations;
+	int file_size, priority;
+	char *file;
+	
+	for(;;)
+	{
+		long long start = now_ns();
+		
+		if((file = dequeue_wait(queue, &file_size, &priority)) == NULL)
+			break;
+		
+		stats->latencies[stats->ops++] = now_ns() - start;
+		free(file);
+	}
+	
+	stats->allocations = thread_allocations - allocations;
+	return NULL;
+}
+
+static void* poller_thread_func(void *arg)
+{
+	thread_stats_t *stats = arg;
+	long allocations = thread_allocations;
+	int polling = 1;
+	
+	while(polling && stats->ops < MAX_POLLS)
+	{
+		long long start = now_ns();
+		queue_size(queue);
+		stats->latencies[stats->ops++] = now_ns() - start;
+		
+		pthread_mutex_lock(&producing_mutex);
+		polling = producing;
+		pthread_mutex_unlock(&producing_mutex);
+	}
+	
+	stats->allocations = thread_allocations - allocations;
+	return NULL;
+}
+
+static int next_priority(uint64_t *state, long index, int id)
+{
+	switch(dist)
+	{
+		case EQUAL_PRIORITY:
+			return 1;
+		case INCREASING_PRIORITY:
+			return (int) (index * num_producers + id);
+		case DECREASING_PRIORITY:
+			return (int) -(index * num_producers + id);
+		default:
+		{
+			//xorshift64*
+			*state ^= *state >> 12;
+			*state ^= *state << 25;
+			*state ^= *state >> 27;
+			return (int) ((*state * 0x2545F4914F6CDD1DULL) >> 33);
+		}
+	}
+}
+
+static long long now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void report(char *name, thread_stats_t *stats, int count, double seconds)
+{
+	//Put every thread's latencies together
+	long ops = 0, allocations = 0;
+	
+	for(int i = 0; i < count; i++)
+	{
+		ops += stats[i].ops;
+		allocations += stats[i].allocations;
+	}
+	
+	long long *all = malloc(sizeof(long long) * (ops > 0 ? ops : 1));
+	long filled = 0;
+	
+	for(int i = 0; i < count; i++)
+	{
+		memcpy(all + filled, stats[i].latencies, sizeof(long long) * stats[i].ops);
+		filled += stats[i].ops;
+	}
+	
+	qsort(all, ops, sizeof(long long), compare_latencies);
+	
+	//Nearest rank percentiles
+	long long p50 = 0, p90 = 0, p99 = 0, max = 0;
+	
+	if(ops > 0)
+	{
+		p50 = all[(ops * 50 + 99) / 100 - 1];
+		p90 = all[(ops * 90 + 99) / 100 - 1];
+		p99 = all[(ops * 99 + 99) / 100 - 1];
+		max = all[ops - 1];
+	}
+	
+	printf("%s: %ld ops, %.0f ops/sec, latency (ns) p50 %lld, p90 %lld, p99 %lld, max %lld, %.2f allocations/op\n",
+		name, ops, ops / seconds, p50, p90, p99, max, (ops > 0) ? (double) allocations / ops : 0);
+	free(all);
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+	long long la = *((const long long*) a), lb = *((const long long*) b);
+	return (la > lb) - (la < lb);
+}
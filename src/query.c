@@ -0,0 +1,573 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "query.h"
+
+#define OPERATOR_CHARS "()=!<>&|'\""	//Characters that can't be part of a key or unquoted value
+
+/* Defines the state of a query being compiled */
+typedef struct _parser_t {
+	char *pos;				//Next character to parse
+	query_t *query;			//The query being compiled
+	char *err;				//Where to describe what's wrong
+	int err_len;			//Size of err
+} parser_t;
+
+/* Defines a key whose type we already know */
+typedef struct _known_key_t {
+	char *key;
+	int type;
+} known_key_t;
+
+/* Static function prototypes */
+
+/*
+ * Parses an OR expression: one or more AND expressions separated by OR.
+ * Params: parser - the parser.
+ * Returns: 0 if the expression was parsed; nonzero otherwise.
+ */
+static int parse_or(parser_t *parser);
+
+/*
+ * Parses an AND expression: one or more NOT expressions separated by AND.
+ * Params: parser - the parser.
+ * Returns: 0 if the expression was parsed; nonzero otherwise.
+ */
+static int parse_and(parser_t *parser);
+
+/*
+ * Parses a NOT expression: a comparison, key or parenthesized expression,
+ * optionally preceded by any number of NOTs.
+ * Params: parser - the parser.
+ * Returns: 0 if the expression was parsed; nonzero otherwise.
+ */
+static int parse_not(parser_t *parser);
+
+/*
+ * Parses a comparison, a key on its own or a parenthesized expression.
+ * Params: parser - the parser.
+ * Returns: 0 if the expression was parsed; nonzero otherwise.
+ */
+static int parse_primary(parser_t *parser);
+
+/*
+ * Parses the value on the right-hand side of a comparison into an operation.
+ * Params: parser - the parser.
+ *         op - the comparison, whose slot has already been set.
+ *         key_type - the type of the key being compared, or -1 if it isn't a
+ *         known key.
+ * Returns: 0 if the value was parsed; nonzero otherwise.
+ */
+static int parse_literal(parser_t *parser, query_op_t *op, int key_type);
+
+/*
+ * Skips whitespace, then checks for a keyword or symbol and skips past it if
+ * it's there. Keywords are case-insensitive and can't run into a key.
+ * Params: parser - the parser.
+ *         word - the keyword or symbol.
+ * Returns: 1 if it was there; 0 otherwise.
+ */
+static int accept(parser_t *parser, char *word);
+
+/*
+ * Skips whitespace, then gets the length of the key or unquoted value at the
+ * parser's position.
+ * Params: parser - the parser.
+ * Returns: the length, which is 0 if there isn't one.
+ */
+static int word_len(parser_t *parser);
+
+/*
+ * Adds an operation to the end of the program.
+ * Params: parser - the parser.
+ *         op - the operation.
+ * Returns: 0 if it was added; nonzero if the program is full.
+ */
+static int emit(parser_t *parser, query_op_t *op);
+
+/*
+ * Describes what's wrong with the query, and where.
+ * Params: parser - the parser.
+ *         what - what's wrong.
+ * Returns: 1, so the caller can return it.
+ */
+static int fail(parser_t *parser, char *what);
+
+/*
+ * Gets the type of a key filegen writes.
+ * Params: key - the key, not null-terminated.
+ *         len - the length of the key.
+ * Returns: the type of the key, or -1 if it isn't one filegen writes.
+ */
+static int known_key_type(char *key, int len);
+
+/*
+ * Parses a value as a type other than a string.
+ * Params: value - the value, not null-terminated.
+ *         len - the length of the value.
+ *         type - the type to parse it as.
+ *         num - a single int64_t buffer that will contain the value on return,
+ *         arranged so that comparing two values of the same type compares
+ *         the numbers.
+ * Returns: 0 if the value is a valid value of the type; nonzero otherwise.
+ */
+static int parse_value(char *value, int len, int type, int64_t *num);
+
+/*
+ * Runs a single comparison against a key's value.
+ * Params: op - the comparison.
+ *         value - the value, not null-terminated.
+ *         len - the length of the value.
+ * Returns: 1 if the comparison is true; 0 otherwise (including if the value
+ *          isn't of the comparison's type).
+ */
+static int compare(query_op_t *op, char *value, int len);
+
+/* query.h extern variables */
+query_t *search_query = NULL;
+
+/* Types of the keys in keystypes (filegen.py) */
+static known_key_t known_keys[] = {
+	{ "sensorname", STRING_VALUE },
+	{ "firmware", STRING_VALUE },
+	{ "timestamp", TIMESTAMP_VALUE },
+	{ "unixtimestamp", INT_VALUE },
+	{ "bytecount", INT_VALUE },
+	{ "packetcount", INT_VALUE },
+	{ "malwarecount", INT_VALUE },
+	{ "uptime", INT_VALUE },
+	{ "machineip", IP_VALUE },
+	{ "language", STRING_VALUE },
+	{ "ipv4count", INT_VALUE },
+	{ "ipv6count", INT_VALUE },
+	{ "threatlevel", INT_VALUE }
+};
+
+/* Names of each type, for error messages */
+static char *type_names[] = { "an int", "an IP address", "a timestamp", "a string" };
+
+query_t* query_compile(char *str, char *err, int err_len)
+{
+	query_t *query = malloc(sizeof(query_t));
+	query->num_keys = 0;
+	query->num_ops = 0;
+	
+	parser_t parser = { str, query, err, err_len };
+	
+	//An empty query has nothing to parse
+	if(word_len(&parser) == 0 && *parser.pos == '\0')
+		return query;
+	
+	int failed = parse_or(&parser);
+	
+	//The whole thing has to be a single expression
+	if(!failed && (word_len(&parser) > 0 || *parser.pos != '\0'))
+		failed = fail(&parser, "expected AND, OR or the end of the query");
+	
+	if(failed)
+	{
+		query_free(query);
+		return NULL;
+	}
+	
+	return query;
+}
+
+void query_free(query_t *query)
+{
+	for(int i = 0; i < query->num_keys; i++)
+		free(query->keys[i]);
+	
+	free(query);
+}
+
+int query_key_slot(query_t *query, char *key, int len)
+{
+	for(int i = 0; i < query->num_keys; i++)
+		if(query->key_lens[i] == len && !memcmp(query->keys[i], key, len))
+			return i;
+	
+	return -1;
+}
+
+int query_add_key(query_t *query, char *key, int len)
+{
+	int slot = query_key_slot(query, key, len);
+	
+	if(slot >= 0 || query->num_keys == QUERY_MAX_KEYS)
+		return slot;
+	
+	slot = query->num_keys++;
+	query->keys[slot] = malloc(len + 1);
+	memcpy(query->keys[slot], key, len);
+	query->keys[slot][len] = '\0';
+	query->key_lens[slot] = len;
+	return slot;
+}
+
+void query_reset(query_t *query, query_values_t *values)
+{
+	for(int i = 0; i < query->num_keys; i++)
+		values->len[i] = -1;
+	
+	values->num_seen = 0;
+}
+
+int query_set(query_t *query, query_values_t *values, int slot, char *value, int len)
+{
+	if(values->len[slot] < 0)
+	{
+		//Ignore trailing whitespace (e.g. from a file with DOS line endings)
+		while(len > 0 && isspace((unsigned char) value[len - 1]))
+			len--;
+		
+		values->len[slot] = (len < QUERY_VALUE_LEN) ? len : QUERY_VALUE_LEN;
+		memcpy(values->value[slot], value, values->len[slot]);
+		values->num_seen++;
+	}
+	
+	return values->num_seen == query->num_keys;
+}
+
+int query_eval(query_t *query, query_values_t *values)
+{
+	int stack[QUERY_MAX_OPS], top = 0;
+	
+	for(int i = 0; i < query->num_ops; i++)
+	{
+		query_op_t *op = &(query->ops[i]);
+		int seen = (op->op <= GE_OP) && values->len[op->slot] >= 0;
+		
+		switch(op->op)
+		{
+			case EXISTS_OP:
+				stack[top++] = seen;
+				break;
+			case AND_OP:
+				top--;
+				stack[top - 1] = stack[top - 1] && stack[top];
+				break;
+			case OR_OP:
+				top--;
+				stack[top - 1] = stack[top - 1] || stack[top];
+				break;
+			case NOT_OP:
+				stack[top - 1] = !stack[top - 1];
+				break;
+			default:
+				stack[top++] = seen && compare(op, values->value[op->slot], values->len[op->slot]);
+				break;
+		}
+	}
+	
+	return (query->num_ops == 0) || stack[0];	//An empty query is always satisfied
+}
+
+static int parse_or(parser_t *parser)
+{
+	if(parse_and(parser))
+		return 1;
+	
+	while(accept(parser, "OR") || accept(parser, "||"))
+	{
+		query_op_t op = { OR_OP };
+		
+		if(parse_and(parser) || emit(parser, &op))
+			return 1;
+	}
+	
+	return 0;
+}
+
+static int parse_and(parser_t *parser)
+{
+	if(parse_not(parser))
+		return 1;
+	
+	while(accept(parser, "AND") || accept(parser, "&&"))
+	{
+		query_op_t op = { AND_OP };
+		
+		if(parse_not(parser) || emit(parser, &op))
+			return 1;
+	}
+	
+	return 0;
+}
+
+static int parse_not(parser_t *parser)
+{
+	if(accept(parser, "NOT") || accept(parser, "!"))
+	{
+		query_op_t op = { NOT_OP };
+		return parse_not(parser) || emit(parser, &op);
+	}
+	
+	return parse_primary(parser);
+}
+
+static int parse_primary(parser_t *parser)
+{
+	//A parenthesized expression
+	if(accept(parser, "("))
+		return parse_or(parser) || (!accept(parser, ")") && fail(parser, "expected )"));
+	
+	//Otherwise it starts with a key
+	int len = word_len(parser);
+	
+	if(len == 0)
+		return fail(parser, "expected a key");
+	
+	query_t *query = parser->query;
+	char *key = parser->pos;
+	query_op_t op;
+	memset(&op, 0, sizeof(query_op_t));
+	
+	if((op.slot = query_add_key(query, key, len)) < 0)
+		return fail(parser, "too many keys");
+	
+	parser->pos += len;
+	
+	//Then it's either a comparison or a key on its own
+	if(accept(parser, "==") || accept(parser, "="))
+		op.op = EQ_OP;
+	else if(accept(parser, "!="))
+		op.op = NE_OP;
+	else if(accept(parser, "<="))
+		op.op = LE_OP;
+	else if(accept(parser, "<"))
+		op.op = LT_OP;
+	else if(accept(parser, ">="))
+		op.op = GE_OP;
+	else if(accept(parser, ">"))
+		op.op = GT_OP;
+	else
+	{
+		op.op = EXISTS_OP;
+		return emit(parser, &op);
+	}
+	
+	return parse_literal(parser, &op, known_key_type(key, len)) || emit(parser, &op);
+}
+
+static int parse_literal(parser_t *parser, query_op_t *op, int key_type)
+{
+	int len = word_len(parser);
+	char *value = parser->pos;
+	
+	//Quoted values are always strings, and run to the matching quote
+	if(*value == '\'' || *value == '"')
+	{
+		char *end = strchr(value + 1, *value);
+		
+		if(end == NULL)
+			return fail(parser, "unterminated string");
+		
+		if(key_type >= 0 && key_type != STRING_VALUE)
+			return fail(parser, "expected an unquoted value");
+		
+		op->type = STRING_VALUE;
+		value++;
+		len = end - value;
+		parser->pos = end + 1;
+	}
+	else if(len == 0)
+		return fail(parser, "expected a value");
+	else
+	{
+		//Use the key's type if we know it; otherwise, go by what the value looks like
+		if(key_type >= 0)
+			op->type = key_type;
+		else
+		{
+			for(op->type = INT_VALUE; op->type < STRING_VALUE; op->type++)
+				if(!parse_value(value, len, op->type, &(op->num)))
+					break;
+		}
+		
+		if(op->type != STRING_VALUE && parse_value(value, len, op->type, &(op->num)))
+		{
+			char what[64];
+			snprintf(what, sizeof(what), "expected %s", type_names[op->type]);
+			return fail(parser, what);
+		}
+		
+		parser->pos += len;
+	}
+	
+	if(len >= QUERY_VALUE_LEN)
+		return fail(parser, "value is too long");
+	
+	memcpy(op->str, value, len);
+	op->str_len = len;
+	return 0;
+}
+
+static int accept(parser_t *parser, char *word)
+{
+	while(isspace((unsigned char) *(parser->pos)))
+		parser->pos++;
+	
+	int len = strlen(word);
+	
+	if(strncasecmp(parser->pos, word, len))
+		return 0;
+	
+	//A keyword has to be followed by something that isn't part of a key
+	if(isalpha((unsigned char) word[0]) && parser->pos[len] != '\0' && !isspace((unsigned char) parser->pos[len]) &&
+		!strchr(OPERATOR_CHARS, parser->pos[len]))
+		return 0;
+	
+	parser->pos += len;
+	return 1;
+}
+
+static int word_len(parser_t *parser)
+{
+	while(isspace((unsigned char) *(parser->pos)))
+		parser->pos++;
+	
+	int len = 0;
+	
+	while(parser->pos[len] != '\0' && !isspace((unsigned char) parser->pos[len]) && !strchr(OPERATOR_CHARS, parser->pos[len]))
+		len++;
+	
+	return len;
+}
+
+static int emit(parser_t *parser, query_op_t *op)
+{
+	if(parser->query->num_ops == QUERY_MAX_OPS)
+		return fail(parser, "query is too long");
+	
+	parser->query->ops[parser->query->num_ops++] = *op;
+	return 0;
+}
+
+static int fail(parser_t *parser, char *what)
+{
+	if(*(parser->pos) == '\0')
+		snprintf(parser->err, parser->err_len, "%s at the end of the query", what);
+	else
+		snprintf(parser->err, parser->err_len, "%s at \"%.20s\"", what, parser->pos);
+	
+	return 1;
+}
+
+static int known_key_type(char *key, int len)
+{
+	for(int i = 0; i < (int) (sizeof(known_keys) / sizeof(known_key_t)); i++)
+		if((int) strlen(known_keys[i].key) == len && !strncmp(known_keys[i].key, key, len))
+			return known_keys[i].type;
+	
+	return -1;
+}
+
+static int parse_value(char *value, int len, int type, int64_t *num)
+{
+	int64_t fields[6] = { 0, 0, 0, 0, 0, 0 };
+	int num_fields = 0, pos = 0;
+	int negative = (type == INT_VALUE && len > 1 && value[0] == '-');
+	char separator = (type == IP_VALUE) ? '.' : '-';
+	
+	if(negative)
+		pos++;
+	
+	//Every type is a list of numbers with separators between them
+	while(pos < len)
+	{
+		int start = pos;
+		
+		if(num_fields == 6)
+			return 1;
+		
+		while(pos < len && isdigit((unsigned char) value[pos]))
+		{
+			//Keep it from overflowing
+			if(fields[num_fields] > (INT64_MAX - 9) / 10)
+				return 1;
+			
+			fields[num_fields] = fields[num_fields] * 10 + (value[pos++] - '0');
+		}
+		
+		if(pos == start)
+			return 1;
+		
+		num_fields++;
+		
+		//A separator has to be followed by another number
+		if(pos < len && (type == INT_VALUE || value[pos++] != separator || pos == len))
+			return 1;
+	}
+	
+	if(num_fields == 0)
+		return 1;
+	
+	switch(type)
+	{
+		case INT_VALUE:
+			*num = negative ? -fields[0] : fields[0];
+			return num_fields != 1;
+		case IP_VALUE:
+			*num = (fields[0] << 24) | (fields[1] << 16) | (fields[2] << 8) | fields[3];
+			return num_fields != 4 || fields[0] > 255 || fields[1] > 255 || fields[2] > 255 || fields[3] > 255;
+		case TIMESTAMP_VALUE:
+			//Arrange it as YYYYMMDDHHMMSS, so later times are bigger numbers
+			*num = fields[0];
+			
+			for(int i = 1; i < 6; i++)
+			{
+				if(fields[i] > 99)
+					return 1;
+				
+				*num = *num * 100 + fields[i];
+			}
+			
+			return fields[0] > 9999;
+	}
+	
+	return 1;
+}
+
+static int compare(query_op_t *op, char *value, int len)
+{
+	int cmp;
+	
+	if(op->type == STRING_VALUE)
+	{
+		cmp = memcmp(value, op->str, (len < op->str_len) ? len : op->str_len);
+		
+		if(cmp == 0)
+			cmp = len - op->str_len;
+	}
+	else
+	{
+		int64_t num;
+		
+		if(parse_value(value, len, op->type, &num))
+			return 0;
+		
+		cmp = (num > op->num) - (num < op->num);
+	}
+	
+	switch(op->op)
+	{
+		case EQ_OP:
+			return cmp == 0;
+		case NE_OP:
+			return cmp != 0;
+		case LT_OP:
+			return cmp < 0;
+		case LE_OP:
+			return cmp <= 0;
+		case GT_OP:
+			return cmp > 0;
+		case GE_OP:
+			return cmp >= 0;
+	}
+	
+	return 0;
+}
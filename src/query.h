@@ -0,0 +1,150 @@
+#ifndef QUERY_H_INCLUDED
+#define QUERY_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * A query is a predicate over the values in a .sen file, e.g.
+ *
+ *   threatlevel > 900 AND (malwarecount > 0 OR machineip = 10.0.0.1)
+ *
+ * Comparisons are key <op> value, where op is one of = == != < <= > >=, and
+ * can be combined with AND, OR and NOT (or &&, || and !) and parentheses. A
+ * key on its own is true if the file has that key.
+ *
+ * Values are typed. The keys filegen writes have the types in keystypes; any
+ * other key takes the type of the value it's compared against:
+ *   - int: a decimal integer, e.g. 900
+ *   - IP: a dotted IPv4 address, e.g. 10.0.0.1
+ *   - timestamp: YYYY-MM-DD-HH-MM-SS, or any prefix of it (e.g. 2023-09),
+ *     with the missing fields treated as zero
+ *   - string: anything else, quoted with '' or "" if it has spaces or
+ *     operators in it
+ *
+ * A query is compiled once into a flat postfix program. As each file is
+ * scanned, the value of every key the query mentions is recorded, and the
+ * program is run over those values once the file ends (or as soon as every
+ * key it mentions has been seen).
+ */
+
+#define QUERY_MAX_KEYS 16			//Most distinct keys a query can mention
+#define QUERY_MAX_OPS 64			//Most operations a compiled query can have
+#define QUERY_VALUE_LEN 80			//Most characters of a value we keep
+
+/* Value types */
+enum {
+	INT_VALUE,
+	IP_VALUE,
+	TIMESTAMP_VALUE,
+	STRING_VALUE
+};
+
+/* Operations */
+enum {
+	EXISTS_OP,		//Push 1 if the key was seen
+	EQ_OP,			//Comparisons push 1 if the key was seen and compares true
+	NE_OP,
+	LT_OP,
+	LE_OP,
+	GT_OP,
+	GE_OP,
+	AND_OP,			//Pop two results and push the result of combining them
+	OR_OP,
+	NOT_OP			//Pop one result and push its negation
+};
+
+/* Defines a single operation of a compiled query */
+typedef struct _query_op_t {
+	int op;							//The operation
+	int slot;						//Key the operation looks at, for EXISTS_OP and comparisons
+	int type;						//Type to compare as, for comparisons
+	int64_t num;					//Value to compare against, for int, IP and timestamp comparisons
+	char str[QUERY_VALUE_LEN];		//Value to compare against, for string comparisons
+	int str_len;					//Length of str
+} query_op_t;
+
+/* Defines a compiled query */
+typedef struct _query_t {
+	char *keys[QUERY_MAX_KEYS];		//Each distinct key the query mentions
+	int key_lens[QUERY_MAX_KEYS];	//Length of each key
+	int num_keys;					//Number of keys
+	query_op_t ops[QUERY_MAX_OPS];	//The program, in postfix order
+	int num_ops;					//Number of operations
+} query_t;
+
+/* Defines the values a file has for each key a query mentions */
+typedef struct _query_values_t {
+	char value[QUERY_MAX_KEYS][QUERY_VALUE_LEN];	//Each key's value, not null-terminated
+	int len[QUERY_MAX_KEYS];						//Length of each value, or -1 if the key hasn't been seen
+	int num_seen;									//Number of keys that have been seen
+} query_values_t;
+
+/* query.h extern variables */
+extern query_t *search_query;		//Query files have to satisfy to match, or NULL for none
+
+/* Query functions */
+
+/*
+ * Compiles a query. An empty query is satisfied by every file.
+ * Params: str - the query.
+ *         err - a buffer for a description of what's wrong with the query.
+ *         err_len - the size of err.
+ * Returns: a malloc()'d compiled query, or NULL if the query doesn't make
+ *          sense.
+ */
+query_t* query_compile(char *str, char *err, int err_len);
+
+/*
+ * Frees a compiled query.
+ * Params: query - the query.
+ * Returns: nothing
+ */
+void query_free(query_t *query);
+
+/*
+ * Gets the slot a query records a key's value in.
+ * Params: query - the query.
+ *         key - the key, not null-terminated.
+ *         len - the length of the key.
+ * Returns: the slot, or -1 if the query doesn't mention the key.
+ */
+int query_key_slot(query_t *query, char *key, int len);
+
+/*
+ * Gets the slot a query records a key's value in, giving the key one if the
+ * query doesn't mention it yet.
+ * Params: query - the query.
+ *         key - the key, not null-terminated.
+ *         len - the length of the key.
+ * Returns: the slot, or -1 if the query already mentions QUERY_MAX_KEYS keys.
+ */
+int query_add_key(query_t *query, char *key, int len);
+
+/*
+ * Clears the values recorded for a file so a new one can be scanned.
+ * Params: query - the query.
+ *         values - the values.
+ * Returns: nothing
+ */
+void query_reset(query_t *query, query_values_t *values);
+
+/*
+ * Records a key's value. Only the first value a file has for a key counts.
+ * Params: query - the query.
+ *         values - the values.
+ *         slot - the key's slot.
+ *         value - the value, not null-terminated.
+ *         len - the length of the value.
+ * Returns: 1 if every key the query mentions has now been seen; 0 otherwise.
+ */
+int query_set(query_t *query, query_values_t *values, int slot, char *value, int len);
+
+/*
+ * Runs a query over the values recorded for a file.
+ * Params: query - the query.
+ *         values - the values.
+ * Returns: 1 if the file satisfies the query; 0 otherwise.
+ */
+int query_eval(query_t *query, query_values_t *values);
+
+#endif //QUERY_H_INCLUDED
@@ -0,0 +1,211 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "result.h"
+
+/* Defines a thread's buffer of results */
+typedef struct _result_buf_t {
+	char data[RESULT_BUF_SIZE];		//Records that haven't been written out yet
+	size_t len;						//Bytes of data used
+	struct _result_buf_t *next;		//Next thread's buffer
+} result_buf_t;
+
+/* Static function prototypes */
+
+/*
+ * Gets the calling thread's buffer, creating it if this is the thread's first
+ * match.
+ * Params: nothing
+ * Returns: the calling thread's buffer.
+ */
+static result_buf_t* local_buf();
+
+/*
+ * Writes out a buffer and empties it.
+ * Params: buf - the buffer.
+ * Returns: nothing
+ */
+static void flush_buf(result_buf_t *buf);
+
+/* result.h extern variables */
+char *result_path = NULL;
+int result_format = RESULT_NDJSON;
+int verbosity = VERBOSE_MATCHES;
+
+/* Static variables */
+static int sink_fd = -1;							//The sink, or -1 if it isn't open
+static __thread result_buf_t *buf = NULL;			//This thread's buffer
+static result_buf_t *all_bufs = NULL;				//Every thread's buffer
+static pthread_mutex_t bufs_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects all_bufs
+static pthread_mutex_t sink_mutex = PTHREAD_MUTEX_INITIALIZER;	//Makes sure only one buffer is written at a time
+
+int result_init(int rank)
+{
+	if(result_path == NULL)
+		return 0;
+	
+	if(!strcmp(result_path, "-"))
+	{
+		sink_fd = STDOUT_FILENO;
+		return 0;
+	}
+	
+	//Every rank gets a file of its own, so nothing else ever writes to it
+	char path[FILENAME_MAX];
+	
+	if(rank >= 0)
+		snprintf(path, FILENAME_MAX, "%s.%d", result_path, rank);
+	else
+		snprintf(path, FILENAME_MAX, "%s", result_path);
+	
+	sink_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	return sink_fd < 0;
+}
+
+void result_match(int id, char *filename, char *key, int key_len, char *value, int value_len)
+{
+	if(sink_fd < 0)
+		return;
+	
+	//Names and lines are short, but make sure nothing overruns a record
+	int file_len = strlen(filename);
+	file_len = (file_len < UINT16_MAX) ? file_len : UINT16_MAX;
+	key_len = (key_len < UINT16_MAX) ? key_len : UINT16_MAX;
+	value_len = (value_len < UINT16_MAX) ? value_len : UINT16_MAX;
+	
+	//Escaping a character takes at most 6 bytes, and the rest of a line of JSON fits in 64
+	size_t most = (result_format == RESULT_BINARY) ? sizeof(result_header_t) + file_len + key_len + value_len
+		: 6 * ((size_t) file_len + key_len + value_len) + 64;
+	
+	result_buf_t *b = local_buf();
+	
+	if(b->len + most > RESULT_BUF_SIZE)
+		flush_buf(b);
+	
+	//A record too big for a whole buffer is dropped rather than split
+	if(most > RESULT_BUF_SIZE)
+		return;
+	
+	char *out = b->data + b->len;
+	
+	if(result_format == RESULT_BINARY)
+	{
+		result_header_t header = { most, id, file_len, key_len, value_len, 0 };
+		memcpy(out, &header, sizeof(header));
+		memcpy(out + sizeof(header), filename, file_len);
+		memcpy(out + sizeof(header) + file_len, key, key_len);
+		memcpy(out + sizeof(header) + file_len + key_len, value, value_len);
+		b->len += most;
+	}
+	else
+	{
+		size_t len = sprintf(out, "{\"id\": %d, \"file\": ", id);
+		len += result_json_string(out + len, filename, file_len);
+		len += sprintf(out + len, ", \"key\": ");
+		len += result_json_string(out + len, key, key_len);
+		len += sprintf(out + len, ", \"value\": ");
+		len += result_json_string(out + len, value, value_len);
+		len += sprintf(out + len, "}\n");
+		b->len += len;
+	}
+}
+
+void result_log(int level, const char *fmt, ...)
+{
+	if(verbosity < level)
+		return;
+	
+	//Keep results on stdout parseable
+	FILE *log = (result_path != NULL && !strcmp(result_path, "-")) ? stderr : stdout;
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(log, fmt, args);
+	va_end(args);
+}
+
+void result_cleanup()
+{
+	pthread_mutex_lock(&bufs_mutex);
+	
+	while(all_bufs != NULL)
+	{
+		result_buf_t *next = all_bufs->next;
+		flush_buf(all_bufs);
+		free(all_bufs);
+		all_bufs = next;
+	}
+	
+	pthread_mutex_unlock(&bufs_mutex);
+	buf = NULL;
+	
+	if(sink_fd > STDOUT_FILENO)
+		close(sink_fd);
+	
+	sink_fd = -1;
+}
+
+size_t result_json_string(char *out, char *str, int len)
+{
+	size_t o = 0;
+	out[o++] = '"';
+	
+	for(int i = 0; i < len; i++)
+	{
+		unsigned char c = (unsigned char) str[i];
+		
+		if(c == '"' || c == '\\')
+		{
+			out[o++] = '\\';
+			out[o++] = c;
+		}
+		else if(c < 0x20)
+			o += sprintf(out + o, "\\u%04x", c);	//Control characters (e.g. a stray \r) have to be escaped
+		else
+			out[o++] = c;
+	}
+	
+	out[o++] = '"';
+	return o;
+}
+
+static result_buf_t* local_buf()
+{
+	//If this is the first time this thread has found a match, give it its own buffer
+	if(buf == NULL)
+	{
+		buf = malloc(sizeof(result_buf_t));
+		buf->len = 0;
+		
+		pthread_mutex_lock(&bufs_mutex);
+		buf->next = all_bufs;
+		all_bufs = buf;
+		pthread_mutex_unlock(&bufs_mutex);
+	}
+	
+	return buf;
+}
+
+static void flush_buf(result_buf_t *b)
+{
+	size_t done = 0;
+	pthread_mutex_lock(&sink_mutex);
+	
+	//A write can be cut short (e.g. by a pipe), so keep going until it's all out
+	while(done < b->len)
+	{
+		ssize_t written = write(sink_fd, b->data + done, b->len - done);
+		
+		if(written <= 0)
+			break;
+		
+		done += written;
+	}
+	
+	pthread_mutex_unlock(&sink_mutex);
+	b->len = 0;
+}
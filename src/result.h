@@ -0,0 +1,111 @@
+#ifndef RESULT_H_INCLUDED
+#define RESULT_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * With -results <file>, every match that would be printed is written to <file>
+ * (- for stdout) as a structured record instead of having to be picked out of
+ * the log (so with -agg, there's nothing to write). Each thread buffers its
+ * records and writes them out RESULT_BUF_SIZE bytes at a time, so threads only
+ * ever contend for the sink once per block, and a block only ever holds whole
+ * records. In fsch, every node writes to a file of its own, <file>.<rank>, so
+ * records from different ranks never share a file to interleave in (with -,
+ * they all go to stdout, which is only safe with one node).
+ *
+ * With -format ndjson (the default), each record is a line of JSON:
+ *
+ *   {"id": n, "file": "...", "key": "...", "value": "..."}
+ *
+ * With -format binary, each record is a result_header_t followed by the file,
+ * key and value, none of them terminated.
+ *
+ * Human-readable logging goes to stdout (or stderr, if results go to stdout)
+ * depending on -v <level>: VERBOSE_QUIET only prints the summaries at the end,
+ * VERBOSE_MATCHES (the default) also prints every match, and VERBOSE_FILES
+ * also prints what happens to every file.
+ */
+
+#define RESULT_BUF_SIZE 1048576	//Bytes each thread buffers before writing them to the sink
+
+/* Formats results can be written in */
+enum {
+	RESULT_NDJSON,	//A line of JSON per match
+	RESULT_BINARY	//A result_header_t per match, followed by its strings
+};
+
+/* Verbosity levels */
+enum {
+	VERBOSE_QUIET,		//Only the summaries at the end
+	VERBOSE_MATCHES,	//Every match too
+	VERBOSE_FILES		//What happens to every file too
+};
+
+/* Defines the start of a binary result record, in native byte order */
+typedef struct _result_header_t {
+	uint32_t length;	//Length of the whole record, including this header
+	int32_t id;			//Rank or worker number that found the match
+	uint16_t file_len;	//Length of the file's name, which comes right after this header
+	uint16_t key_len;	//Length of the key, which comes after the file's name
+	uint16_t value_len;	//Length of the value, which comes after the key
+	uint16_t reserved;	//Always 0
+} result_header_t;
+
+/* Result variables */
+extern char *result_path;	//Where to write results, - for stdout, or NULL if we're not writing them
+extern int result_format;	//Format to write results in
+extern int verbosity;		//How much human-readable logging to print
+
+/* Result functions */
+
+/*
+ * Opens the results sink, emptying it first. Every process that can find a
+ * match has to call this before it does. Does nothing without -results.
+ * Params: rank - the rank opening it, which gets <file>.<rank> to itself, or
+ *         -1 if this is the only process writing results.
+ * Returns: 0 if the sink was opened (or there isn't one); a nonzero value
+ *          otherwise.
+ */
+int result_init(int rank);
+
+/*
+ * Adds a match to the calling thread's buffer, writing the buffer out first
+ * if it's full. Does nothing without -results.
+ * Params: id - the rank or worker number that found the match.
+ *         filename - the file (or "<segment>:<record>") that matched.
+ *         key - the key that matched.
+ *         key_len - the length of key.
+ *         value - its value.
+ *         value_len - the length of value.
+ * Returns: nothing
+ */
+void result_match(int id, char *filename, char *key, int key_len, char *value, int value_len);
+
+/*
+ * Prints human-readable logging if the verbosity is at least some level.
+ * Params: level - the verbosity the message needs.
+ *         fmt - a printf() format string, followed by its arguments.
+ * Returns: nothing
+ */
+void result_log(int level, const char *fmt, ...);
+
+/*
+ * Appends a JSON string, quoted and escaped, to a buffer. Used for results and
+ * anything else that writes JSON with names in it.
+ * Params: out - where to append it; must have room for 6 * len + 2 bytes.
+ *         str - the string.
+ *         len - the length of str.
+ * Returns: the number of bytes appended (not null-terminated).
+ */
+size_t result_json_string(char *out, char *str, int len);
+
+/*
+ * Writes out every thread's buffer and closes the sink. Every thread that
+ * found matches has to have finished first.
+ * Params: nothing
+ * Returns: nothing
+ */
+void result_cleanup();
+
+#endif //RESULT_H_INCLUDED
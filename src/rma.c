@@ -0,0 +1,129 @@
+#include <mpi.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hier.h"
+#include "rma.h"
+#include "sched.h"
+#include "trace.h"
+#include "univ.h"
+
+/* Where a node is with the catalog */
+enum {
+	CATALOG_WAITING,	//rma_node_work() hasn't opened it yet
+	CATALOG_OPEN,		//There may be files left to claim
+	CATALOG_DONE		//Every file has been claimed
+};
+
+/* Static variables */
+static MPI_Win catalog_win = MPI_WIN_NULL;	//Window of every file, in the order they should be claimed
+static MPI_Win cursor_win = MPI_WIN_NULL;	//Window of the index of the next file to claim, then the number of files
+static long catalog_size = 0;				//Number of files in the catalog
+static int catalog_state = CATALOG_WAITING;	//Where we are with the catalog
+static pthread_mutex_t catalog_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects catalog_state
+static pthread_cond_t catalog_cond = PTHREAD_COND_INITIALIZER;		//Signaled when catalog_state changes
+
+void rma_central_work()
+{
+	trace_thread_name("dispatch");
+	int total = enqueue_all_files();	//Find every file...
+	
+	//...and lay them out in the order they should be claimed
+	chunk_entry_t *catalog = malloc(sizeof(chunk_entry_t) * (total > 0 ? total : 1));
+	
+	for(int i = 0; i < total; i++)
+		catalog_take(all_files, catalog[i].name, FILE_NAME_LEN, &(catalog[i].file_size), &(catalog[i].priority));
+	
+	//Publish them, and the cursor the nodes claim them with
+	long counters[2] = { 0, total };
+	MPI_Win_create(catalog, sizeof(chunk_entry_t) * total, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &catalog_win);
+	MPI_Win_create(counters, sizeof(counters), sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &cursor_win);
+	
+	//Every node frees the windows once it's claimed the last file, so this waits for all of them
+	MPI_Win_free(&cursor_win);
+	MPI_Win_free(&catalog_win);
+	free(catalog);
+}
+
+void rma_node_work()
+{
+	trace_thread_name("receive");
+	
+	//We don't expose anything; we only read the central machine's windows
+	MPI_Win_create(NULL, 0, 1, MPI_INFO_NULL, MPI_COMM_WORLD, &catalog_win);
+	MPI_Win_create(NULL, 0, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &cursor_win);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, catalog_win);
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, cursor_win);
+	
+	MPI_Get(&catalog_size, 1, MPI_LONG, CENTRAL, 1, 1, MPI_LONG, cursor_win);
+	MPI_Win_flush(CENTRAL, cursor_win);
+	
+	//Let the process thread start claiming, then wait for it to claim the last file
+	pthread_mutex_lock(&catalog_mutex);
+	catalog_state = CATALOG_OPEN;
+	pthread_cond_broadcast(&catalog_cond);
+	
+	while(catalog_state != CATALOG_DONE)
+		pthread_cond_wait(&catalog_cond, &catalog_mutex);
+	
+	pthread_mutex_unlock(&catalog_mutex);
+	
+	MPI_Win_unlock_all(cursor_win);
+	MPI_Win_unlock_all(catalog_win);
+	MPI_Win_free(&cursor_win);
+	MPI_Win_free(&catalog_win);
+}
+
+void rma_refill(file_queue_t *queue)
+{
+	if(!rma_enabled)
+		return;
+	
+	//Wait for the catalog to open
+	pthread_mutex_lock(&catalog_mutex);
+	
+	while(catalog_state == CATALOG_WAITING)
+		pthread_cond_wait(&catalog_cond, &catalog_mutex);
+	
+	int open = (catalog_state == CATALOG_OPEN);
+	pthread_mutex_unlock(&catalog_mutex);
+	
+	//Only claim more once we're down to half a chunk
+	if(!open || queue_size(queue) > rma_claim / 2)
+		return;
+	
+	//Claim the next chunk
+	long claim = rma_claim, first;
+	long long start = trace_now();
+	MPI_Fetch_and_op(&claim, &first, MPI_LONG, CENTRAL, 0, MPI_SUM, cursor_win);
+	MPI_Win_flush(CENTRAL, cursor_win);
+	
+	//If someone else claimed the last file, there's nothing else coming
+	if(first >= catalog_size)
+	{
+		close_queue(queue);
+		
+		pthread_mutex_lock(&catalog_mutex);
+		catalog_state = CATALOG_DONE;
+		pthread_cond_broadcast(&catalog_cond);
+		pthread_mutex_unlock(&catalog_mutex);
+		return;
+	}
+	
+	//Read what we claimed and queue it up
+	int count = (first + rma_claim <= catalog_size) ? rma_claim : (int) (catalog_size - first);
+	chunk_entry_t *chunk = malloc(sizeof(chunk_entry_t) * count);
+	MPI_Get(chunk, sizeof(chunk_entry_t) * count, MPI_BYTE, CENTRAL, sizeof(chunk_entry_t) * first,
+		sizeof(chunk_entry_t) * count, MPI_BYTE, catalog_win);
+	MPI_Win_flush(CENTRAL, catalog_win);
+	trace_span(MPI_RECV_EVENT, chunk[0].name, CENTRAL, start);
+	
+	for(int i = 0; i < count; i++)
+	{
+		enqueue(queue, chunk[i].name, chunk[i].file_size, chunk[i].priority);
+		trace_instant(RECEIVED_EVENT, chunk[i].name, CENTRAL);
+	}
+	
+	free(chunk);
+}
@@ -0,0 +1,43 @@
+#ifndef RMA_H_INCLUDED
+#define RMA_H_INCLUDED
+
+#include "container.h"
+
+/*
+ * With -rma, the central machine doesn't dispatch anything. It finds every
+ * file, then publishes them in priority order as a catalog in an MPI RMA
+ * window, next to a cursor in a second window. Nodes claim the next -claim
+ * files for themselves by adding to the cursor with MPI_Fetch_and_op and read
+ * what they claimed with MPI_Get, so the central machine is only involved in
+ * archiving. A node claims its next chunk when its queue gets down to half a
+ * chunk, so it has more to do by the time it runs out.
+ */
+
+/* RMA functions */
+
+/*
+ * Finds every file and publishes them for the nodes to claim, then waits for
+ * every node to finish claiming them. The central machine's work with -rma.
+ * Params: nothing
+ * Returns: nothing
+ */
+void rma_central_work();
+
+/*
+ * Opens the central machine's catalog for our process thread to claim files
+ * from, then waits for it to claim the last of them. A node's work with -rma.
+ * Params: nothing
+ * Returns: nothing
+ */
+void rma_node_work();
+
+/*
+ * Claims the next chunk of files into a queue if it's running low, or closes
+ * the queue if every file has been claimed. Waits for rma_node_work() to open
+ * the catalog first. Does nothing without -rma.
+ * Params: queue - the queue to claim files into.
+ * Returns: nothing
+ */
+void rma_refill(file_queue_t *queue);
+
+#endif //RMA_H_INCLUDED
@@ -0,0 +1,983 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#endif
+
+#include "compress.h"
+#include "sched.h"
+#include "result.h"
+#include "segment.h"
+#include "sla.h"
+#include "timing.h"
+#include "trace.h"
+#include "univ.h"
+#include "walk.h"
+
+#define MAX_ARCHIVE_WRITERS 64	//Archive segments we keep open at once
+#define MAX_SOURCE_SEGMENTS 64	//Segments we keep open to take records out of, unless they're waiting on an archive segment
+#define MAX_ARCHIVE_NAMES 1000	//Names we try for a file in the archive before giving up on archiving it
+#define RATE_WEIGHT 0.2			//Weight of the newest file in a node's average speed
+
+/* Defines a segment that move_record() is taking records out of */
+typedef struct _source_seg_t {
+	char path[FILE_NAME_LEN];			//Full path to the segment
+	segment_t seg;						//The segment, mapped for reading
+	int fd;								//Descriptor for marking its records as archived
+	int live;							//Records in it that haven't been marked as archived
+	int waiting;						//Records copied out of it into archive segments that aren't finished yet
+	struct _source_seg_t *next;			//Next most recently used segment
+} source_seg_t;
+
+/* Defines a record copied into an archive segment, waiting for it to be finished */
+typedef struct _copied_record_t {
+	source_seg_t *source;				//Segment the record came from
+	uint32_t index;						//Index of the record there
+} copied_record_t;
+
+/* Defines an archive segment that move_record() is writing */
+typedef struct _archive_writer_t {
+	char path[FILE_NAME_LEN];			//Full path the archive segment is meant to have
+	char temp_path[FILE_NAME_LEN];		//Full path it's written to until it's finished
+	seg_writer_t *writer;				//The segment's writer
+	copied_record_t *copied;			//Where each of its records came from
+	uint32_t copied_cap;				//Number of entries allocated in copied
+	struct _archive_writer_t *next;		//Next most recently used archive segment
+} archive_writer_t;
+
+/* Static function prototypes */
+
+/*
+ * Helper function to find the next best processor if we're using cyclic
+ * distribution.
+ * Params: file_size - the size of the file.
+ * Returns: the rank of the next best processor to send to according to cyclic
+ *          distribution.
+ */
+static int get_best_proc_cyclic(int file_size);
+
+/*
+ * Helper function to find the next best processor if we're using block
+ * distribution.
+ * Params: file_size - the size of the file.
+ * Returns: the rank of the next best processor to send to according to block
+ *          distribution.
+ */
+static int get_best_proc_block(int file_size);
+
+/*
+ * Helper function to find the next best processor if we're using random
+ * distribution. Inline because it's just a one-liner.
+ * Params: file_size - the size of the file.
+ * Returns: the rank of the next best processor to send to according to
+ *          random distribution.
+ */
+static inline int get_best_proc_random(int file_size);
+
+/*
+ * Helper function to find the next best processor if we're using a scheduling
+ * method that requires node data.
+ * Params: file_size - the size of the file.
+ * Returns: the rank of the next best processor to send to according to the
+ *          scheduling method we're using that requires queue data.
+ */
+static int get_best_proc_queue_data(int file_size);
+
+/*
+ * Helper function to find the next best processor if we're using -edf: the
+ * node expected to finish the file soonest, going by the work it has left and
+ * how fast it's been working. That's the node most likely to meet the file's
+ * deadline, or the one that misses it by the least.
+ * Params: file_size - the size of the file.
+ * Returns: the rank of the node expected to finish the file soonest.
+ */
+static int get_best_proc_deadline(int file_size);
+
+/*
+ * Picks the best node to send the next file to with whichever scheduling
+ * algorithm or priority option we're using. With credits, dispatch_mutex has
+ * to be held.
+ * Params: file_size - the size of the file.
+ * Returns: the best node, in [1, target_count].
+ */
+static int pick_proc(int file_size);
+
+/*
+ * Checks if a node has enough credits left for a file. A node with nothing
+ * outstanding can always take a file, however big it is. dispatch_mutex has
+ * to be held.
+ * Params: target - the node, in [1, target_count].
+ *         file_size - the size of the file.
+ * Returns: 1 if it has enough; 0 otherwise.
+ */
+static int has_credit(int target, int file_size);
+
+/*
+ * Finds the first node with enough credits for a file, starting from the one
+ * the scheduling algorithm picked and going around in order.
+ * Params: target - the node the scheduling algorithm picked.
+ *         file_size - the size of the file.
+ * Returns: the first node with enough credits, or target if none do.
+ */
+static int next_with_credit(int target, int file_size);
+
+/*
+ * The function the scan thread should run. Finds every file, then closes
+ * all_files.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time.
+ */
+static void* scan_thread_func(void *nothing);
+
+/*
+ * Gets the writer for an archive segment, starting it if it isn't already.
+ * The least recently used segment is finished if too many are open.
+ * Params: path - the full path the archive segment is meant to have.
+ * Returns: the archive segment, or NULL if it couldn't be started.
+ */
+static archive_writer_t* get_archive_writer(char *path);
+
+/*
+ * Finishes an archive segment: writes it out, moves it into the archive under
+ * a name nothing else has, and only then marks the records copied into it as
+ * archived in the segments they came from, deleting any segment with nothing
+ * left in it. Until then those records are still live where they were, so if
+ * we never get this far, they're archived again next time instead of lost.
+ * Frees the archive segment.
+ * Params: archive - the archive segment.
+ * Returns: nothing
+ */
+static void finish_writer(archive_writer_t *archive);
+
+/*
+ * Gets a segment move_record() is taking records out of, opening it if it
+ * isn't already. The least recently used segments are closed if too many are
+ * open, unless they have records waiting on an archive segment.
+ * Params: path - the full path to the segment.
+ * Returns: the segment, or NULL if it couldn't be opened.
+ */
+static source_seg_t* get_source(char *path);
+
+/*
+ * Closes a segment opened by get_source() and frees it.
+ * Params: source - the segment.
+ * Returns: nothing
+ */
+static void close_source(source_seg_t *source);
+
+/*
+ * Moves a file into the archive without ever replacing anything already
+ * there: if its name is taken, it gets the first name from unique_path() that
+ * isn't. Makes any directories it needs in the archive.
+ * Params: from - the full path to the file.
+ *         path - the full path the file is meant to have in the archive.
+ *         moved_to - a FILE_NAME_LEN buffer that will contain the full path
+ *         the file ended up at on return.
+ * Returns: 0 if the file was moved; a nonzero value otherwise.
+ */
+static int move_into_archive(char *from, char *path, char *moved_to);
+
+/*
+ * Works out where a file goes in the archive: the same place relative to the
+ * archive directory as it was relative to its root, under root<n>/ for every
+ * root but the file directory, so files from different roots and
+ * subdirectories never share a name.
+ * Params: filepath - the full path to the file.
+ *         new_path - a FILE_NAME_LEN buffer that will contain the full path
+ *         in the archive on return.
+ * Returns: 0 if the path fits in new_path; a nonzero value otherwise.
+ */
+static int archive_path(char *filepath, char *new_path);
+
+/*
+ * Makes a name for a file in the archive that's different from its own, by
+ * adding -<n> before its extensions.
+ * Params: path - the full path the file would have had in the archive.
+ *         n - which name to make, from 1.
+ *         unique - a FILE_NAME_LEN buffer that will contain the new path on
+ *         return.
+ * Returns: 0 if the path fits in unique; a nonzero value otherwise.
+ */
+static int unique_path(char *path, int n, char *unique);
+
+/*
+ * Moves a file without ever replacing whatever's already at the destination.
+ * Params: from - the full path to the file.
+ *         to - the full path to move it to.
+ * Returns: 0 if the file was moved; a nonzero value otherwise, with errno set
+ *          (EEXIST if something's already at the destination).
+ */
+static int move_no_replace(char *from, char *to);
+
+/*
+ * Makes every directory a path in the archive needs that isn't there yet.
+ * Params: path - the full path to a file in the archive.
+ * Returns: nothing
+ */
+static void make_parent_dirs(char *path);
+
+/*
+ * Adds a file the walk found to all_files, if it's one we can process. A
+ * walk_func_t for walk().
+ * Params: root - the index of the root the file is under.
+ *         path - the file's directory, relative to the root.
+ *         name - the file's name.
+ *         dir_fd - a descriptor for the file's directory.
+ * Returns: nothing
+ */
+static void add_found_file(int root, char *path, char *name, int dir_fd);
+
+/*
+ * Works out where a file is on disk for layout_order, so reading files in
+ * that order is mostly sequential.
+ * Params: dir_fd - a descriptor for the file's directory.
+ *         name - the file's name.
+ *         inode - the file's inode number.
+ * Returns: the file's location, or 0 without a layout option.
+ */
+static long long file_location(int dir_fd, char *name, long long inode);
+
+/* sched.h extern variables */
+int *node_stats;
+int target_count;
+file_catalog_t *all_files;
+int file_count;
+int files_per_proc = 1;
+int credit_files = 0;
+long long credit_bytes = 0;
+int layout_order = LAYOUT_NONE;
+int files_scanned = 0;
+long long files_dispatched = 0;
+long long files_archived = 0;
+
+/* Static variables */
+static archive_writer_t *archive_writers = NULL;	//Open archive segments, most recently used first
+static source_seg_t *source_segs = NULL;			//Open segments records are being archived from, most recently used first
+static long long *outstanding = NULL;				//Bytes each node has been sent but hasn't finished, indexed like targets
+static int *in_flight = NULL;						//Files each node has been sent but hasn't finished
+static double *ns_per_byte = NULL;					//Each node's average time per byte, or 0 if it hasn't finished anything
+static pthread_mutex_t dispatch_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects outstanding, in_flight and ns_per_byte
+static pthread_cond_t credit_cond = PTHREAD_COND_INITIALIZER;		//Signaled when a node gets credits back
+static pthread_t scan_thread;						//Thread running enqueue_all_files() for start_scan()
+static int scan_threaded = 0;						//1 if scan_thread was started; 0 otherwise
+static int scan_found = 0;							//Number of files the walk has added so far
+static long long scan_time = 0;						//When the scan started, which deadline priorities are relative to
+
+int enqueue_all_files()
+{
+	scan_found = 0;
+	scan_time = time(NULL);
+	walk(add_found_file);	//Every walker adds the files it finds as it finds them
+	int found = scan_found;	//Number of files we found (the dispatcher may be taking them out already)
+    
+    //Nothing's been taken out yet if there's a priority or layout option, so put the best files first
+    if(priority_option != NO_PRIORITY || layout_order != LAYOUT_NONE)
+    	catalog_sort(all_files);
+    
+    return (file_count = found);	//Set file count while returning it
+}
+
+void start_scan()
+{
+	//Picking by priority or layout needs every file, and so does sizing blocks evenly, so find them all first
+	if(priority_option != NO_PRIORITY || layout_order != LAYOUT_NONE || sched_type == BLOCK)
+	{
+		set_files_per_proc(enqueue_all_files());
+		close_catalog(all_files);
+		return;
+	}
+	
+	scan_threaded = 1;
+	pthread_create(&scan_thread, NULL, scan_thread_func, NULL);
+}
+
+void finish_scan()
+{
+	if(scan_threaded)
+		pthread_join(scan_thread, NULL);
+	
+	scan_threaded = 0;
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* scan_thread_func(void *nothing)
+{
+	//We don't actually use the parameter for anything
+	trace_thread_name("scan");
+	enqueue_all_files();
+	close_catalog(all_files);	//Tell the dispatcher there's nothing else coming
+	return NULL;	//We actually don't return anything useful
+}
+
+void move_file(char *filepath)
+{
+	//Get the full new path to the file
+	char new_path[FILE_NAME_LEN], moved_to[FILE_NAME_LEN];
+	
+	if(archive_path(filepath, new_path))
+	{
+		fprintf(stderr, "Couldn't archive %s: its archive path is longer than %d characters\n", filepath, FILE_NAME_LEN - 1);
+		return;
+	}
+	
+	result_log(VERBOSE_FILES, "Moving from %s to %s\n", filepath, new_path);
+	
+	if(move_into_archive(filepath, new_path, moved_to))
+	{
+		fprintf(stderr, "Couldn't archive %s, so it's staying where it is\n", filepath);
+		return;
+	}
+	
+	if(strcmp(moved_to, new_path))
+		result_log(VERBOSE_FILES, "%s was taken, so %s went to %s\n", new_path, filepath, moved_to);
+	
+	files_archived++;
+}
+
+void move_record(char *segpath, int index)
+{
+	//Get the full path to the archive segment
+	char new_path[FILE_NAME_LEN];
+	
+	if(archive_path(segpath, new_path))
+	{
+		fprintf(stderr, "Couldn't archive record %d of %s: its archive path is longer than %d characters\n", index, segpath, FILE_NAME_LEN - 1);
+		return;
+	}
+	
+	//Find the record, unless it's gone or already archived
+	source_seg_t *source = get_source(segpath);
+	
+	if(source == NULL || (uint32_t) index >= source->seg.count || (source->seg.index[index].flags & SEG_ARCHIVED))
+		return;
+	
+	seg_entry_t *entry = &(source->seg.index[index]);
+	result_log(VERBOSE_FILES, "Moving record %d (%.*s) from %s to %s\n", index, SEG_NAME_LEN, entry->name, segpath, new_path);
+	
+	//Copy it into the archive segment; it's only marked as archived here once that's finished
+	archive_writer_t *archive = get_archive_writer(new_path);
+	
+	if(archive == NULL || segment_writer_add(archive->writer, entry->name, source->seg.data + entry->offset, entry->length))
+	{
+		fprintf(stderr, "Couldn't archive record %d of %s, so it's staying where it is\n", index, segpath);
+		return;
+	}
+	
+	if(archive->writer->count > archive->copied_cap)
+	{
+		archive->copied_cap *= 2;
+		archive->copied = realloc(archive->copied, sizeof(copied_record_t) * archive->copied_cap);
+	}
+	
+	archive->copied[archive->writer->count - 1].source = source;
+	archive->copied[archive->writer->count - 1].index = index;
+	source->waiting++;
+}
+
+void finish_archive()
+{
+	//Finish the archive segments first, so every record that made it into one is marked as archived
+	while(archive_writers != NULL)
+	{
+		archive_writer_t *next = archive_writers->next;
+		finish_writer(archive_writers);
+		archive_writers = next;
+	}
+	
+	while(source_segs != NULL)
+	{
+		source_seg_t *next = source_segs->next;
+		close_source(source_segs);
+		source_segs = next;
+	}
+}
+
+int file_name_valid(char *filename)
+{
+	//If the filename is a directory, it's definitely not valid
+	if(filename[0] == '.')
+		return 0;
+	
+	//Check if filename ends with ".sen" or is a segment or compressed .sen file
+	return !strcmp((filename + strlen(filename) - 4), ".sen") || segment_name_valid(filename) || compressed_name_valid(filename);
+}
+
+void set_files_per_proc(int total_files)
+{
+	files_per_proc = (target_count > 0) ? total_files / target_count : 1;	//Get the number of files per node for block scheduling
+	
+	//Adjust so we don't accidentally leave any nodes out
+	if(target_count > 0 && total_files % target_count != 0)
+		files_per_proc--;
+}
+
+int get_best_proc(int file_size)
+{
+	//Without anything to keep track of, the scheduling algorithm decides on its own
+	if(outstanding == NULL)
+		return pick_proc(file_size);
+	
+	pthread_mutex_lock(&dispatch_mutex);
+	
+	//Wait until some node has room for the file
+	for(;;)
+	{
+		int room = 0;
+		
+		for(int i = 1; i <= target_count && !room; i++)
+			room = has_credit(i, file_size);
+		
+		if(room)
+			break;
+		
+		pthread_cond_wait(&credit_cond, &dispatch_mutex);
+	}
+	
+	int best = pick_proc(file_size);
+	outstanding[best] += file_size;	//It has this much more work now
+	in_flight[best]++;
+	pthread_mutex_unlock(&dispatch_mutex);
+	return best;
+}
+
+int reports_done()
+{
+	return priority_option == DEADLINE_PRIORITY || credit_files > 0 || credit_bytes > 0;
+}
+
+static int pick_proc(int file_size)
+{
+	//Scheduling by deadline overrides the scheduling algorithm
+	if(priority_option == DEADLINE_PRIORITY)
+		return get_best_proc_deadline(file_size);
+	
+	//Depending on the scheduling type, return the value a helper function returns
+	switch(sched_type)
+	{
+		case CYCLIC:
+			return get_best_proc_cyclic(file_size);
+		case BLOCK:
+			return get_best_proc_block(file_size);
+		case RANDOM:
+			return get_best_proc_random(file_size);
+		case QUEUE_SIZE:
+			return get_best_proc_queue_data(file_size);
+		case QUEUE_LENGTH:
+			return get_best_proc_queue_data(file_size);
+		default:
+			return -1;	//Something went really wrong
+	}
+}
+
+static int get_best_proc_cyclic(int file_size)
+{
+	static int proc_counter = 0;	//Keep track of which processor we last left off at
+	
+	int retval = next_with_credit((proc_counter % target_count) + 1, file_size);	//Get the processor we left off at, or the next one with room
+	proc_counter = retval;	//So next time, we get the next cyclic processor
+	return retval;
+}
+
+static int get_best_proc_block(int file_size)
+{
+	static int proc_counter = 0;	//Keep track of which processor we last left off at
+	static int block_counter = 0;	//Keep track of how many files we've sent to it so far
+	
+	int retval = (proc_counter % target_count) + 1;	//Get the processor we left off at
+	
+	//If it's out of credits, lend this file to the next one with room; the block carries on when it has room again
+	if(!has_credit(retval, file_size))
+		return next_with_credit(retval, file_size);
+	
+	block_counter++;	//Increment the number of files we've sent to it by 1
+	
+	//If it's greater than the number of files it should be getting, increment so we get the next processor next time
+	if(block_counter >= files_per_proc)
+	{
+		proc_counter++;
+		block_counter = 0;
+	}
+	
+	return retval;
+}
+
+static inline int get_best_proc_random(int file_size)
+{
+	return next_with_credit((rand() % target_count) + 1, file_size);	//Just get a random processor between [1, # of nodes] with room
+}
+
+static int get_best_proc_queue_data(int file_size)
+{
+	//Find the node with minimum "x", where x is some metric, out of the ones with room
+	int min = next_with_credit(1, file_size);
+	
+	for(int i = 1; i <= target_count; i++)
+		if(node_stats[i] < node_stats[min] && has_credit(i, file_size))
+			min = i;
+	
+	return min;
+}
+
+static int get_best_proc_deadline(int file_size)
+{
+	//Nodes that haven't finished anything yet are assumed to be as fast as the average node
+	double known_sum = 0;
+	int known = 0;
+	
+	for(int i = 1; i <= target_count; i++)
+	{
+		if(ns_per_byte[i] > 0)
+		{
+			known_sum += ns_per_byte[i];
+			known++;
+		}
+	}
+	
+	double default_rate = (known > 0) ? known_sum / known : 1;
+	
+	//Find the node with room that would finish this file soonest if it were sent there
+	int best = 0;
+	double best_finish = 0;
+	
+	for(int i = 1; i <= target_count; i++)
+	{
+		double rate = (ns_per_byte[i] > 0) ? ns_per_byte[i] : default_rate;
+		double finish = (outstanding[i] + file_size) * rate;
+		
+		if(has_credit(i, file_size) && (best == 0 || finish < best_finish))
+		{
+			best = i;
+			best_finish = finish;
+		}
+	}
+	
+	return (best > 0) ? best : 1;
+}
+
+static int has_credit(int target, int file_size)
+{
+	if(outstanding == NULL || in_flight[target] == 0)
+		return 1;
+	
+	if(credit_files > 0 && in_flight[target] >= credit_files)
+		return 0;
+	
+	return credit_bytes <= 0 || outstanding[target] + file_size <= credit_bytes;
+}
+
+static int next_with_credit(int target, int file_size)
+{
+	for(int i = 0; i < target_count; i++)
+	{
+		int next = ((target - 1 + i) % target_count) + 1;
+		
+		if(has_credit(next, file_size))
+			return next;
+	}
+	
+	return target;
+}
+
+void init_estimates()
+{
+	outstanding = calloc(target_count + 1, sizeof(long long));
+	in_flight = calloc(target_count + 1, sizeof(int));
+	ns_per_byte = calloc(target_count + 1, sizeof(double));
+}
+
+void sched_file_done(int target, int file_size, long long busy_ns)
+{
+	if(outstanding == NULL || target < 1 || target > target_count)
+		return;
+	
+	pthread_mutex_lock(&dispatch_mutex);
+	outstanding[target] -= file_size;
+	in_flight[target]--;
+	
+	//Fold this file's speed into the node's average, if it finished it
+	if(busy_ns >= 0)
+	{
+		double rate = (double) busy_ns / ((file_size > 0) ? file_size : 1);
+		ns_per_byte[target] = (ns_per_byte[target] > 0) ? (1 - RATE_WEIGHT) * ns_per_byte[target] + RATE_WEIGHT * rate : rate;
+	}
+	
+	pthread_cond_broadcast(&credit_cond);	//Its credits are back, so the dispatcher may be able to send again
+	pthread_mutex_unlock(&dispatch_mutex);
+}
+
+void free_estimates()
+{
+	free(outstanding);
+	free(in_flight);
+	free(ns_per_byte);
+	outstanding = NULL;
+	in_flight = NULL;
+	ns_per_byte = NULL;
+}
+
+static archive_writer_t* get_archive_writer(char *path)
+{
+	archive_writer_t **link = &archive_writers;
+	int open_count = 0;
+	
+	//Look for it, moving it to the front if we find it
+	while(*link != NULL)
+	{
+		archive_writer_t *cur = *link;
+		
+		if(!strcmp(cur->path, path))
+		{
+			*link = cur->next;
+			cur->next = archive_writers;
+			archive_writers = cur;
+			return cur;
+		}
+		
+		open_count++;
+		link = &(cur->next);
+	}
+	
+	//If we have too many open, finish the least recently used one to make room
+	if(open_count >= MAX_ARCHIVE_WRITERS)
+	{
+		archive_writer_t **last = &archive_writers;
+		
+		while((*last)->next != NULL)
+			last = &((*last)->next);
+		
+		finish_writer(*last);
+		*last = NULL;
+	}
+	
+	//Otherwise, start it next to where it's going, under a name of its own (the process ID keeps -hier leaders apart)
+	archive_writer_t *add = malloc(sizeof(archive_writer_t));
+	strcpy(add->path, path);
+	
+	if(snprintf(add->temp_path, FILE_NAME_LEN, "%s.%d.tmp", path, (int) getpid()) >= FILE_NAME_LEN)
+	{
+		free(add);
+		return NULL;
+	}
+	
+	make_parent_dirs(add->temp_path);
+	unlink(add->temp_path);	//Anything there is from a run of ours that never finished it
+	add->writer = segment_writer_open(add->temp_path);
+	
+	if(add->writer == NULL)
+	{
+		free(add);
+		return NULL;
+	}
+	
+	add->copied_cap = 64;
+	add->copied = malloc(sizeof(copied_record_t) * add->copied_cap);
+	add->next = archive_writers;
+	archive_writers = add;
+	return add;
+}
+
+static void finish_writer(archive_writer_t *archive)
+{
+	char moved_to[FILE_NAME_LEN];
+	uint32_t count = archive->writer->count;
+	int finished = !segment_writer_close(archive->writer) && !move_into_archive(archive->temp_path, archive->path, moved_to);
+	
+	if(finished)
+	{
+		if(strcmp(moved_to, archive->path))
+			result_log(VERBOSE_FILES, "%s was taken, so its records went to %s\n", archive->path, moved_to);
+		
+		//Its name has to be on disk too before the records can go anywhere else
+		char *slash = strrchr(moved_to, (int) '/');
+		*slash = '\0';
+		int dir_fd = open(moved_to, O_RDONLY | O_DIRECTORY);
+		*slash = '/';
+		
+		if(dir_fd >= 0)
+		{
+			fsync(dir_fd);
+			close(dir_fd);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Couldn't write archive segment %s, so the %u records meant for it are staying where they are\n", archive->path, count);
+		unlink(archive->temp_path);
+	}
+	
+	for(uint32_t i = 0; i < count; i++)
+	{
+		copied_record_t *record = &(archive->copied[i]);
+		source_seg_t *source = record->source;
+		source->waiting--;
+		
+		if(!finished)
+			continue;
+		
+		if(segment_tombstone(source->fd, &(source->seg), record->index))
+		{
+			fprintf(stderr, "Couldn't mark record %u of %s as archived, so it'll be archived again\n", record->index, source->path);
+			continue;
+		}
+		
+		files_archived++;
+		
+		//If that was the last record left, every record has made it into the archive, so the original isn't needed anymore
+		if(--(source->live) == 0)
+			unlink(source->path);
+	}
+	
+	free(archive->copied);
+	free(archive);
+}
+
+static source_seg_t* get_source(char *path)
+{
+	source_seg_t **link = &source_segs;
+	int open_count = 0;
+	
+	//Look for it, moving it to the front if we find it
+	while(*link != NULL)
+	{
+		source_seg_t *cur = *link;
+		
+		if(!strcmp(cur->path, path))
+		{
+			*link = cur->next;
+			cur->next = source_segs;
+			source_segs = cur;
+			return cur;
+		}
+		
+		open_count++;
+		link = &(cur->next);
+	}
+	
+	//If we have too many open, close the least recently used ones nothing's waiting on
+	for(link = &source_segs; open_count >= MAX_SOURCE_SEGMENTS && *link != NULL; )
+	{
+		source_seg_t *cur = *link;
+		
+		if(cur->waiting > 0)
+		{
+			link = &(cur->next);
+			continue;
+		}
+		
+		*link = cur->next;
+		close_source(cur);
+		open_count--;
+	}
+	
+	//Otherwise, open it, counting what's left in it once so we know when it's empty
+	source_seg_t *add = malloc(sizeof(source_seg_t));
+	strcpy(add->path, path);
+	add->fd = open(path, O_WRONLY);
+	
+	if(add->fd < 0 || segment_open(&(add->seg), path))
+	{
+		if(add->fd >= 0)
+			close(add->fd);
+		
+		free(add);
+		return NULL;
+	}
+	
+	add->live = 0;
+	add->waiting = 0;
+	
+	for(uint32_t i = 0; i < add->seg.count; i++)
+		if(!(add->seg.index[i].flags & SEG_ARCHIVED))
+			add->live++;
+	
+	add->next = source_segs;
+	source_segs = add;
+	return add;
+}
+
+static void close_source(source_seg_t *source)
+{
+	segment_close(&(source->seg));
+	close(source->fd);
+	free(source);
+}
+
+static int archive_path(char *filepath, char *new_path)
+{
+	//Find the root it's under (the longest one, in case one root is inside another)
+	int root = -1;
+	size_t root_len = 0;
+	
+	for(int i = 0; i < walk_root_count; i++)
+	{
+		size_t len = strlen(walk_roots[i]);
+		
+		if(len > root_len && !strncmp(filepath, walk_roots[i], len))
+		{
+			root = i;
+			root_len = len;
+		}
+	}
+	
+	int len;
+	
+	if(root > 0)
+		len = snprintf(new_path, FILE_NAME_LEN, "%sroot%d/%s", archive_dir_str, root, filepath + root_len);
+	else if(root == 0)
+		len = snprintf(new_path, FILE_NAME_LEN, "%s%s", archive_dir_str, filepath + root_len);
+	else
+		len = snprintf(new_path, FILE_NAME_LEN, "%s%s", archive_dir_str, strrchr(filepath, (int) '/') + 1);	//Not under any root, so just keep its name
+	
+	return len >= FILE_NAME_LEN;
+}
+
+static int unique_path(char *path, int n, char *unique)
+{
+	//Every extension stays on the end, so it's still the same kind of file (e.g. x.sen.gz becomes x-1.sen.gz)
+	char *file_name = strrchr(path, (int) '/') + 1;
+	char *extension = strchr(file_name, (int) '.');
+	
+	if(extension == NULL)
+		extension = file_name + strlen(file_name);
+	
+	return snprintf(unique, FILE_NAME_LEN, "%.*s-%d%s", (int) (extension - path), path, n, extension) >= FILE_NAME_LEN;
+}
+
+static int move_no_replace(char *from, char *to)
+{
+#ifdef RENAME_NOREPLACE
+	//Let the filesystem refuse to replace anything, if it knows how
+	int retval = renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_NOREPLACE);
+	
+	if(!retval || (errno != EINVAL && errno != ENOSYS))
+		return retval;
+#endif
+	
+	//Otherwise, link it in, which never replaces anything either, then remove the original
+	if(link(from, to))
+		return -1;
+	
+	unlink(from);
+	return 0;
+}
+
+static int move_into_archive(char *from, char *path, char *moved_to)
+{
+	strcpy(moved_to, path);
+	
+	//If its name is taken, find one that isn't
+	for(int n = 1; n <= MAX_ARCHIVE_NAMES; n++)
+	{
+		int retval = move_no_replace(from, moved_to);
+		
+		//If its directory isn't in the archive yet, make it and try again
+		if(retval && errno == ENOENT)
+		{
+			make_parent_dirs(moved_to);
+			retval = move_no_replace(from, moved_to);
+		}
+		
+		if(!retval)
+			return 0;
+		
+		if(errno != EEXIST || unique_path(path, n, moved_to))
+			break;
+	}
+	
+	return 1;
+}
+
+static void make_parent_dirs(char *path)
+{
+	//The archive directory itself is already there
+	for(char *slash = strchr(path + strlen(archive_dir_str), (int) '/'); slash != NULL; slash = strchr(slash + 1, (int) '/'))
+	{
+		*slash = '\0';
+		mkdir(path, 0755);
+		*slash = '/';
+	}
+}
+
+static void add_found_file(int root, char *path, char *name, int dir_fd)
+{
+	//If the name isn't valid, there's nothing to do with it
+	if(!file_name_valid(name))
+		return;
+	
+	long long start = timing_start();
+	
+	//Get the full path to the file, which has to fit in a message
+	char filename[FILE_NAME_LEN];
+	
+	if(snprintf(filename, FILE_NAME_LEN, "%s%s%s", walk_roots[root], path, name) >= FILE_NAME_LEN)
+	{
+		fprintf(stderr, "Skipping %s%s%s: its path is longer than %d characters\n", walk_roots[root], path, name, FILE_NAME_LEN - 1);
+		return;
+	}
+	
+	//Get the size of the file (it may have been archived by a previous run's straggler, or be something else with a .sen name)
+	struct stat st;
+	
+	if(fstatat(dir_fd, name, &st, 0) || !S_ISREG(st.st_mode))
+		return;
+	
+	int file_size = st.st_size;
+	long long location = file_location(dir_fd, name, st.st_ino);
+	
+	//Set the file priority (1 unless we specified a priority option)
+	int priority = 1;
+	
+	if(priority_option == OLDEST_FILE_PRIORITY)
+	{
+		char *priority_string = strchr(name, (int) '_') + 1;
+		priority = -atoi(priority_string);
+	}
+	else if(priority_option == DEADLINE_PRIORITY)
+		priority = (int) -(file_deadline(name) - scan_time);	//Earliest deadline first (relative to now, so it fits past 2038)
+	
+	catalog_add(all_files, root, filename + strlen(walk_roots[root]), file_size, priority, location);	//Add the file
+	__atomic_add_fetch(&scan_found, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&files_scanned, 1, __ATOMIC_RELAXED);
+	trace_instant(SCANNED_EVENT, filename, -1);
+	timing_stop(SCAN_PHASE, start);
+}
+
+static long long file_location(int dir_fd, char *name, long long inode)
+{
+	if(layout_order == LAYOUT_NONE)
+		return 0;
+	
+#ifdef FS_IOC_FIEMAP
+	if(layout_order == LAYOUT_EXTENT)
+	{
+		//Ask for the file's first extent; files with none (empty, inline or not written out yet) fall back to their inode
+		long long buf[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(long long) + 1];	//long long keeps it aligned
+		struct fiemap *map = (struct fiemap*) buf;
+		memset(buf, 0, sizeof(buf));
+		map->fm_length = ~0ULL;
+		map->fm_extent_count = 1;
+		
+		int fd = openat(dir_fd, name, O_RDONLY);
+		int mapped = fd >= 0 && ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0
+			&& !(map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN);
+		
+		if(fd >= 0)
+			close(fd);
+		
+		if(mapped)
+			return (long long) map->fm_extents[0].fe_physical;
+	}
+#endif
+	
+	return inode;
+}
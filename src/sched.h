@@ -0,0 +1,150 @@
+#ifndef SCHED_H_INCLUDED
+#define SCHED_H_INCLUDED
+
+#include "container.h"
+
+/* How files with the same priority are ordered */
+enum {
+	LAYOUT_NONE,	//In the order they're found
+	LAYOUT_INODE,	//By inode number
+	LAYOUT_EXTENT	//By where their first extent is on disk (FIEMAP), or by inode number if that can't be found
+};
+
+/* Scheduling variables (shared by every build that dispatches files) */
+extern int *node_stats;				//Array of node stats for certain scheduling algorithms, indexed like targets
+extern int target_count;			//Number of nodes files are dispatched to; get_best_proc() picks from [1, target_count]
+
+extern file_catalog_t *all_files;	//Catalog of all files we found
+extern int file_count;				//Number of files we found
+extern int files_per_proc;			//Number of files each processor should get for block scheduling
+extern int credit_files;			//Files a node can have been sent but not finished, or 0 for no limit
+extern long long credit_bytes;		//Bytes a node can have been sent but not finished, or 0 for no limit
+extern int layout_order;			//How files with the same priority are ordered
+extern int files_scanned;			//Number of files found so far
+extern long long files_dispatched;	//Number of files sent to nodes so far
+extern long long files_archived;	//Number of files (or records) this machine has archived so far
+
+/* Scheduling functions */
+
+/*
+ * Walks every input root (see walk.h) and adds every file found to
+ * all_files, sorting it by priority and layout afterwards if there's a
+ * priority or layout option.
+ * Params: nothing
+ * Returns: the number of files added to the catalog.
+ */
+int enqueue_all_files();
+
+/*
+ * Starts enqueue_all_files() on a thread of its own, so files can be
+ * dispatched while the directory is still being read. all_files is closed once
+ * every file has been found, so catalog_take_wait() on it returns 0 when
+ * there's nothing left to dispatch. With a priority or layout option, the
+ * best file can't be picked until every file has been found, and with block
+ * scheduling, blocks can't be sized until then either, so the scan finishes
+ * before this returns.
+ * Params: nothing
+ * Returns: nothing
+ */
+void start_scan();
+
+/*
+ * Waits for the thread start_scan() started to finish.
+ * Params: nothing
+ * Returns: nothing
+ */
+void finish_scan();
+
+/*
+ * Moves a file from its root to the same place under the archive directory
+ * (under root<n>/ for every root but the file directory). Nothing already in
+ * the archive is ever replaced: if the name is taken, the file gets -<n> added
+ * before its extensions.
+ * Params: filepath - the full path to the file.
+ * Returns: nothing
+ */
+void move_file(char *filepath);
+
+/*
+ * Moves a single record of a segment to the archive directory. The record is
+ * copied into a new segment that goes in the same place there as move_file()
+ * would put the segment, and is only marked as archived in the original
+ * segment once that new segment is finished and on disk. The original is
+ * deleted once all of its records are archived.
+ * Params: segpath - the full path to the segment.
+ *         index - the index of the record in the segment.
+ * Returns: nothing
+ */
+void move_record(char *segpath, int index);
+
+/*
+ * Finishes every archive segment move_record() has been writing, marking
+ * their records as archived.
+ * Params: nothing
+ * Returns: nothing
+ */
+void finish_archive();
+
+/*
+ * Checks if a file name is valid. A file name is considered valid if it does
+ * not begin with "." and ends with ".sen" or ".seg".
+ * Params: filename - the full path to the file.
+ * Returns: 1 if the file name is valid; 0 otherwise.
+ */
+int file_name_valid(char *filename);
+
+/*
+ * Sets the number of files each node should get for block scheduling.
+ * Params: total_files - the total number of files that will be dispatched.
+ * Returns: nothing
+ */
+void set_files_per_proc(int total_files);
+
+/*
+ * Returns the best node to send the next file to. With -credits or
+ * -creditbytes, only nodes with room for the file in their queue are picked,
+ * and this blocks until one has room; the file counts against that node's
+ * credits until sched_file_done() is called for it.
+ * Params: file_size - the size of the file.
+ * Returns: the best node to send the next file to, in [1, target_count]. When
+ *          dispatching to every node, this is the node's rank.
+ */
+int get_best_proc(int file_size);
+
+/*
+ * Checks if nodes have to tell the dispatcher when they finish each file,
+ * which they do for -edf and for credit-based flow control.
+ * Params: nothing
+ * Returns: 1 if they do; 0 otherwise.
+ */
+int reports_done();
+
+/*
+ * Initializes the estimates of how much work each node has left and how soon
+ * it can finish a file, which -edf and the credits dispatch by. Call once
+ * target_count is set, if reports_done().
+ * Params: nothing
+ * Returns: nothing
+ */
+void init_estimates();
+
+/*
+ * Tells the dispatcher a node finished a file, so it knows the node has less
+ * work left and how fast it's going, and gives the node its credits for the
+ * file back. Can be called from any thread.
+ * Params: target - the node, in [1, target_count].
+ *         file_size - the size of the file.
+ *         busy_ns - how long the node took to process it, or -1 if it never
+ *         finished it (it was cancelled), so it says nothing about its speed.
+ * Returns: nothing
+ */
+void sched_file_done(int target, int file_size, long long busy_ns);
+
+/*
+ * Frees the estimates init_estimates() initialized.
+ * Params: nothing
+ * Returns: nothing
+ */
+void free_estimates();
+
+#endif //SCHED_H_INCLUDED
@@ -0,0 +1,175 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "segment.h"
+
+/* Static function prototypes */
+
+/*
+ * Reads a segment's footer from an open file and checks it.
+ * Params: fd - the segment's file descriptor.
+ *         size - the size of the segment.
+ *         footer - a single seg_footer_t buffer that will contain the footer
+ *         on return.
+ * Returns: 0 if the footer is valid; a nonzero value otherwise.
+ */
+static int read_footer(int fd, uint64_t size, seg_footer_t *footer);
+
+/*
+ * Writes a whole buffer at an offset, retrying short writes.
+ * Params: fd - the file descriptor to write to.
+ *         data - the buffer to write.
+ *         length - the length of the buffer.
+ *         offset - where to write it.
+ * Returns: 0 if everything was written; a nonzero value otherwise.
+ */
+static int pwrite_all(int fd, const void *data, size_t length, uint64_t offset);
+
+int segment_name_valid(char *filename)
+{
+	int len = strlen(filename);
+	return len > 4 && !strcmp(filename + len - 4, ".seg");	//Check if filename ends with ".seg"
+}
+
+int segment_open(segment_t *seg, char *path)
+{
+	int fd = open(path, O_RDONLY);
+	
+	if(fd < 0)
+		return 1;
+	
+	struct stat st;
+	seg_footer_t footer;
+	
+	if(fstat(fd, &st) || read_footer(fd, st.st_size, &footer))
+	{
+		close(fd);
+		return 1;
+	}
+	
+	//Map the whole segment; the mapping outlives the file descriptor
+	seg->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if(seg->data == MAP_FAILED)
+		return 1;
+	
+	//We're going to read it front to back
+	madvise(seg->data, st.st_size, MADV_SEQUENTIAL);
+	
+	seg->size = st.st_size;
+	seg->index = (seg_entry_t*) (seg->data + footer.index_offset);
+	seg->count = footer.count;
+	return 0;
+}
+
+void segment_close(segment_t *seg)
+{
+	munmap(seg->data, seg->size);
+}
+
+int segment_tombstone(int fd, segment_t *seg, uint32_t index)
+{
+	if(index >= seg->count)
+		return 1;
+	
+	//Only the flags change, so that's all we write
+	uint32_t flags = seg->index[index].flags | SEG_ARCHIVED;
+	uint64_t offset = ((char*) &(seg->index[index]) - seg->data) + offsetof(seg_entry_t, flags);
+	return pwrite_all(fd, &flags, sizeof(flags), offset);
+}
+
+seg_writer_t* segment_writer_open(char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	
+	if(fd < 0)
+		return NULL;
+	
+	seg_writer_t *writer = malloc(sizeof(seg_writer_t));
+	writer->fd = fd;
+	writer->offset = 0;
+	writer->count = 0;
+	writer->cap = 64;
+	writer->entries = malloc(sizeof(seg_entry_t) * writer->cap);
+	return writer;
+}
+
+int segment_writer_add(seg_writer_t *writer, char *name, char *data, uint32_t length)
+{
+	if(pwrite_all(writer->fd, data, length, writer->offset))
+		return 1;
+	
+	//Make room for its index entry
+	if(writer->count == writer->cap)
+	{
+		writer->cap *= 2;
+		writer->entries = realloc(writer->entries, sizeof(seg_entry_t) * writer->cap);
+	}
+	
+	seg_entry_t *entry = &(writer->entries[writer->count++]);
+	memset(entry, 0, sizeof(seg_entry_t));
+	entry->offset = writer->offset;
+	entry->length = length;
+	strncpy(entry->name, name, SEG_NAME_LEN - 1);
+	
+	writer->offset += length;
+	return 0;
+}
+
+int segment_writer_close(seg_writer_t *writer)
+{
+	//Write the index and footer after the last record
+	seg_footer_t footer;
+	memcpy(footer.magic, SEG_MAGIC, sizeof(footer.magic));
+	footer.index_offset = writer->offset;
+	footer.count = writer->count;
+	footer.reserved = 0;
+	
+	uint64_t index_len = sizeof(seg_entry_t) * writer->count;
+	int retval = pwrite_all(writer->fd, writer->entries, index_len, writer->offset) ||
+		pwrite_all(writer->fd, &footer, sizeof(footer), writer->offset + index_len) ||
+		fsync(writer->fd);	//It has to be on disk before anyone counts on it being there
+	
+	close(writer->fd);
+	free(writer->entries);
+	free(writer);
+	return retval;
+}
+
+static int read_footer(int fd, uint64_t size, seg_footer_t *footer)
+{
+	if(size < sizeof(seg_footer_t))
+		return 1;
+	
+	if(pread(fd, footer, sizeof(seg_footer_t), size - sizeof(seg_footer_t)) != sizeof(seg_footer_t))
+		return 1;
+	
+	//Make sure it's a segment and its index fits where the footer says it is
+	return memcmp(footer->magic, SEG_MAGIC, sizeof(footer->magic)) ||
+		footer->index_offset + (uint64_t) footer->count * sizeof(seg_entry_t) + sizeof(seg_footer_t) != size;
+}
+
+static int pwrite_all(int fd, const void *data, size_t length, uint64_t offset)
+{
+	const char *p = data;
+	
+	while(length > 0)
+	{
+		ssize_t ret = pwrite(fd, p, length, offset);
+		
+		if(ret <= 0)
+			return 1;
+		
+		p += ret;
+		length -= ret;
+		offset += ret;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef SEGMENT_H_INCLUDED
+#define SEGMENT_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * A segment packs many logical .sen files ("records") into one file:
+ *
+ *   [record 0][record 1]...[record n - 1][index entry 0]...[index entry n - 1][footer]
+ *
+ * Records are stored back to back exactly as they'd appear in a .sen file.
+ * The index and footer are written when the segment is closed. A segment is
+ * only ever written once, as a new file: nothing writes records into a segment
+ * that's already there, so a segment that didn't get its footer can't take
+ * any other records down with it.
+ */
+
+#define SEG_MAGIC "FSCHSEG1"	//Magic number at the start of the footer
+#define SEG_NAME_LEN 64			//Characters of a record's original file name we keep
+#define SEG_ARCHIVED 1			//Index entry flag set when a record has been archived (a tombstone)
+
+/* Defines an index entry, one per record */
+typedef struct _seg_entry_t {
+	uint64_t offset;			//Offset of the record from the start of the segment
+	uint32_t length;			//Length of the record
+	uint32_t flags;				//SEG_ARCHIVED if the record has been archived
+	char name[SEG_NAME_LEN];	//Original file name of the record
+} seg_entry_t;
+
+/* Defines the footer at the very end of a segment */
+typedef struct _seg_footer_t {
+	char magic[8];				//SEG_MAGIC, not null-terminated
+	uint64_t index_offset;		//Offset of the first index entry
+	uint32_t count;				//Number of records
+	uint32_t reserved;			//Unused, always 0
+} seg_footer_t;
+
+/* Defines a segment mapped into memory for reading */
+typedef struct _segment_t {
+	char *data;					//The whole segment
+	uint64_t size;				//Size of the segment
+	seg_entry_t *index;			//Index entries, pointing into data
+	uint32_t count;				//Number of records
+} segment_t;
+
+/* Defines a segment being written */
+typedef struct _seg_writer_t {
+	int fd;						//File descriptor of the segment
+	uint64_t offset;			//Where the next record goes
+	seg_entry_t *entries;		//Index entries so far
+	uint32_t count;				//Number of index entries so far
+	uint32_t cap;				//Number of index entries allocated
+} seg_writer_t;
+
+/* Segment functions */
+
+/*
+ * Checks if a file name is a segment's. A segment's name ends with ".seg".
+ * Params: filename - the name of the file.
+ * Returns: 1 if the file name is a segment's; 0 otherwise.
+ */
+int segment_name_valid(char *filename);
+
+/*
+ * Maps a segment into memory for reading.
+ * Params: seg - a segment_t to fill in.
+ *         path - the full path to the segment.
+ * Returns: 0 if the segment was opened; a nonzero value otherwise.
+ */
+int segment_open(segment_t *seg, char *path);
+
+/*
+ * Unmaps a segment opened with segment_open().
+ * Params: seg - the segment to close.
+ * Returns: nothing
+ */
+void segment_close(segment_t *seg);
+
+/*
+ * Marks a record as archived in place, writing nothing but its flags.
+ * Params: fd - a descriptor for the segment, open for writing.
+ *         seg - the segment, opened with segment_open().
+ *         index - the index of the record.
+ * Returns: 0 if the record was marked; a nonzero value otherwise.
+ */
+int segment_tombstone(int fd, segment_t *seg, uint32_t index);
+
+/*
+ * Creates a new segment for writing. Nothing already at the path is ever
+ * written over.
+ * Params: path - the full path to the segment.
+ * Returns: a writer for the segment, or NULL if it couldn't be created (with
+ *          errno set to EEXIST if something's already at the path).
+ */
+seg_writer_t* segment_writer_open(char *path);
+
+/*
+ * Appends a record to a segment being written.
+ * Params: writer - the segment's writer.
+ *         name - the original file name of the record.
+ *         data - the record's contents.
+ *         length - the length of the record.
+ * Returns: 0 if the record was written; a nonzero value otherwise.
+ */
+int segment_writer_add(seg_writer_t *writer, char *name, char *data, uint32_t length);
+
+/*
+ * Writes a segment's index and footer and flushes it to disk, then closes and
+ * frees its writer.
+ * Params: writer - the segment's writer.
+ * Returns: 0 if the segment was written; a nonzero value otherwise.
+ */
+int segment_writer_close(seg_writer_t *writer);
+
+#endif //SEGMENT_H_INCLUDED
@@ -0,0 +1,224 @@
+#include <mpi.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+#include "shmq.h"
+#include "univ.h"
+
+/* Defines a file in a host's shared queue */
+typedef struct _shm_entry_t {
+	char name[FILE_NAME_LEN];	//Full path to the file
+	int file_size;				//Size of the file
+	int priority;				//Priority of the file
+} shm_entry_t;
+
+/* Defines a host's shared queue, which lives in the shared window */
+typedef struct _shm_queue_t {
+	pthread_mutex_t mutex;				//Protects the queue, across every process on the host
+	pthread_cond_t not_empty;			//Signaled when a file is pushed or the queue is closed
+	pthread_cond_t not_full;			//Signaled when a file is popped
+	int head;							//Index of the next file to pop
+	int size;							//Number of files in the queue
+	int sum_file_size;					//Sum of the sizes of the files in the queue
+	int closed;							//1 if nothing else will be pushed; 0 otherwise
+	shm_entry_t entries[SHM_QUEUE_CAP];	//The files, as a ring
+} shm_queue_t;
+
+/* shmq.h extern variables */
+int is_host_leader = 0;
+int *host_leaders = NULL;
+int *host_targets = NULL;
+
+/* Static variables */
+static MPI_Comm host_comm = MPI_COMM_NULL;	//Communicator of the nodes on our host
+static MPI_Win host_win = MPI_WIN_NULL;		//Shared window holding our host's queue
+static shm_queue_t *queue = NULL;			//Our host's queue, in the shared window
+
+void init_shm()
+{
+	//Group the nodes by host; the central machine stays out of every host
+	MPI_Comm_split_type(MPI_COMM_WORLD, (proc_id == CENTRAL) ? MPI_UNDEFINED : MPI_COMM_TYPE_SHARED, proc_id, MPI_INFO_NULL, &host_comm);
+	int leader_id = -1;
+	
+	if(proc_id != CENTRAL)
+	{
+		int host_rank;
+		MPI_Comm_rank(host_comm, &host_rank);
+		is_host_leader = (host_rank == 0);
+		
+		//The host leader allocates the queue; everyone else maps the leader's part of the window
+		MPI_Aint size = is_host_leader ? sizeof(shm_queue_t) : 0;
+		int disp_unit;
+		void *base;
+		MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, host_comm, &base, &host_win);
+		MPI_Win_shared_query(host_win, 0, &size, &disp_unit, &queue);
+		
+		if(is_host_leader)
+		{
+			memset(queue, 0, sizeof(shm_queue_t));
+			
+			pthread_mutexattr_t mutex_attr;
+			pthread_mutexattr_init(&mutex_attr);
+			pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+			pthread_mutex_init(&(queue->mutex), &mutex_attr);
+			pthread_mutexattr_destroy(&mutex_attr);
+			
+			pthread_condattr_t cond_attr;
+			pthread_condattr_init(&cond_attr);
+			pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+			pthread_cond_init(&(queue->not_empty), &cond_attr);
+			pthread_cond_init(&(queue->not_full), &cond_attr);
+			pthread_condattr_destroy(&cond_attr);
+		}
+		
+		MPI_Barrier(host_comm);	//Nobody touches the queue until it's initialized
+		
+		int leader_rank = 0;
+		MPI_Group host_group, world_group;
+		MPI_Comm_group(host_comm, &host_group);
+		MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+		MPI_Group_translate_ranks(host_group, 1, &leader_rank, world_group, &leader_id);
+		MPI_Group_free(&host_group);
+		MPI_Group_free(&world_group);
+	}
+	
+	//The central machine needs to know which hosts there are and who's on each
+	int *leader_ids = (proc_id == CENTRAL) ? malloc(sizeof(int) * proc_count) : NULL;
+	MPI_Gather(&leader_id, 1, MPI_INT, leader_ids, 1, MPI_INT, CENTRAL, MPI_COMM_WORLD);
+	
+	if(proc_id == CENTRAL)
+	{
+		host_leaders = malloc(sizeof(int) * proc_count);
+		host_targets = calloc(proc_count, sizeof(int));
+		target_count = 0;
+		
+		//Host leaders are the lowest rank on their host, so each host's target is set before anyone else on it needs it
+		for(int i = 1; i < proc_count; i++)
+		{
+			if(leader_ids[i] == i)
+			{
+				host_leaders[++target_count] = i;
+				host_targets[i] = target_count;
+			}
+			else
+				host_targets[i] = host_targets[leader_ids[i]];
+		}
+		
+		free(leader_ids);
+	}
+}
+
+void shm_push(char *filename, int file_size, int priority)
+{
+	pthread_mutex_lock(&(queue->mutex));
+	
+	while(queue->size == SHM_QUEUE_CAP)
+		pthread_cond_wait(&(queue->not_full), &(queue->mutex));
+	
+	shm_entry_t *entry = &(queue->entries[(queue->head + queue->size) % SHM_QUEUE_CAP]);
+	memset(entry->name, 0, FILE_NAME_LEN);
+	strncpy(entry->name, filename, FILE_NAME_LEN - 1);
+	entry->file_size = file_size;
+	entry->priority = priority;
+	queue->size++;
+	queue->sum_file_size += file_size;
+	
+	pthread_cond_signal(&(queue->not_empty));
+	pthread_mutex_unlock(&(queue->mutex));
+}
+
+char* shm_pop(int *file_size, int *priority)
+{
+	pthread_mutex_lock(&(queue->mutex));
+	
+	while(queue->size == 0 && !queue->closed)
+		pthread_cond_wait(&(queue->not_empty), &(queue->mutex));
+	
+	//If we woke up because the queue was closed, there's nothing left to give
+	if(queue->size == 0)
+	{
+		pthread_mutex_unlock(&(queue->mutex));
+		return NULL;
+	}
+	
+	shm_entry_t *entry = &(queue->entries[queue->head]);
+	char *filename = malloc(strlen(entry->name) + 1);
+	strcpy(filename, entry->name);
+	*file_size = entry->file_size;
+	*priority = entry->priority;
+	
+	queue->head = (queue->head + 1) % SHM_QUEUE_CAP;
+	queue->size--;
+	queue->sum_file_size -= *file_size;
+	
+	pthread_cond_signal(&(queue->not_full));
+	pthread_mutex_unlock(&(queue->mutex));
+	return filename;
+}
+
+int shm_peek(char **files, int max)
+{
+	pthread_mutex_lock(&(queue->mutex));
+	int count = 0;
+	
+	//Copy the names, since they could be written over as soon as we let go
+	for(; count < max && count < queue->size; count++)
+	{
+		shm_entry_t *entry = &(queue->entries[(queue->head + count) % SHM_QUEUE_CAP]);
+		files[count] = malloc(strlen(entry->name) + 1);
+		strcpy(files[count], entry->name);
+	}
+	
+	pthread_mutex_unlock(&(queue->mutex));
+	return count;
+}
+
+void shm_close()
+{
+	pthread_mutex_lock(&(queue->mutex));
+	queue->closed = 1;
+	pthread_cond_broadcast(&(queue->not_empty));	//Wake up everyone waiting so they can see it's closed
+	pthread_mutex_unlock(&(queue->mutex));
+}
+
+int shm_length()
+{
+	pthread_mutex_lock(&(queue->mutex));
+	int size = queue->size;
+	pthread_mutex_unlock(&(queue->mutex));
+	return size;
+}
+
+int shm_bytes()
+{
+	pthread_mutex_lock(&(queue->mutex));
+	int sum = queue->sum_file_size;
+	pthread_mutex_unlock(&(queue->mutex));
+	return sum;
+}
+
+void shm_cleanup()
+{
+	if(proc_id == CENTRAL)
+	{
+		free(host_leaders);
+		free(host_targets);
+		host_leaders = host_targets = NULL;
+		return;
+	}
+	
+	MPI_Barrier(host_comm);	//Wait for everyone on the host to be done with the queue
+	
+	if(is_host_leader)
+	{
+		pthread_mutex_destroy(&(queue->mutex));
+		pthread_cond_destroy(&(queue->not_empty));
+		pthread_cond_destroy(&(queue->not_full));
+	}
+	
+	MPI_Win_free(&host_win);
+	MPI_Comm_free(&host_comm);
+	queue = NULL;
+}
@@ -0,0 +1,95 @@
+#ifndef SHMQ_H_INCLUDED
+#define SHMQ_H_INCLUDED
+
+#include <mpi.h>
+
+/*
+ * With -shm, the nodes on each host share one file queue instead of each
+ * having their own. The queue lives in an MPI shared window allocated by the
+ * lowest rank on the host, its host leader, and is protected by a
+ * process-shared mutex inside the window. The central machine only sends
+ * files to host leaders, treating each host as a single target, and every
+ * node on the host takes its next file from the shared queue as soon as it's
+ * free, so the host balances itself without any messages.
+ *
+ * The shared queue is first in, first out; files already arrive in priority
+ * order from the central machine. Nodes still report to the central machine
+ * themselves, and it works out which host each one is on.
+ */
+
+#define SHM_QUEUE_CAP 1024	//Files a host's queue can hold before its leader waits for room
+
+/* Shared queue variables */
+extern int is_host_leader;	//1 if we receive files for our host; 0 otherwise
+extern int *host_leaders;	//On the central machine, each host's leader's rank, indexed like targets
+extern int *host_targets;	//On the central machine, which target each rank's host is, indexed by rank
+
+/* Shared queue functions */
+
+/*
+ * Groups the nodes by host and sets up each host's shared queue. Every rank
+ * has to call this, before init_central() or init_node(). On the central
+ * machine, this sets target_count to the number of hosts.
+ * Params: nothing
+ * Returns: nothing
+ */
+void init_shm();
+
+/*
+ * Adds a file to our host's queue, waiting for room if it's full.
+ * Params: filename - full path to the file.
+ *         file_size - the size of the file.
+ *         priority - the file's priority.
+ * Returns: nothing
+ */
+void shm_push(char *filename, int file_size, int priority);
+
+/*
+ * Takes the next file from our host's queue, waiting for one if it's empty.
+ * Params: file_size - where to put the size of the file.
+ *         priority - where to put the file's priority.
+ * Returns: the file's full path, malloc()'d, or NULL if the queue is closed
+ *          and empty.
+ */
+char* shm_pop(int *file_size, int *priority);
+
+/*
+ * Gets the names of the files at the front of our host's queue without taking
+ * them, in the order they'd be taken.
+ * Params: files - a buffer for up to max file names, each malloc()'d.
+ *         max - the most file names to get.
+ * Returns: the number of file names put in files.
+ */
+int shm_peek(char **files, int max);
+
+/*
+ * Closes our host's queue, so nodes stop waiting for files once it's empty.
+ * Only the host leader should call this, once it won't push anything else.
+ * Params: nothing
+ * Returns: nothing
+ */
+void shm_close();
+
+/*
+ * Gets the number of files in our host's queue.
+ * Params: nothing
+ * Returns: the number of files.
+ */
+int shm_length();
+
+/*
+ * Gets the sum of the sizes of the files in our host's queue.
+ * Params: nothing
+ * Returns: the sum of their sizes.
+ */
+int shm_bytes();
+
+/*
+ * Frees our host's queue. Every node on the host has to call this, once none
+ * of its threads will touch the queue again.
+ * Params: nothing
+ * Returns: nothing
+ */
+void shm_cleanup();
+
+#endif //SHMQ_H_INCLUDED
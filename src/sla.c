@@ -0,0 +1,113 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sla.h"
+
+/* Static function prototypes */
+
+/*
+ * Compares two latenesses, for qsort().
+ * Params: a - the first lateness.
+ *         b - the second lateness.
+ * Returns: a negative, zero or positive value if a is less than, equal to or
+ *          greater than b.
+ */
+static int compare_doubles(const void *a, const void *b);
+
+/*
+ * Gets a percentile of some sorted latenesses.
+ * Params: lateness - the latenesses, sorted.
+ *         count - the number of latenesses.
+ *         p - the percentile, in [0, 1].
+ * Returns: the percentile.
+ */
+static double percentile(double *lateness, int count, double p);
+
+/* sla.h extern variables */
+int sla_seconds = 0;
+
+/* Static variables */
+static double *latenesses = NULL;								//How late each file we processed was
+static int lateness_count = 0;									//Number of files in latenesses
+static int lateness_cap = 0;									//Number of files latenesses has room for
+static pthread_mutex_t lateness_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects latenesses
+
+long long file_deadline(char *filename)
+{
+	//The timestamp comes after the first '_' of the name, minus any directory
+	char *name = strrchr(filename, '/');
+	name = (name != NULL) ? name + 1 : filename;
+	
+	char *underscore = strchr(name, '_');
+	return ((underscore != NULL) ? atoll(underscore + 1) : 0) + sla_seconds;
+}
+
+void sla_record(char *filename)
+{
+	if(sla_seconds <= 0)
+		return;
+	
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	double lateness = (now.tv_sec - file_deadline(filename)) + now.tv_nsec / 1e9;
+	
+	pthread_mutex_lock(&lateness_mutex);
+	
+	if(lateness_count == lateness_cap)
+	{
+		lateness_cap = (lateness_cap > 0) ? lateness_cap * 2 : 1024;
+		latenesses = realloc(latenesses, sizeof(double) * lateness_cap);
+	}
+	
+	latenesses[lateness_count++] = lateness;
+	pthread_mutex_unlock(&lateness_mutex);
+}
+
+double* sla_latenesses(int *count)
+{
+	*count = lateness_count;
+	return latenesses;
+}
+
+void sla_write(FILE *file, double *lateness, int count)
+{
+	qsort(lateness, count, sizeof(double), compare_doubles);
+	
+	int misses = 0;
+	
+	for(int i = 0; i < count; i++)
+		if(lateness[i] > 0)
+			misses++;
+	
+	fprintf(file, "SLA MISSES: %d of %d files (%.2f%%) missed their %d second deadline\n", misses, count,
+		(count > 0) ? 100.0 * misses / count : 0, sla_seconds);
+	fprintf(file, "LATENESS (seconds): p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", percentile(lateness, count, 0.5),
+		percentile(lateness, count, 0.9), percentile(lateness, count, 0.99), (count > 0) ? lateness[count - 1] : 0);
+}
+
+void sla_cleanup()
+{
+	pthread_mutex_lock(&lateness_mutex);
+	free(latenesses);
+	latenesses = NULL;
+	lateness_count = lateness_cap = 0;
+	pthread_mutex_unlock(&lateness_mutex);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double da = *((const double*) a), db = *((const double*) b);
+	return (da > db) - (da < db);
+}
+
+static double percentile(double *lateness, int count, double p)
+{
+	if(count == 0)
+		return 0;
+	
+	//Nearest rank
+	int rank = (int) (p * count + 0.999999);
+	return lateness[(rank > 0) ? rank - 1 : 0];
+}
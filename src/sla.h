@@ -0,0 +1,65 @@
+#ifndef SLA_H_INCLUDED
+#define SLA_H_INCLUDED
+
+#include <stdio.h>
+
+/*
+ * With -sla <secs>, every file has to be processed within <secs> seconds of
+ * the time in its name (<sensor>_<timestamp>.sen), its deadline. Whoever
+ * processes a file records how late it was (negative if it was early), and
+ * the central machine reports how many files missed their deadline and the
+ * percentiles of their lateness.
+ *
+ * The -edf priority option schedules by deadline: every queue is sorted
+ * earliest deadline first, and each file is sent to the node expected to
+ * finish it soonest, going by how much work each node has been sent but hasn't
+ * finished and how fast it's been finishing files (see sched_file_done()).
+ */
+
+#define SLA_DEFAULT_SECONDS 60	//SLA -edf uses if -sla isn't given
+
+/* SLA variables */
+extern int sla_seconds;		//Seconds after its timestamp a file has to be processed by, or 0 if there's no SLA
+
+/* SLA functions */
+
+/*
+ * Gets a file's deadline from its name.
+ * Params: filename - the file's name, with or without its directory.
+ * Returns: the file's deadline, in seconds since the epoch.
+ */
+long long file_deadline(char *filename);
+
+/*
+ * Records how late a file was, now that it's been processed. Does nothing if
+ * there's no SLA.
+ * Params: filename - the file's name.
+ * Returns: nothing
+ */
+void sla_record(char *filename);
+
+/*
+ * Gets how late every file this rank processed was.
+ * Params: count - where to put the number of files.
+ * Returns: each file's lateness in seconds; owned by the SLA module.
+ */
+double* sla_latenesses(int *count);
+
+/*
+ * Writes the number of files that missed their deadline and the percentiles
+ * of how late files were.
+ * Params: file - where to write them.
+ *         lateness - every file's lateness in seconds; sorted in place.
+ *         count - the number of files.
+ * Returns: nothing
+ */
+void sla_write(FILE *file, double *lateness, int count);
+
+/*
+ * Frees what sla_record() recorded.
+ * Params: nothing
+ * Returns: nothing
+ */
+void sla_cleanup();
+
+#endif //SLA_H_INCLUDED
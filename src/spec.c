@@ -0,0 +1,671 @@
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compress.h"
+#include "node.h"
+#include "result.h"
+#include "sched.h"
+#include "segment.h"
+#include "spec.h"
+#include "trace.h"
+#include "univ.h"
+
+/* Kinds of messages */
+enum {
+	DONE_MSG,	//A node is done with a file
+	CLAIM_MSG,	//A node running a copied file wants to publish its match
+	ACCEPT_MSG,	//A node hasn't published the file it's running, so it can be copied
+	REFUSE_MSG,	//A node's file can't be copied (it's published it, or it isn't running one)
+	END_MSG,	//Nothing more is coming
+	OFFER_MSG,	//The central machine wants to copy whatever file a node is running
+	COPY_MSG,	//A copy of somebody else's file for a node to run
+	GRANT_MSG,	//The claimer should publish the match, or the copy that's done won
+	DENY_MSG,	//Another copy already published it, or finished it first
+	CANCEL_MSG	//Another copy already finished it
+};
+
+/* Defines a message between the central machine and a node */
+typedef struct _spec_msg_t {
+	int type;					//Kind of message
+	int file_size;				//Size of the file (DONE_MSG, ACCEPT_MSG and COPY_MSG only)
+	int priority;				//Priority of the file (ACCEPT_MSG and COPY_MSG only)
+	long long busy_ns;			//How long the node spent on it, or -1 if it was cancelled (DONE_MSG only)
+	char name[FILE_NAME_LEN];	//Full path to the file
+} spec_msg_t;
+
+/* Defines what the central machine knows about a node */
+typedef struct _spec_node_t {
+	int held;				//Files it's been sent (or saved for) but isn't done with
+	long long busy_since;	//When it started the file it's running, as far as we can tell, from now_ns()
+	int asked;				//1 if we've already asked to copy the file it's running; 0 otherwise
+	int spare;				//Node saved for a copy of the file it's running, while we wait for its answer
+} spec_node_t;
+
+/* Defines a file that's been copied, as the central machine sees it */
+typedef struct _spec_file_t {
+	char name[FILE_NAME_LEN];		//Full path to the file
+	int targets[2];					//Node running the first copy, then the node running the second
+	int done[2];					//1 once each copy is done; 0 until then
+	int winner;						//Copy that finished or claimed it first, or -1 if none has
+	struct _spec_file_t *next;		//Next copied file
+} spec_file_t;
+
+/* Defines a list of files a node has been told about */
+typedef struct _name_list_t {
+	char **names;	//The files, malloc()'d
+	int count;		//Number of files in names
+	int capacity;	//Number of files there's room for in names
+} name_list_t;
+
+/* Static function prototypes */
+
+/*
+ * The function the central machine's speculation thread runs: keeps track of
+ * what every node is doing, sends copies, and answers claims.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time.
+ */
+static void* central_thread_func(void *nothing);
+
+/*
+ * The function a node's speculation thread runs: takes cancels, offers,
+ * copies and answers to claims from the central machine.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time.
+ */
+static void* node_thread_func(void *nothing);
+
+/*
+ * Waits for a message, sleeping SPEC_LISTEN_MS at a time rather than spinning
+ * in MPI_Recv() the whole time.
+ * Params: msg - where to put the message.
+ *         source - the rank to hear from, or MPI_ANY_SOURCE.
+ *         tag - SPEC_TAG on the central machine, SPEC_REPLY_TAG on a node.
+ * Returns: the rank it came from.
+ */
+static int receive_msg(spec_msg_t *msg, int source, int tag);
+
+/*
+ * Finds a copied file. table_mutex must be held.
+ * Params: filename - the full path to the file.
+ * Returns: the link pointing to the file (so it can be removed), which points
+ *          to NULL if it was never copied.
+ */
+static spec_file_t** find_file(char *filename);
+
+/*
+ * Finds the busy node that's been running its file longest, if it's been
+ * running it longer than a threshold and we haven't asked about it yet.
+ * table_mutex must be held.
+ * Params: now - the time, from now_ns().
+ *         threshold - how long it has to have been running, in ns.
+ * Returns: the node, or 0 if there isn't one.
+ */
+static int find_straggler(long long now, long long threshold);
+
+/*
+ * Works out how long speculate_pct percent of finished files took.
+ * table_mutex must be held.
+ * Params: nothing
+ * Returns: the time, in ns.
+ */
+static long long percentile();
+
+/*
+ * Compares two times for qsort().
+ * Params: a, b - pointers to the times.
+ * Returns: a negative, zero or positive value as a is less than, equal to or
+ *          greater than b.
+ */
+static int compare_times(const void *a, const void *b);
+
+/*
+ * Sends a message about a file.
+ * Params: type - the kind of message.
+ *         filename - the full path to the file, or NULL if there isn't one.
+ *         file_size - its size, for the kinds that need it.
+ *         priority - its priority, for the kinds that need it.
+ *         dest - the rank to send it to.
+ *         tag - SPEC_TAG to the central machine, SPEC_REPLY_TAG to a node.
+ * Returns: nothing
+ */
+static void send_msg(int type, char *filename, int file_size, int priority, int dest, int tag);
+
+/*
+ * Adds a file to a list. node_mutex must be held.
+ * Params: list - the list.
+ *         filename - the full path to the file.
+ * Returns: nothing
+ */
+static void add_name(name_list_t *list, char *filename);
+
+/*
+ * Removes a file from a list if it's there. node_mutex must be held.
+ * Params: list - the list.
+ *         filename - the full path to the file.
+ * Returns: 1 if it was there; 0 otherwise.
+ */
+static int take_name(name_list_t *list, char *filename);
+
+/*
+ * Frees a list.
+ * Params: list - the list.
+ * Returns: nothing
+ */
+static void free_names(name_list_t *list);
+
+/* spec.h extern variables */
+long long spec_copies = 0;
+long long spec_wins = 0;
+
+/* Static variables */
+static MPI_Comm spec_comm = MPI_COMM_NULL;	//Communicator nodes and the central machine talk about files on
+static pthread_t spec_thread;				//Thread that hears from the other side
+static spec_node_t *nodes = NULL;			//What the central machine knows about each node, indexed by rank
+static int held_total = 0;					//Sum of every node's held
+static int offers_waiting = 0;				//Number of nodes we've asked to copy a file that haven't answered
+static spec_file_t *copied = NULL;			//Every copied file that still has a copy running
+static long long *samples = NULL;			//How long each finished file took, in ns
+static int sample_count = 0;				//Number of times in samples
+static int sample_capacity = 0;				//Number of times there's room for in samples
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects everything above
+static char current[FILE_NAME_LEN];			//File a node's process thread is running, or "" if it's between files
+static int current_size;					//Its size
+static int current_priority;				//Its priority
+static int current_copied = 0;				//1 if another copy of current might be running, so it has to be claimed; 0 otherwise
+static int current_published = 0;			//1 once current's match has been published without being claimed; 0 until then
+static name_list_t cancelled;				//Files a node has been told to cancel
+static name_list_t copies;					//Copies a node has been sent but hasn't started yet
+static int reply = -1;						//Answer to a node's claim or to its being done with a copied file, or -1 if it hasn't come yet
+static pthread_mutex_t node_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects everything from current down
+static pthread_cond_t reply_cond = PTHREAD_COND_INITIALIZER;	//Signaled when reply is set
+
+void spec_start()
+{
+	MPI_Comm_dup(MPI_COMM_WORLD, &spec_comm);
+	
+	if(proc_id == CENTRAL)
+	{
+		nodes = calloc(proc_count, sizeof(spec_node_t));
+		pthread_create(&spec_thread, NULL, central_thread_func, NULL);
+	}
+	else
+		pthread_create(&spec_thread, NULL, node_thread_func, NULL);
+}
+
+void spec_dispatched(int target)
+{
+	//If it had nothing to do, it starts this file right away
+	pthread_mutex_lock(&table_mutex);
+	
+	if(nodes[target].held++ == 0)
+		nodes[target].busy_since = now_ns();
+	
+	held_total++;
+	pthread_mutex_unlock(&table_mutex);
+}
+
+void spec_tail()
+{
+	int *offers = malloc(sizeof(int) * proc_count);	//Nodes to ask, each with a spare of its own
+	long long threshold = -1;
+	int sampled = 0;
+	
+	//Keep going until every node is done with every file, and has answered every offer
+	for(;;)
+	{
+		int offer_count = 0;
+		pthread_mutex_lock(&table_mutex);
+		
+		if(held_total == 0 && offers_waiting == 0)
+		{
+			pthread_mutex_unlock(&table_mutex);
+			break;
+		}
+		
+		//We only know what "too long" is once enough files have finished
+		if(sample_count >= SPEC_MIN_SAMPLES && sample_count != sampled)
+		{
+			threshold = percentile();
+			sampled = sample_count;
+		}
+		
+		//Save every node with nothing left to do for a copy of the worst straggler left
+		long long now = now_ns();
+		
+		for(int spare = 1; threshold >= 0 && spare < proc_count; spare++)
+		{
+			if(nodes[spare].held > 0)
+				continue;
+			
+			int straggler = find_straggler(now, threshold);
+			
+			if(straggler == 0)
+				break;
+			
+			nodes[straggler].asked = 1;
+			nodes[straggler].spare = spare;
+			nodes[spare].held++;
+			nodes[spare].busy_since = now;
+			held_total++;
+			offers_waiting++;
+			offers[offer_count++] = straggler;
+		}
+		
+		pthread_mutex_unlock(&table_mutex);
+		
+		//Ask each straggler's node first, since it might be just about to publish its file
+		for(int i = 0; i < offer_count; i++)
+			send_msg(OFFER_MSG, NULL, 0, 0, offers[i], SPEC_REPLY_TAG);
+		
+		struct timespec pause = { 0, SPEC_POLL_MS * 1000000L };
+		nanosleep(&pause, NULL);
+	}
+	
+	free(offers);
+	
+	//Nothing more is coming from any node, so stop listening
+	send_msg(END_MSG, NULL, 0, 0, CENTRAL, SPEC_TAG);
+	pthread_join(spec_thread, NULL);
+}
+
+int spec_begin(char *filename, int file_size, int priority)
+{
+	pthread_mutex_lock(&node_mutex);
+	
+	//If it's a copy, the original is running somewhere else, so it has to be claimed (and even if it's skipped,
+	//spec_done() has to hear it lost)
+	current_copied = take_name(&copies, filename);
+	current_published = 0;
+	
+	if(take_name(&cancelled, filename))
+	{
+		pthread_mutex_unlock(&node_mutex);
+		return 1;
+	}
+	
+	strncpy(current, filename, FILE_NAME_LEN - 1);
+	current_size = file_size;
+	current_priority = priority;
+	pthread_mutex_unlock(&node_mutex);
+	return 0;
+}
+
+int spec_cancelled(char *filename)
+{
+	pthread_mutex_lock(&node_mutex);
+	int retval = take_name(&cancelled, filename);
+	pthread_mutex_unlock(&node_mutex);
+	return retval;
+}
+
+int spec_claim(char *filename)
+{
+	pthread_mutex_lock(&node_mutex);
+	
+	//Nobody else has it, and once it's published, nobody else can be given it
+	if(!current_copied)
+	{
+		current_published = 1;
+		pthread_mutex_unlock(&node_mutex);
+		return 1;
+	}
+	
+	reply = -1;
+	pthread_mutex_unlock(&node_mutex);
+	
+	send_msg(CLAIM_MSG, filename, 0, 0, CENTRAL, SPEC_TAG);
+	
+	pthread_mutex_lock(&node_mutex);
+	
+	while(reply < 0)
+		pthread_cond_wait(&reply_cond, &node_mutex);
+	
+	int retval = (reply == GRANT_MSG);
+	pthread_mutex_unlock(&node_mutex);
+	return retval;
+}
+
+int spec_done(char *filename, int file_size, long long busy_ns)
+{
+	//Once we let go, the file can't be copied anymore, so if it hasn't been, it's all ours
+	pthread_mutex_lock(&node_mutex);
+	current[0] = '\0';
+	int copied = current_copied;
+	reply = -1;
+	pthread_mutex_unlock(&node_mutex);
+	
+	spec_msg_t msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = DONE_MSG;
+	msg.file_size = file_size;
+	msg.busy_ns = busy_ns;
+	strncpy(msg.name, filename, FILE_NAME_LEN - 1);
+	MPI_Send(&msg, sizeof(msg), MPI_BYTE, CENTRAL, SPEC_TAG, spec_comm);
+	
+	if(!copied)
+		return 1;
+	
+	//Otherwise, only the central machine knows which copy won (the cancel could still be on its way)
+	pthread_mutex_lock(&node_mutex);
+	
+	while(reply < 0)
+		pthread_cond_wait(&reply_cond, &node_mutex);
+	
+	int retval = (reply == GRANT_MSG);
+	pthread_mutex_unlock(&node_mutex);
+	return retval;
+}
+
+void spec_stop()
+{
+	if(proc_id == CENTRAL)
+	{
+		//Every copy is done by now, so nothing's left on copied
+		free(nodes);
+		free(samples);
+		nodes = NULL;
+		samples = NULL;
+		sample_count = sample_capacity = 0;
+	}
+	else
+	{
+		pthread_join(spec_thread, NULL);	//The central machine has already told it nothing more is coming
+		
+		//Cancels for copies we'd already finished are never taken
+		free_names(&cancelled);
+		free_names(&copies);
+	}
+	
+	MPI_Comm_free(&spec_comm);
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* central_thread_func(void *nothing)
+{
+	//We don't actually use the parameter for anything
+	trace_thread_name("speculate");
+	
+	for(;;)
+	{
+		spec_msg_t msg;
+		int source = receive_msg(&msg, MPI_ANY_SOURCE, SPEC_TAG);
+		
+		if(msg.type == END_MSG)
+			break;
+		
+		int reply_type = -1, cancel = -1, copy_to = -1;
+		pthread_mutex_lock(&table_mutex);
+		spec_file_t **link = find_file(msg.name);
+		spec_file_t *file = *link;
+		int index = (file != NULL && file->targets[1] == source) ? 1 : 0;
+		int other = (file != NULL && !file->done[1 - index]) ? file->targets[1 - index] : -1;
+		
+		switch(msg.type)
+		{
+			case ACCEPT_MSG:	//It'll claim its file from now on, so it's safe to copy
+				file = malloc(sizeof(spec_file_t));
+				strcpy(file->name, msg.name);
+				file->targets[0] = source;
+				file->targets[1] = copy_to = nodes[source].spare;
+				file->done[0] = file->done[1] = 0;
+				file->winner = -1;
+				file->next = copied;
+				copied = file;
+				offers_waiting--;
+				break;
+			case REFUSE_MSG:	//The node we saved for it is free again
+				nodes[nodes[source].spare].held--;
+				held_total--;
+				offers_waiting--;
+				break;
+			case CLAIM_MSG:	//Whichever copy claims it first wins, and the other one is cancelled
+				if(file != NULL && file->winner < 0)
+				{
+					file->winner = index;
+					cancel = other;
+				}
+				
+				reply_type = (file == NULL || file->winner == index) ? GRANT_MSG : DENY_MSG;
+				break;
+			case DONE_MSG:
+				//It's on to its next file, if it has one
+				nodes[source].held--;
+				nodes[source].busy_since = now_ns();
+				nodes[source].asked = 0;
+				held_total--;
+				
+				//If it was copied, whichever copy finishes first wins too, and only the winner counts the file
+				if(file != NULL)
+				{
+					file->done[index] = 1;
+					
+					if(file->winner < 0)
+					{
+						file->winner = index;
+						cancel = other;
+					}
+					
+					spec_wins += (file->winner == index && index == 1);
+					reply_type = (file->winner == index) ? GRANT_MSG : DENY_MSG;
+				}
+				
+				//Only the winner says how long a file takes (a cancelled copy never finished it, so it never could)
+				if(msg.busy_ns >= 0 && (file == NULL || file->winner == index))
+				{
+					if(sample_count == sample_capacity)
+					{
+						sample_capacity = (sample_capacity > 0) ? sample_capacity * 2 : 1024;
+						samples = realloc(samples, sizeof(long long) * sample_capacity);
+					}
+					
+					samples[sample_count++] = msg.busy_ns;
+				}
+				
+				//The scheduler only ever sent the first copy; if it was cancelled, busy_ns is -1, so its speed isn't learned
+				if(index == 0 && reports_done())
+					sched_file_done(source, msg.file_size, msg.busy_ns);
+				
+				//Once both copies are done, we can forget about it
+				if(file != NULL && file->done[0] && file->done[1])
+				{
+					*link = file->next;
+					free(file);
+				}
+				
+				break;
+		}
+		
+		pthread_mutex_unlock(&table_mutex);
+		
+		if(reply_type >= 0)
+			send_msg(reply_type, msg.name, 0, 0, source, SPEC_REPLY_TAG);
+		
+		if(cancel >= 0)
+			send_msg(CANCEL_MSG, msg.name, 0, 0, cancel, SPEC_REPLY_TAG);
+		
+		if(copy_to >= 0)
+		{
+			send_msg(COPY_MSG, msg.name, msg.file_size, msg.priority, copy_to, SPEC_REPLY_TAG);
+			trace_instant(DISPATCHED_EVENT, msg.name, copy_to);
+			result_log(VERBOSE_FILES, "Copying straggler %s from %d to %d\n", msg.name, source, copy_to);
+			spec_copies++;
+		}
+	}
+	
+	//Nothing more is coming from us either
+	for(int i = 1; i < proc_count; i++)
+		send_msg(END_MSG, NULL, 0, 0, i, SPEC_REPLY_TAG);
+	
+	return NULL;	//We actually don't return anything useful
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* node_thread_func(void *nothing)
+{
+	//We don't actually use the parameter for anything
+	trace_thread_name("speculate");
+	
+	for(;;)
+	{
+		spec_msg_t msg;
+		receive_msg(&msg, CENTRAL, SPEC_REPLY_TAG);
+		
+		if(msg.type == END_MSG)
+			break;
+		
+		pthread_mutex_lock(&node_mutex);
+		
+		switch(msg.type)
+		{
+			case CANCEL_MSG:
+				add_name(&cancelled, msg.name);
+				break;
+			case OFFER_MSG:
+				//Only a plain file we haven't published yet can be copied, and only once; we answer before letting
+				//go of the lock, so the central machine hears about it before our claim or our being done with it
+				if(current[0] != '\0' && !current_published && !current_copied
+					&& !segment_name_valid(current) && !compressed_name_valid(current))
+				{
+					current_copied = 1;
+					send_msg(ACCEPT_MSG, current, current_size, current_priority, CENTRAL, SPEC_TAG);
+				}
+				else
+					send_msg(REFUSE_MSG, NULL, 0, 0, CENTRAL, SPEC_TAG);
+				
+				break;
+			case COPY_MSG:
+				add_name(&copies, msg.name);	//Before it can be dequeued
+				break;
+			case GRANT_MSG:
+			case DENY_MSG:
+				reply = msg.type;
+				pthread_cond_signal(&reply_cond);
+				break;
+		}
+		
+		pthread_mutex_unlock(&node_mutex);
+		
+		if(msg.type == COPY_MSG)
+			enqueue(file_queue, msg.name, msg.file_size, msg.priority);
+	}
+	
+	return NULL;	//We actually don't return anything useful
+}
+
+static int receive_msg(spec_msg_t *msg, int source, int tag)
+{
+	int waiting;
+	MPI_Status status;
+	MPI_Iprobe(source, tag, spec_comm, &waiting, &status);
+	
+	while(!waiting)
+	{
+		struct timespec pause = { 0, SPEC_LISTEN_MS * 1000000L };
+		nanosleep(&pause, NULL);
+		MPI_Iprobe(source, tag, spec_comm, &waiting, &status);
+	}
+	
+	MPI_Recv(msg, sizeof(spec_msg_t), MPI_BYTE, status.MPI_SOURCE, tag, spec_comm, &status);
+	return status.MPI_SOURCE;
+}
+
+static spec_file_t** find_file(char *filename)
+{
+	spec_file_t **link = &copied;
+	
+	while(*link != NULL && strcmp((*link)->name, filename))
+		link = &((*link)->next);
+	
+	return link;
+}
+
+static int find_straggler(long long now, long long threshold)
+{
+	int oldest = 0;
+	
+	for(int i = 1; i < proc_count; i++)
+	{
+		spec_node_t *node = &(nodes[i]);
+		
+		if(node->held == 0 || node->asked || now - node->busy_since <= threshold)
+			continue;
+		
+		if(oldest == 0 || node->busy_since < nodes[oldest].busy_since)
+			oldest = i;
+	}
+	
+	return oldest;
+}
+
+static long long percentile()
+{
+	long long *sorted = malloc(sizeof(long long) * sample_count);
+	memcpy(sorted, samples, sizeof(long long) * sample_count);
+	qsort(sorted, sample_count, sizeof(long long), compare_times);
+	
+	long long time = sorted[(long long) (sample_count - 1) * speculate_pct / 100];
+	free(sorted);
+	return time;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+	long long x = *((const long long*) a), y = *((const long long*) b);
+	return (x > y) - (x < y);
+}
+
+static void send_msg(int type, char *filename, int file_size, int priority, int dest, int tag)
+{
+	spec_msg_t msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = type;
+	msg.file_size = file_size;
+	msg.priority = priority;
+	
+	if(filename != NULL)
+		strncpy(msg.name, filename, FILE_NAME_LEN - 1);
+	
+	MPI_Send(&msg, sizeof(msg), MPI_BYTE, dest, tag, spec_comm);
+}
+
+static void add_name(name_list_t *list, char *filename)
+{
+	if(list->count == list->capacity)
+	{
+		list->capacity = (list->capacity > 0) ? list->capacity * 2 : 16;
+		list->names = realloc(list->names, sizeof(char*) * list->capacity);
+	}
+	
+	list->names[list->count] = malloc(strlen(filename) + 1);
+	strcpy(list->names[list->count++], filename);
+}
+
+static int take_name(name_list_t *list, char *filename)
+{
+	for(int i = 0; i < list->count; i++)
+	{
+		if(!strcmp(list->names[i], filename))
+		{
+			free(list->names[i]);
+			list->names[i] = list->names[--list->count];
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+static void free_names(name_list_t *list)
+{
+	for(int i = 0; i < list->count; i++)
+		free(list->names[i]);
+	
+	free(list->names);
+	list->names = NULL;
+	list->count = list->capacity = 0;
+}
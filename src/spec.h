@@ -0,0 +1,110 @@
+#ifndef SPEC_H_INCLUDED
+#define SPEC_H_INCLUDED
+
+/*
+ * With -speculate <percentile>, the end of a run doesn't have to wait on one
+ * huge or slow-to-read file. The central machine keeps track of how many files
+ * each node has left, and nodes tell it when they finish one, on a
+ * communicator of their own. Once every file has been sent out, when a node
+ * has nothing left to do and another node has been on the same file for
+ * longer than <percentile> percent of finished files took, the central machine
+ * asks the busy node for its file and copies it onto the idle one, at most
+ * once per file. Whichever copy finishes first wins, and the other is
+ * cancelled: a node stops reading a cancelled file at its next chunk, and
+ * skips it if it hasn't started it yet.
+ *
+ * Matches are still published (printed, written to -results and archived)
+ * exactly once. The busy node only hands its file over if it hasn't published
+ * it yet. From then on, both copies have to claim the file from the central
+ * machine before publishing it, and only the first claim is granted. Files
+ * that are never copied never have to be claimed. Likewise, a copied file is
+ * only counted as processed by the copy that won, which each copy hears from
+ * the central machine once it's done. Only plain files are ever copied.
+ * Speculation needs the central machine to send out every file itself, so
+ * it's only used with the default dispatch (not with -hier, -shm, -rma or
+ * -dedup).
+ */
+
+#define SPEC_MIN_SAMPLES 8		//Files that have to finish before we know how long a file usually takes
+#define SPEC_POLL_MS 10			//How often the central machine looks for stragglers once every file has been sent
+#define SPEC_LISTEN_MS 1		//How long a speculation thread sleeps when there's nothing to hear
+
+/* Speculation variables (central machine only) */
+extern long long spec_copies;	//Number of copies of stragglers sent out
+extern long long spec_wins;		//Number of those copies that finished first
+
+/* Speculation functions */
+
+/*
+ * Sets up speculation, starting a thread on every rank to hear from the other
+ * side. Every rank has to call this, before init_central() or init_node().
+ * Params: nothing
+ * Returns: nothing
+ */
+void spec_start();
+
+/*
+ * Notes that a file is about to be sent to a node. Central machine only.
+ * Params: target - the node it's being sent to.
+ * Returns: nothing
+ */
+void spec_dispatched(int target);
+
+/*
+ * Copies stragglers onto idle nodes until every file has finished, then tells
+ * every node there's nothing more coming. Central machine only, once every
+ * file has been sent out but before the nodes are told to stop.
+ * Params: nothing
+ * Returns: nothing
+ */
+void spec_tail();
+
+/*
+ * Notes which file a node is starting, so the central machine can ask for it,
+ * unless it's already been cancelled. Nodes' process threads only.
+ * Params: filename - the full path to the file.
+ *         file_size - its size.
+ *         priority - its priority.
+ * Returns: 1 if the file was cancelled and shouldn't be processed; 0
+ *          otherwise.
+ */
+int spec_begin(char *filename, int file_size, int priority);
+
+/*
+ * Checks whether the file a node is processing has been cancelled. Nodes'
+ * process threads only.
+ * Params: filename - the full path to the file.
+ * Returns: 1 if it has; 0 otherwise.
+ */
+int spec_cancelled(char *filename);
+
+/*
+ * Claims the right to publish a file's match, asking the central machine if
+ * the file might have been copied. Nodes' process threads only.
+ * Params: filename - the full path to the file.
+ * Returns: 1 if this copy should publish it; 0 if another copy already has.
+ */
+int spec_claim(char *filename);
+
+/*
+ * Tells the central machine a node is done with a file (processed, cancelled
+ * or skipped). If the file was copied, waits to hear which copy won. Nodes'
+ * process threads only.
+ * Params: filename - the full path to the file.
+ *         file_size - its size.
+ *         busy_ns - how long the node spent on it, or -1 if it was cancelled
+ *         or skipped.
+ * Returns: 1 if this node should count the file as processed (it was never
+ *          copied, or this copy won); 0 otherwise.
+ */
+int spec_done(char *filename, int file_size, long long busy_ns);
+
+/*
+ * Frees everything spec_start() set up. Every rank has to call this, after
+ * its process or archive thread has finished.
+ * Params: nothing
+ * Returns: nothing
+ */
+void spec_stop();
+
+#endif //SPEC_H_INCLUDED
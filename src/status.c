@@ -0,0 +1,298 @@
+#include <mpi.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "node.h"
+#include "sched.h"
+#include "shmq.h"
+#include "status.h"
+#include "trace.h"
+#include "univ.h"
+
+/* What a node's counters message holds */
+enum {
+	PROCESSED_COUNTER,	//Files processed
+	BYTES_COUNTER,		//Bytes processed
+	QUEUE_COUNTER,		//Files waiting in its queue
+	ARCHIVED_COUNTER,	//Files it archived
+	DONE_COUNTER,		//1 if it's the node's last message; 0 otherwise
+	NUM_COUNTERS
+};
+
+/* Defines what the central machine knows about a node */
+typedef struct _node_status_t {
+	long long counters[NUM_COUNTERS];	//The node's last counters
+	double updated;						//When we got them
+	double bytes_per_sec;				//How fast it processed bytes between its last two messages
+} node_status_t;
+
+/* Static function prototypes */
+
+/*
+ * The function the status thread should run. On the central machine, answers
+ * connections and keeps track of nodes' counters; on nodes, sends their
+ * counters every STATUS_INTERVAL_MS.
+ * Params: nothing - should always be NULL.
+ * Returns: NULL every time.
+ */
+static void* status_thread_func(void *nothing);
+
+/*
+ * Receives every counters message that's waiting. Central machine only.
+ * Params: nothing
+ * Returns: nothing
+ */
+static void receive_counters();
+
+/*
+ * Sends our counters to the central machine. Nodes only.
+ * Params: done - 1 if it's our last message; 0 otherwise.
+ * Returns: nothing
+ */
+static void send_counters(int done);
+
+/*
+ * Writes a JSON snapshot of the run to a connection, then closes it. Central
+ * machine only.
+ * Params: fd - the connection.
+ * Returns: nothing
+ */
+static void write_snapshot(int fd);
+
+/* Static variables */
+static MPI_Comm status_comm = MPI_COMM_NULL;	//Communicator nodes send their counters on
+static pthread_t status_thread;					//Thread that listens (central) or sends counters (nodes)
+static int listen_fd = -1;						//The socket we listen on
+static node_status_t *nodes = NULL;				//What we know about each node, indexed by rank
+static int nodes_done = 0;						//Number of nodes that sent their last message
+static double start_time;						//When we started
+static int stopping = 0;						//1 once status_stop() has been called; 0 before
+static pthread_mutex_t stop_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects stopping
+static pthread_cond_t stop_cond = PTHREAD_COND_INITIALIZER;		//Signaled when stopping is set
+
+void status_start()
+{
+	MPI_Comm_dup(MPI_COMM_WORLD, &status_comm);
+	start_time = MPI_Wtime();
+	
+	if(proc_id == CENTRAL)
+	{
+		nodes = calloc(proc_count, sizeof(node_status_t));
+		
+		//Listen on the socket, replacing whatever a previous run left there
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, status_path, sizeof(addr.sun_path) - 1);
+		unlink(status_path);
+		
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		
+		if(listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) || listen(listen_fd, 8))
+		{
+			fprintf(stderr, "Couldn't listen on %s, so there won't be a status endpoint\n", status_path);
+			
+			if(listen_fd >= 0)
+				close(listen_fd);
+			
+			listen_fd = -1;
+		}
+	}
+	
+	pthread_create(&status_thread, NULL, status_thread_func, NULL);
+}
+
+void status_stop()
+{
+	pthread_mutex_lock(&stop_mutex);
+	stopping = 1;
+	pthread_cond_broadcast(&stop_cond);
+	pthread_mutex_unlock(&stop_mutex);
+	
+	pthread_join(status_thread, NULL);
+	
+	if(proc_id == CENTRAL)
+	{
+		if(listen_fd >= 0)
+		{
+			close(listen_fd);
+			unlink(status_path);
+		}
+		
+		free(nodes);
+		nodes = NULL;
+	}
+	else
+		send_counters(1);	//Our counters are final now
+	
+	MPI_Comm_free(&status_comm);
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* status_thread_func(void *nothing)
+{
+	//We don't actually use the parameter for anything
+	trace_thread_name("status");
+	
+	if(proc_id == CENTRAL)
+	{
+		//Keep answering until we've been told to stop and every node has sent its last message
+		for(;;)
+		{
+			receive_counters();
+			
+			pthread_mutex_lock(&stop_mutex);
+			int stop = stopping;
+			pthread_mutex_unlock(&stop_mutex);
+			
+			if(stop && nodes_done == proc_count - 1)
+				break;
+			
+			//Wait a little for a connection
+			if(listen_fd < 0)
+			{
+				struct timespec pause = { 0, STATUS_POLL_MS * 1000000L };
+				nanosleep(&pause, NULL);
+				continue;
+			}
+			
+			struct pollfd pfd = { listen_fd, POLLIN, 0 };
+			
+			if(poll(&pfd, 1, STATUS_POLL_MS) > 0)
+			{
+				int fd = accept(listen_fd, NULL, NULL);
+				
+				if(fd >= 0)
+					write_snapshot(fd);
+			}
+		}
+	}
+	else
+	{
+		//Send our counters every interval until we're told to stop
+		pthread_mutex_lock(&stop_mutex);
+		
+		while(!stopping)
+		{
+			struct timespec wake;
+			clock_gettime(CLOCK_REALTIME, &wake);
+			wake.tv_sec += STATUS_INTERVAL_MS / 1000;
+			wake.tv_nsec += (STATUS_INTERVAL_MS % 1000) * 1000000L;
+			
+			if(wake.tv_nsec >= 1000000000L)
+			{
+				wake.tv_sec++;
+				wake.tv_nsec -= 1000000000L;
+			}
+			
+			if(pthread_cond_timedwait(&stop_cond, &stop_mutex, &wake) != 0 && !stopping)
+			{
+				pthread_mutex_unlock(&stop_mutex);
+				send_counters(0);
+				pthread_mutex_lock(&stop_mutex);
+			}
+		}
+		
+		pthread_mutex_unlock(&stop_mutex);
+	}
+	
+	return NULL;	//We actually don't return anything useful
+}
+
+static void receive_counters()
+{
+	int waiting;
+	MPI_Status status;
+	MPI_Iprobe(MPI_ANY_SOURCE, PROGRESS_TAG, status_comm, &waiting, &status);
+	
+	while(waiting)
+	{
+		node_status_t *node = &(nodes[status.MPI_SOURCE]);
+		long long counters[NUM_COUNTERS];
+		MPI_Recv(counters, NUM_COUNTERS, MPI_LONG_LONG, status.MPI_SOURCE, PROGRESS_TAG, status_comm, &status);
+		
+		//Work out how fast it's been going since its last message
+		double now = MPI_Wtime() - start_time;
+		
+		if(now > node->updated)
+			node->bytes_per_sec = (counters[BYTES_COUNTER] - node->counters[BYTES_COUNTER]) / (now - node->updated);
+		
+		memcpy(node->counters, counters, sizeof(counters));
+		node->updated = now;
+		nodes_done += counters[DONE_COUNTER];
+		
+		MPI_Iprobe(MPI_ANY_SOURCE, PROGRESS_TAG, status_comm, &waiting, &status);
+	}
+}
+
+static void send_counters(int done)
+{
+	long long counters[NUM_COUNTERS];
+	counters[PROCESSED_COUNTER] = files_processed;
+	counters[BYTES_COUNTER] = bytes_processed;
+	counters[ARCHIVED_COUNTER] = files_archived;
+	counters[DONE_COUNTER] = done;
+	
+	//With shared queues, the host leader reports the host's queue
+	if(shm_enabled)
+		counters[QUEUE_COUNTER] = is_host_leader ? shm_length() : 0;
+	else
+		counters[QUEUE_COUNTER] = queue_size(file_queue);
+	
+	MPI_Send(counters, NUM_COUNTERS, MPI_LONG_LONG, CENTRAL, PROGRESS_TAG, status_comm);
+}
+
+static void write_snapshot(int fd)
+{
+	double elapsed = MPI_Wtime() - start_time;
+	long long processed = 0, bytes = 0, queued = 0, archived = files_archived;
+	
+	for(int i = 1; i < proc_count; i++)
+	{
+		processed += nodes[i].counters[PROCESSED_COUNTER];
+		bytes += nodes[i].counters[BYTES_COUNTER];
+		queued += nodes[i].counters[QUEUE_COUNTER];
+		archived += nodes[i].counters[ARCHIVED_COUNTER];
+	}
+	
+	//Nodes claim their own files with -rma, so what they've been sent is what they've processed or queued
+	long long dispatched = rma_enabled ? processed + queued : files_dispatched;
+	
+	//Build the snapshot first, so a client that hangs up early can't stop us partway through
+	char *json;
+	size_t len;
+	FILE *out = open_memstream(&json, &len);
+	
+	fprintf(out, "{\"elapsed\": %.3f, \"scanned\": %d, \"dispatched\": %lld, \"processed\": %lld, \"archived\": %lld, ",
+		elapsed, files_scanned, dispatched, processed, archived);
+	fprintf(out, "\"bytes_per_sec\": %.1f, \"eta_seconds\": ", (elapsed > 0) ? bytes / elapsed : 0);
+	
+	if(processed > 0)
+		fprintf(out, "%.1f", (files_scanned - processed) * (elapsed / processed));
+	else
+		fprintf(out, "null");
+	
+	fprintf(out, ", \"nodes\": [");
+	
+	for(int i = 1; i < proc_count; i++)
+	{
+		node_status_t *node = &(nodes[i]);
+		fprintf(out, "%s{\"rank\": %d, \"processed\": %lld, \"bytes\": %lld, \"queue\": %lld, \"archived\": %lld, \"bytes_per_sec\": %.1f}",
+			(i > 1) ? ", " : "", i, node->counters[PROCESSED_COUNTER], node->counters[BYTES_COUNTER],
+			node->counters[QUEUE_COUNTER], node->counters[ARCHIVED_COUNTER], node->bytes_per_sec);
+	}
+	
+	fprintf(out, "]}\n");
+	fclose(out);
+	
+	send(fd, json, len, MSG_NOSIGNAL);
+	free(json);
+	close(fd);
+}
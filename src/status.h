@@ -0,0 +1,42 @@
+#ifndef STATUS_H_INCLUDED
+#define STATUS_H_INCLUDED
+
+/*
+ * With -status <path>, the central machine listens on a UNIX-domain socket at
+ * <path> while it runs. Anything that connects gets a JSON snapshot of how the
+ * run is going, then the connection is closed:
+ *
+ *   {"elapsed": s, "scanned": n, "dispatched": n, "processed": n,
+ *    "archived": n, "bytes_per_sec": x, "eta_seconds": s or null,
+ *    "nodes": [{"rank": r, "processed": n, "bytes": n, "queue": n,
+ *               "archived": n, "bytes_per_sec": x}, ...]}
+ *
+ * e.g. with socat - UNIX-CONNECT:<path>. Every node sends its counters to the
+ * central machine every STATUS_INTERVAL_MS on a communicator of their own. The
+ * ETA is for the files found so far, at the rate they've been processed.
+ */
+
+#define STATUS_INTERVAL_MS 1000	//How often nodes send their counters
+#define STATUS_POLL_MS 100		//How long the central machine waits for a connection before checking for counters
+
+/* Status functions */
+
+/*
+ * Starts listening for connections on the central machine, and sending
+ * counters on nodes. Every rank has to call this, after init_central() or
+ * init_node().
+ * Params: nothing
+ * Returns: nothing
+ */
+void status_start();
+
+/*
+ * Stops everything status_start() started. Nodes send their last counters;
+ * the central machine waits for every node's, then stops listening. Every rank
+ * has to call this, once it's done its work but before it cleans up.
+ * Params: nothing
+ * Returns: nothing
+ */
+void status_stop();
+
+#endif //STATUS_H_INCLUDED
@@ -0,0 +1,228 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timing.h"
+#include "univ.h"
+
+/* Defines one thread's timings in a list of every thread's timings */
+typedef struct _thread_timing_t {
+	timing_t timing;
+	struct _thread_timing_t *next;
+} thread_timing_t;
+
+/* Static function prototypes */
+
+/*
+ * Gets the histogram bucket a time belongs in. Buckets are a power of two
+ * wide, split into TIMING_SUB_BUCKETS linear pieces.
+ * Params: ns - the time in nanoseconds.
+ * Returns: the index of the bucket.
+ */
+static int bucket_of(long long ns);
+
+/*
+ * Gets the largest time a histogram bucket can hold.
+ * Params: bucket - the index of the bucket.
+ * Returns: the largest time in nanoseconds.
+ */
+static long long bucket_max(int bucket);
+
+/*
+ * Gets a percentile of a phase's times from its histogram.
+ * Params: stats - the phase's timings.
+ *         percentile - the percentile, in (0, 1].
+ * Returns: the percentile in nanoseconds.
+ */
+static long long phase_percentile(phase_stats_t *stats, double percentile);
+
+/* timing.h extern variables */
+int timing_enabled = 0;
+
+/* Static variables */
+static const char *phase_names[NUM_PHASES] = { "scan", "dispatch", "queue_wait", "parse", "archive", "prefetch" };
+static __thread thread_timing_t *local_timing = NULL;	//This thread's timings
+static thread_timing_t *all_timings = NULL;				//Every thread's timings
+static pthread_mutex_t timings_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects all_timings
+
+long long timing_start()
+{
+	if(!timing_enabled)
+		return 0;
+	
+	return now_ns();
+}
+
+long long timing_stop(int phase, long long start)
+{
+	if(!timing_enabled)
+		return 0;
+	
+	long long now = timing_start();
+	long long ns = now - start;
+	
+	//If this is the first time this thread has timed anything, give it its own timings
+	if(local_timing == NULL)
+	{
+		local_timing = malloc(sizeof(thread_timing_t));
+		init_timing(&(local_timing->timing));
+		
+		pthread_mutex_lock(&timings_mutex);
+		local_timing->next = all_timings;
+		all_timings = local_timing;
+		pthread_mutex_unlock(&timings_mutex);
+	}
+	
+	//Then record it
+	phase_stats_t *stats = &(local_timing->timing.phases[phase]);
+	stats->count++;
+	stats->total_ns += ns;
+	stats->buckets[bucket_of(ns)]++;
+	
+	if(ns < stats->min_ns)
+		stats->min_ns = ns;
+	
+	if(ns > stats->max_ns)
+		stats->max_ns = ns;
+	
+	return now;
+}
+
+void init_timing(timing_t *timing)
+{
+	memset(timing, 0, sizeof(timing_t));
+	
+	for(int i = 0; i < NUM_PHASES; i++)
+		timing->phases[i].min_ns = LLONG_MAX;
+}
+
+void timing_merge_threads(timing_t *timing)
+{
+	pthread_mutex_lock(&timings_mutex);
+	
+	for(thread_timing_t *t = all_timings; t != NULL; t = t->next)
+	{
+		for(int i = 0; i < NUM_PHASES; i++)
+		{
+			phase_stats_t *from = &(t->timing.phases[i]), *to = &(timing->phases[i]);
+			to->count += from->count;
+			to->total_ns += from->total_ns;
+			
+			if(from->min_ns < to->min_ns)
+				to->min_ns = from->min_ns;
+			
+			if(from->max_ns > to->max_ns)
+				to->max_ns = from->max_ns;
+			
+			for(int j = 0; j < TIMING_BUCKETS; j++)
+				to->buckets[j] += from->buckets[j];
+		}
+	}
+	
+	pthread_mutex_unlock(&timings_mutex);
+}
+
+void timing_write_json(FILE *file, timing_t *timing, long long *rank_totals, int num_ranks)
+{
+	fprintf(file, "{\n  \"ranks\": %d,\n  \"phases\": {\n", num_ranks);
+	
+	for(int i = 0; i < NUM_PHASES; i++)
+	{
+		phase_stats_t *stats = &(timing->phases[i]);
+		
+		//Get the min, max and mean of this phase's total time per rank that ran it
+		long long rank_min = LLONG_MAX, rank_max = 0, rank_sum = 0;
+		int ranks = 0;
+		
+		for(int r = 0; r < num_ranks; r++)
+		{
+			long long total = rank_totals[r * NUM_PHASES + i];
+			
+			if(total == 0)
+				continue;
+			
+			ranks++;
+			rank_sum += total;
+			
+			if(total < rank_min)
+				rank_min = total;
+			
+			if(total > rank_max)
+				rank_max = total;
+		}
+		
+		long long count = stats->count;
+		
+		fprintf(file, "    \"%s\": {\"count\": %lld, \"total_s\": %.9f, \"min_us\": %.3f, \"max_us\": %.3f, \"mean_us\": %.3f, \"p99_us\": %.3f, "
+			"\"rank_total_s\": {\"ranks\": %d, \"min\": %.9f, \"max\": %.9f, \"mean\": %.9f}}%s\n",
+			phase_names[i], count, stats->total_ns / 1e9,
+			(count > 0) ? stats->min_ns / 1e3 : 0, stats->max_ns / 1e3,
+			(count > 0) ? (double) stats->total_ns / count / 1e3 : 0,
+			phase_percentile(stats, 0.99) / 1e3,
+			ranks, (ranks > 0) ? rank_min / 1e9 : 0, rank_max / 1e9,
+			(ranks > 0) ? (double) rank_sum / ranks / 1e9 : 0,
+			(i < NUM_PHASES - 1) ? "," : "");
+	}
+	
+	fprintf(file, "  }\n}\n");
+}
+
+void timing_cleanup()
+{
+	pthread_mutex_lock(&timings_mutex);
+	
+	while(all_timings != NULL)
+	{
+		thread_timing_t *next = all_timings->next;
+		free(all_timings);
+		all_timings = next;
+	}
+	
+	pthread_mutex_unlock(&timings_mutex);
+	local_timing = NULL;
+}
+
+static int bucket_of(long long ns)
+{
+	if(ns < TIMING_SUB_BUCKETS)
+		return (ns < 0) ? 0 : (int) ns;	//Small times get a bucket each
+	
+	//Find the power of two, then which linear piece of it we're in
+	int log = 63 - __builtin_clzll((unsigned long long) ns);
+	int sub = (int) ((ns >> (log - 3)) & (TIMING_SUB_BUCKETS - 1));
+	return (log - 2) * TIMING_SUB_BUCKETS + sub;
+}
+
+static long long bucket_max(int bucket)
+{
+	if(bucket < TIMING_SUB_BUCKETS)
+		return bucket;
+	
+	int log = bucket / TIMING_SUB_BUCKETS + 2;
+	int sub = bucket % TIMING_SUB_BUCKETS;
+	return ((long long) (TIMING_SUB_BUCKETS + sub + 1) << (log - 3)) - 1;
+}
+
+static long long phase_percentile(phase_stats_t *stats, double percentile)
+{
+	if(stats->count == 0)
+		return 0;
+	
+	//Walk the histogram until we've seen enough times
+	long long wanted = (long long) (stats->count * percentile + 0.5), seen = 0;
+	
+	if(wanted < 1)
+		wanted = 1;
+	
+	for(int i = 0; i < TIMING_BUCKETS; i++)
+	{
+		seen += stats->buckets[i];
+		
+		//Don't report a percentile past the slowest time we actually saw
+		if(seen >= wanted)
+			return (bucket_max(i) < stats->max_ns) ? bucket_max(i) : stats->max_ns;
+	}
+	
+	return stats->max_ns;
+}
@@ -0,0 +1,88 @@
+#ifndef TIMING_H_INCLUDED
+#define TIMING_H_INCLUDED
+
+#include <stdio.h>
+
+#define TIMING_SUB_BUCKETS 8								//Histogram buckets per power of two
+#define TIMING_BUCKETS (64 * TIMING_SUB_BUCKETS)		//Histogram buckets per phase
+
+/* Phases we time */
+enum {
+	SCAN_PHASE,			//Finding a file in enqueue_all_files()
+	DISPATCH_PHASE,		//Picking a node for a file and sending it there
+	QUEUE_WAIT_PHASE,	//Waiting for a file in dequeue_wait()
+	PARSE_PHASE,		//Running process() on a file
+	ARCHIVE_PHASE,		//Running move_file() on a file
+	PREFETCH_PHASE,		//Telling the kernel to read ahead the next files in a queue
+	NUM_PHASES
+};
+
+/* Defines the timings of a single phase */
+typedef struct _phase_stats_t {
+	long long count;					//Number of times this phase ran
+	long long total_ns;					//Total time spent in this phase
+	long long min_ns;					//Shortest time this phase took
+	long long max_ns;					//Longest time this phase took
+	long long buckets[TIMING_BUCKETS];	//Log-linear histogram of times, for percentiles
+} phase_stats_t;
+
+/* Defines the timings of every phase */
+typedef struct _timing_t {
+	phase_stats_t phases[NUM_PHASES];
+} timing_t;
+
+/* Timing variables */
+extern int timing_enabled;	//1 if we're timing phases; 0 otherwise
+
+/* Timing functions */
+
+/*
+ * Gets the time to start timing a phase at.
+ * Params: nothing
+ * Returns: the monotonic clock in nanoseconds, or 0 if timing is disabled.
+ */
+long long timing_start();
+
+/*
+ * Records that a phase finished running. Each thread records into its own
+ * timing_t, so this never takes a lock after a thread's first call.
+ * Params: phase - the phase that finished.
+ *         start - what timing_start() returned when the phase started.
+ * Returns: the monotonic clock in nanoseconds, so phases can be chained.
+ */
+long long timing_stop(int phase, long long start);
+
+/*
+ * Initializes a timing_t so it can be merged into.
+ * Params: timing - the timing_t to initialize.
+ * Returns: nothing
+ */
+void init_timing(timing_t *timing);
+
+/*
+ * Merges the timings of every thread in this process.
+ * Params: timing - a timing_t to merge into, already initialized.
+ * Returns: nothing
+ */
+void timing_merge_threads(timing_t *timing);
+
+/*
+ * Writes a timing summary as JSON: the count, min, max, mean and p99 of each
+ * phase over every run of it, plus the min, max and mean of each phase's total
+ * per rank that ran it.
+ * Params: file - the file to write to.
+ *         timing - the timings merged over every rank.
+ *         rank_totals - each rank's total time per phase, rank-major.
+ *         num_ranks - the number of ranks in rank_totals.
+ * Returns: nothing
+ */
+void timing_write_json(FILE *file, timing_t *timing, long long *rank_totals, int num_ranks);
+
+/*
+ * Frees every thread's timings.
+ * Params: nothing
+ * Returns: nothing
+ */
+void timing_cleanup();
+
+#endif //TIMING_H_INCLUDED
@@ -0,0 +1,253 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "result.h"
+#include "trace.h"
+#include "univ.h"
+
+/* Defines a single traced event */
+typedef struct _trace_event_t {
+	long long ts;				//When the event happened, in nanoseconds since the trace clock started
+	long long dur;				//How long a span lasted in nanoseconds, or -1 for instant events
+	int type;					//Type of event
+	int peer;					//Rank or worker on the other end, or -1
+	char file[TRACE_NAME_LEN];	//Name of the file the event is about, without its directory
+} trace_event_t;
+
+/* Defines one thread's ring buffer of events */
+typedef struct _trace_ring_t {
+	trace_event_t events[TRACE_RING_SIZE];	//Events, oldest overwritten first
+	unsigned long long head;				//Number of events ever recorded
+	int tid;								//Track number of this thread
+	char name[32];							//Name of this thread's track
+	struct _trace_ring_t *next;				//Next thread's ring buffer
+} trace_ring_t;
+
+/* Defines a growable buffer rendered events go into */
+typedef struct _trace_buf_t {
+	char *data;		//Buffer contents
+	size_t len;		//Number of bytes used
+	size_t cap;		//Number of bytes allocated
+} trace_buf_t;
+
+/* Static function prototypes */
+
+/*
+ * Gets the calling thread's ring buffer, creating it if it doesn't have one.
+ * Params: nothing
+ * Returns: the calling thread's ring buffer.
+ */
+static trace_ring_t* local_ring();
+
+/*
+ * Records an event into the calling thread's ring buffer.
+ * Params: type - the type of event.
+ *         filename - the file the event is about, or NULL.
+ *         peer - the rank or worker on the other end, or -1.
+ *         ts - when the event happened, on the monotonic clock.
+ *         dur - how long a span lasted, or -1 for instant events.
+ * Returns: nothing
+ */
+static void record(int type, char *filename, int peer, long long ts, long long dur);
+
+/*
+ * Appends formatted text to a buffer, growing it if needed.
+ * Params: buf - the buffer to append to.
+ *         fmt - a printf() format string, followed by its arguments.
+ * Returns: nothing
+ */
+static void buf_printf(trace_buf_t *buf, const char *fmt, ...);
+
+/* trace.h extern variables */
+int trace_enabled = 0;
+
+/* Static variables */
+static const char *event_names[NUM_EVENTS] = { "scanned", "dispatched", "received", "dequeued",
+	"parse", "matched", "archive", "MPI_Send", "MPI_Recv", "prefetch" };
+static long long epoch = 0;							//Monotonic time the trace clock started at
+static __thread trace_ring_t *ring = NULL;			//This thread's ring buffer
+static trace_ring_t *all_rings = NULL;				//Every thread's ring buffer
+static int num_rings = 0;							//Number of ring buffers in all_rings
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects all_rings and num_rings
+
+void trace_start_clock()
+{
+	epoch = trace_now();
+}
+
+void trace_thread_name(const char *name)
+{
+	if(!trace_enabled)
+		return;
+	
+	trace_ring_t *r = local_ring();
+	strncpy(r->name, name, sizeof(r->name) - 1);
+	r->name[sizeof(r->name) - 1] = '\0';
+}
+
+long long trace_now()
+{
+	if(!trace_enabled)
+		return 0;
+	
+	return now_ns();
+}
+
+void trace_instant(int type, char *filename, int peer)
+{
+	if(!trace_enabled)
+		return;
+	
+	record(type, filename, peer, trace_now(), -1);
+}
+
+void trace_span(int type, char *filename, int peer, long long start)
+{
+	if(!trace_enabled)
+		return;
+	
+	record(type, filename, peer, start, trace_now() - start);
+}
+
+char* trace_render(int pid, size_t *len)
+{
+	trace_buf_t buf = { malloc(4096), 0, 4096 };
+	buf.data[0] = '\0';
+	
+	//Name this process's track group
+	buf_printf(&buf, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}", pid, pid);
+	
+	pthread_mutex_lock(&rings_mutex);
+	
+	for(trace_ring_t *r = all_rings; r != NULL; r = r->next)
+	{
+		//Name this thread's track, and say if we lost events off the end of its ring
+		unsigned long long first = (r->head > TRACE_RING_SIZE) ? r->head - TRACE_RING_SIZE : 0;
+		buf_printf(&buf, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\",\"dropped\":%llu}}",
+			pid, r->tid, r->name, first);
+		
+		//Then write every event still in the ring, oldest first
+		for(unsigned long long i = first; i < r->head; i++)
+		{
+			trace_event_t *e = &(r->events[i % TRACE_RING_SIZE]);
+			
+			buf_printf(&buf, ",\n{\"name\":\"%s\",\"cat\":\"fsch\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+				event_names[e->type], pid, r->tid, e->ts / 1e3);
+			
+			if(e->dur >= 0)
+				buf_printf(&buf, "\"ph\":\"X\",\"dur\":%.3f,", e->dur / 1e3);
+			else
+				buf_printf(&buf, "\"ph\":\"i\",\"s\":\"t\",");
+			
+			//File names can have anything in them (quotes, backslashes, control characters), so escape them
+			char file[6 * TRACE_NAME_LEN + 2];
+			file[result_json_string(file, e->file, strlen(e->file))] = '\0';
+			buf_printf(&buf, "\"args\":{\"file\":%s,\"peer\":%d}}", file, e->peer);
+		}
+	}
+	
+	pthread_mutex_unlock(&rings_mutex);
+	
+	*len = buf.len;
+	return buf.data;
+}
+
+void trace_write(FILE *file, char *events, int *lens, int num_lists)
+{
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	
+	for(int i = 0; i < num_lists; i++)
+	{
+		if(i > 0)
+			fprintf(file, ",\n");
+		
+		fwrite(events, 1, lens[i], file);
+		events += lens[i];
+	}
+	
+	fprintf(file, "\n]}\n");
+}
+
+void trace_cleanup()
+{
+	pthread_mutex_lock(&rings_mutex);
+	
+	while(all_rings != NULL)
+	{
+		trace_ring_t *next = all_rings->next;
+		free(all_rings);
+		all_rings = next;
+	}
+	
+	num_rings = 0;
+	pthread_mutex_unlock(&rings_mutex);
+	ring = NULL;
+}
+
+static trace_ring_t* local_ring()
+{
+	//If this is the first time this thread has traced anything, give it its own ring buffer
+	if(ring == NULL)
+	{
+		ring = malloc(sizeof(trace_ring_t));
+		ring->head = 0;
+		
+		pthread_mutex_lock(&rings_mutex);
+		ring->tid = num_rings++;
+		snprintf(ring->name, sizeof(ring->name), "thread %d", ring->tid);
+		ring->next = all_rings;
+		all_rings = ring;
+		pthread_mutex_unlock(&rings_mutex);
+	}
+	
+	return ring;
+}
+
+static void record(int type, char *filename, int peer, long long ts, long long dur)
+{
+	trace_ring_t *r = local_ring();
+	trace_event_t *e = &(r->events[r->head % TRACE_RING_SIZE]);
+	
+	e->ts = ts - epoch;
+	e->dur = dur;
+	e->type = type;
+	e->peer = peer;
+	e->file[0] = '\0';
+	
+	//Keep just the file's name, which is all that fits (and all that's interesting)
+	if(filename != NULL)
+	{
+		char *name = strrchr(filename, '/');
+		strncpy(e->file, (name != NULL) ? name + 1 : filename, TRACE_NAME_LEN - 1);
+		e->file[TRACE_NAME_LEN - 1] = '\0';
+	}
+	
+	r->head++;
+}
+
+static void buf_printf(trace_buf_t *buf, const char *fmt, ...)
+{
+	va_list args;
+	
+	//Try to print into what's left of the buffer
+	va_start(args, fmt);
+	int len = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+	va_end(args);
+	
+	//If it didn't fit, grow the buffer and try again
+	if(buf->len + len + 1 > buf->cap)
+	{
+		while(buf->len + len + 1 > buf->cap)
+			buf->cap *= 2;
+		
+		buf->data = realloc(buf->data, buf->cap);
+		
+		va_start(args, fmt);
+		vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, args);
+		va_end(args);
+	}
+	
+	buf->len += len;
+}
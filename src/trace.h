@@ -0,0 +1,100 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdio.h>
+
+#define TRACE_RING_SIZE 65536	//Events each thread keeps; the oldest are overwritten past this
+#define TRACE_NAME_LEN 32		//Characters of a file's name each event keeps
+
+/* Events we trace */
+enum {
+	SCANNED_EVENT,		//The central machine found a file
+	DISPATCHED_EVENT,	//The central machine sent a file to a node
+	RECEIVED_EVENT,		//A node received a file
+	DEQUEUED_EVENT,		//A node took a file off its queue
+	PARSE_EVENT,		//A node ran process() on a file (span)
+	MATCHED_EVENT,		//process() found the search key in a file
+	ARCHIVE_EVENT,		//A file was moved to the archive directory (span)
+	MPI_SEND_EVENT,		//An MPI send (span)
+	MPI_RECV_EVENT,		//An MPI receive (span)
+	PREFETCH_EVENT,		//A node told the kernel to read ahead a file it's about to process
+	NUM_EVENTS
+};
+
+/* Trace variables */
+extern int trace_enabled;	//1 if we're tracing; 0 otherwise
+
+/* Trace functions */
+
+/*
+ * Starts the trace clock. Every timestamp is relative to this, so every rank
+ * should call it at the same time (e.g. right after a barrier).
+ * Params: nothing
+ * Returns: nothing
+ */
+void trace_start_clock();
+
+/*
+ * Names the calling thread's track in the trace.
+ * Params: name - the name of the track.
+ * Returns: nothing
+ */
+void trace_thread_name(const char *name);
+
+/*
+ * Gets the time to start a span at.
+ * Params: nothing
+ * Returns: the monotonic clock in nanoseconds, or 0 if tracing is disabled.
+ */
+long long trace_now();
+
+/*
+ * Records an instant event into the calling thread's ring buffer. Only the
+ * calling thread ever writes its ring, so this never takes a lock after a
+ * thread's first event.
+ * Params: type - the type of event.
+ *         filename - the file the event is about, or NULL.
+ *         peer - the rank or worker on the other end, or -1.
+ * Returns: nothing
+ */
+void trace_instant(int type, char *filename, int peer);
+
+/*
+ * Records a span event that started at start and ends now.
+ * Params: type - the type of event.
+ *         filename - the file the event is about, or NULL.
+ *         peer - the rank or worker on the other end, or -1.
+ *         start - what trace_now() returned when the span started.
+ * Returns: nothing
+ */
+void trace_span(int type, char *filename, int peer, long long start);
+
+/*
+ * Renders every thread's events in this process as Chrome trace events. The
+ * result is a comma-separated list, so lists from several processes can be
+ * joined with commas into one trace.
+ * Params: pid - the process (rank) the events belong to.
+ *         len - a single size_t buffer that will contain the length of the
+ *         result on return.
+ * Returns: a malloc()'d string of events.
+ */
+char* trace_render(int pid, size_t *len);
+
+/*
+ * Writes a Chrome trace file made of event lists from trace_render().
+ * Params: file - the file to write to.
+ *         events - the event lists, one after another.
+ *         lens - the length of each event list.
+ *         num_lists - the number of event lists.
+ * Returns: nothing
+ */
+void trace_write(FILE *file, char *events, int *lens, int num_lists);
+
+/*
+ * Frees every thread's ring buffer.
+ * Params: nothing
+ * Returns: nothing
+ */
+void trace_cleanup();
+
+#endif //TRACE_H_INCLUDED
@@ -0,0 +1,307 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "agg.h"
+#include "dedup.h"
+#include "prefetch.h"
+#include "query.h"
+#include "result.h"
+#include "sched.h"
+#include "sla.h"
+#include "timing.h"
+#include "trace.h"
+#include "univ.h"
+#include "walk.h"
+
+#define PRINT_USAGE(prog) fprintf(stderr, \
+	  "************************************** \
+	 \n** MATH 4777 Project File Scheduler ** \
+	 \n************************************** \
+	 \nUsage: %s <file directory> <archive directory> <search key> [scheduling algorithm] [priority options] [options] \
+	 \n Scheduling algorithms: \
+	 \n   -c  = Cyclic distribution (default) \
+	 \n   -b  = Block distribution \
+	 \n   -r  = Random distribution \
+	 \n   -qs = Queue size distribution \
+	 \n   -ql = Queue length distribution \
+	 \n Priority options: \
+	 \n   -n  = No priority (default) \
+	 \n   -op = Oldest files given priority \
+	 \n   -edf = Earliest deadline first, sending each file to the node expected to finish it soonest \
+	 \n Options: \
+	 \n   -agg <key>       = Print the count, sum, min and max of <key> per sensor per time bucket instead of each match \
+	 \n   -bind <core|numa> = Pin each thread to a CPU (core) or to that CPU's NUMA node (numa), spreading ranks across the host \
+	 \n   -bucket <secs>   = Width of an -agg time bucket in seconds (default: 3600) \
+	 \n   -cpus <list>     = Only use these CPUs, e.g. 0-7,16-23 (implies -bind core unless -bind is given) \
+	 \n   -hier            = Group nodes by host under sub-coordinators that schedule locally (fsch only) \
+	 \n   -dedup           = Only parse and print one copy of files with identical contents (copies are still archived) \
+	 \n   -group <nodes>   = With -hier, split each host into groups of at most <nodes> nodes \
+	 \n   -claim <files>   = With -rma, files a node claims at a time (default: 16) \
+	 \n   -chunk <files>   = With -hier, most files handed to a sub-coordinator at a time (default: 256) \
+	 \n   -credits <files> = Only send a node more files while it has fewer than <files> queued or in progress \
+	 \n   -creditbytes <bytes> = Only send a node more files while it has fewer than <bytes> queued or in progress \
+	 \n   -format <ndjson|binary> = Format to write -results in (default: ndjson) \
+	 \n   -layout inode|extent = Order files with the same priority by inode number or by where they are on disk, for sequential reads \
+	 \n   -prefetch <max>  = Read ahead up to <max> queued files while processing, adapting to I/O latency (max: 64) \
+	 \n   -recursive       = Also find files in every subdirectory of each root \
+	 \n   -results <file>  = Write every match to <file> (<file>.<rank> in fsch; - for stdout) as structured records, buffered per thread \
+	 \n   -root <dir>      = Also find files in <dir> (can be given more than once) \
+	 \n   -rma             = Nodes claim files themselves from a catalog the central machine publishes in an RMA window (fsch only) \
+	 \n   -shm             = Nodes on a host share one file queue in shared memory, and files are sent per host (fsch only) \
+	 \n   -sla <secs>      = Files are due <secs> seconds after their timestamp; report misses and lateness (default with -edf: 60) \
+	 \n   -speculate <pct> = Once every file has been sent, copy files running longer than <pct>%% of files took onto idle nodes; the first copy to finish wins (fsch only) \
+	 \n   -status <socket> = Serve a JSON snapshot of progress, throughput and ETA on a UNIX socket at <socket> (fsch only) \
+	 \n   -t <threads>     = Number of worker threads (fsch_threads only; default: one per core) \
+	 \n   -timing <file>   = Write a JSON summary of per-phase wall-clock timings to <file> (- for stdout) \
+	 \n   -trace <file>    = Write a Chrome/Perfetto trace of every file's lifecycle to <file> \
+	 \n   -v <level>       = 0 prints only summaries, 1 also prints every match (default), 2 also prints every file moved \
+	 \n   -walkers <n>     = Number of threads walking directories (default: 4 with -recursive or -root, otherwise 1) \
+	 \n   -where <query>   = Only match files that also satisfy <query>, e.g. \"threatlevel > 900 AND malwarecount > 0\"\n", prog)
+
+/* Static function prototypes */
+
+/*
+ * Copies a directory argument, appending a '/' if it doesn't end with one.
+ * Params: dir - the directory argument.
+ * Returns: a malloc()'d copy of the directory ending with '/'.
+ */
+static char* dir_string(char *dir);
+
+/* univ.h extern variables */
+char *file_dir_str;
+char *archive_dir_str;
+char *search_key;
+int proc_count;
+int proc_id;
+int sched_type;
+int priority_option;
+int thread_count;
+char *timing_path = NULL;
+char *trace_path = NULL;
+char *status_path = NULL;
+int hier_enabled = 0;
+int hier_group_max = 0;
+int hier_chunk = 256;
+int shm_enabled = 0;
+int rma_enabled = 0;
+int rma_claim = 16;
+int speculate_pct = 0;
+
+int parse_args(int argc, char *argv[])
+{
+	//Make sure we have file and archive directories and search key to work with
+	if(argc < 4)
+	{
+		PRINT_USAGE(argv[0]);
+		return -1;
+	}
+	
+	//Set the file and archive directories to work with
+	file_dir_str = dir_string(argv[1]);
+	archive_dir_str = dir_string(argv[2]);
+	walk_add_root(file_dir_str);	//The file directory is always the first root
+	
+	//Get the word to search for
+	search_key = malloc(strlen(argv[3]) + 1);
+	strcpy(search_key, argv[3]);
+	
+	//First, set the default scheduling algorithm, priority option and thread count
+	sched_type = CYCLIC;
+	priority_option = NO_PRIORITY;
+	thread_count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	
+	//Then go through whatever options the user specified
+	for(int i = 4; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-c"))
+			sched_type = CYCLIC;
+		else if(!strcmp(argv[i], "-b"))
+			sched_type = BLOCK;
+		else if(!strcmp(argv[i], "-r"))
+			sched_type = RANDOM;
+		else if(!strcmp(argv[i], "-qs"))
+			sched_type = QUEUE_SIZE;
+		else if(!strcmp(argv[i], "-ql"))
+			sched_type = QUEUE_LENGTH;
+		else if(!strcmp(argv[i], "-n"))
+			priority_option = NO_PRIORITY;
+		else if(!strcmp(argv[i], "-op"))
+			priority_option = OLDEST_FILE_PRIORITY;
+		else if(!strcmp(argv[i], "-edf"))
+			priority_option = DEADLINE_PRIORITY;
+		else if(!strcmp(argv[i], "-agg") && i + 1 < argc)
+			agg_key = argv[++i];
+		else if(!strcmp(argv[i], "-bucket") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			agg_bucket = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-bind") && i + 1 < argc && !strcmp(argv[i + 1], "core"))
+		{
+			bind_mode = BIND_CORE;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-bind") && i + 1 < argc && !strcmp(argv[i + 1], "numa"))
+		{
+			bind_mode = BIND_NUMA;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-cpus") && i + 1 < argc)
+			bind_cpus = argv[++i];
+		else if(!strcmp(argv[i], "-dedup"))
+			dedup_enabled = 1;
+		else if(!strcmp(argv[i], "-hier"))
+			hier_enabled = 1;
+		else if(!strcmp(argv[i], "-recursive"))
+			walk_recursive = 1;
+		else if(!strcmp(argv[i], "-root") && i + 1 < argc)
+			walk_add_root(dir_string(argv[++i]));
+		else if(!strcmp(argv[i], "-walkers") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			walk_threads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-results") && i + 1 < argc)
+			result_path = argv[++i];
+		else if(!strcmp(argv[i], "-rma"))
+			rma_enabled = 1;
+		else if(!strcmp(argv[i], "-claim") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			rma_claim = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-shm"))
+			shm_enabled = 1;
+		else if(!strcmp(argv[i], "-group") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			hier_group_max = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-chunk") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			hier_chunk = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-credits") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			credit_files = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-creditbytes") && i + 1 < argc && atoll(argv[i + 1]) > 0)
+			credit_bytes = atoll(argv[++i]);
+		else if(!strcmp(argv[i], "-format") && i + 1 < argc && !strcmp(argv[i + 1], "ndjson"))
+		{
+			result_format = RESULT_NDJSON;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-format") && i + 1 < argc && !strcmp(argv[i + 1], "binary"))
+		{
+			result_format = RESULT_BINARY;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-layout") && i + 1 < argc && !strcmp(argv[i + 1], "inode"))
+		{
+			layout_order = LAYOUT_INODE;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-layout") && i + 1 < argc && !strcmp(argv[i + 1], "extent"))
+		{
+			layout_order = LAYOUT_EXTENT;
+			i++;
+		}
+		else if(!strcmp(argv[i], "-prefetch") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+		{
+			prefetch_max = atoi(argv[++i]);
+			
+			if(prefetch_max > PREFETCH_MAX_DEPTH)
+				prefetch_max = PREFETCH_MAX_DEPTH;
+		}
+		else if(!strcmp(argv[i], "-sla") && i + 1 < argc && atoi(argv[i + 1]) > 0)
+			sla_seconds = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-speculate") && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) < 100)
+			speculate_pct = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-status") && i + 1 < argc)
+			status_path = argv[++i];
+		else if(!strcmp(argv[i], "-t") && i + 1 < argc)
+			thread_count = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-timing") && i + 1 < argc)
+		{
+			timing_path = argv[++i];
+			timing_enabled = 1;
+		}
+		else if(!strcmp(argv[i], "-trace") && i + 1 < argc)
+		{
+			trace_path = argv[++i];
+			trace_enabled = 1;
+		}
+		else if(!strcmp(argv[i], "-v") && i + 1 < argc && isdigit((unsigned char) argv[i + 1][0]))
+			verbosity = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-where") && i + 1 < argc)
+		{
+			//Compile the query once, up front, so a bad one stops us before we start
+			char err[128];
+			
+			if((search_query = query_compile(argv[++i], err, sizeof(err))) == NULL)
+			{
+				fprintf(stderr, "Bad query: %s\n", err);
+				return -1;
+			}
+		}
+		else
+		{
+			PRINT_USAGE(argv[0]);
+			return -1;
+		}
+	}
+	
+	//Scheduling by deadline needs deadlines
+	if(priority_option == DEADLINE_PRIORITY && sla_seconds == 0)
+		sla_seconds = SLA_DEFAULT_SECONDS;
+	
+	//Nodes claiming their own files don't need anyone to hand files out
+	if(rma_enabled && (hier_enabled || shm_enabled) && proc_id == CENTRAL)
+		fprintf(stderr, "Warning: with -rma, every node claims its own files, so %s ignored\n",
+			(hier_enabled && shm_enabled) ? "-hier and -shm are" : (hier_enabled ? "-hier is" : "-shm is"));
+	
+	if(rma_enabled)
+		hier_enabled = shm_enabled = 0;
+	
+	//Groups already share out each host's files, so they don't need a shared queue too
+	if(hier_enabled && shm_enabled && proc_id == CENTRAL)
+		fprintf(stderr, "Warning: with -hier, each group already shares out its files, so -shm is ignored\n");
+	
+	if(hier_enabled)
+		shm_enabled = 0;
+	
+	//Copying stragglers needs the central machine to send out every file itself, and dedup's claims would count copies twice
+	if(speculate_pct > 0 && (hier_enabled || shm_enabled || rma_enabled || dedup_enabled) && proc_id == CENTRAL)
+		fprintf(stderr, "Warning: -speculate doesn't work with %s, so it's ignored\n",
+			hier_enabled ? "-hier" : (shm_enabled ? "-shm" : (rma_enabled ? "-rma" : "-dedup")));
+	
+	if(hier_enabled || shm_enabled || rma_enabled || dedup_enabled)
+		speculate_pct = 0;
+	
+	//A CPU list on its own means pinning to each CPU
+	if(bind_cpus != NULL && bind_mode == BIND_NONE)
+		bind_mode = BIND_CORE;
+	
+	//We always need at least one worker
+	if(thread_count < 1)
+		thread_count = 1;
+	
+	//The query has to record the aggregated key's value, so this waits until we have the whole query
+	if(agg_key != NULL && agg_init())
+	{
+		fprintf(stderr, "Bad query: too many keys\n");
+		return -1;
+	}
+	
+	return 0;
+}
+
+long long now_ns()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static char* dir_string(char *dir)
+{
+	int len = strlen(dir);
+	char *retval = malloc(len + 2);	//Leave room for a '/' and the terminator
+	strcpy(retval, dir);
+	
+	//If the directory doesn't end with '/', we need to append it
+	if(len == 0 || retval[len - 1] != '/')
+		strcat(retval, "/");
+	
+	return retval;
+}
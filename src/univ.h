@@ -1,7 +1,7 @@
 #ifndef UNIV_H_INCLUDED
 #define UNIV_H_INCLUDED
 
-//This is basically a header for main.c
+//This is basically a header for univ.c, which every build links
 
 #define CENTRAL 0
 #define FILE_NAME_LEN 80
@@ -19,7 +19,8 @@ enum {
 /* Priority options */
 enum {
 	NO_PRIORITY,
-	OLDEST_FILE_PRIORITY
+	OLDEST_FILE_PRIORITY,
+	DEADLINE_PRIORITY
 };
 
 /* MPI tags */
@@ -29,7 +30,17 @@ enum {
 	FILE_PRIORITY_TAG,
 	STOP_TAG,
 	ARCHIVE_TAG,
-	QUEUE_DATA_TAG
+	QUEUE_DATA_TAG,
+	ARCHIVE_RECORD_TAG,
+	AGG_TAG,
+	CHUNK_REQUEST_TAG,
+	FILE_CHUNK_TAG,
+	DEDUP_TAG,
+	DEDUP_REPLY_TAG,
+	FILE_DONE_TAG,
+	PROGRESS_TAG,
+	SPEC_TAG,
+	SPEC_REPLY_TAG
 };
 
 /* Represents a key/value pair */
@@ -47,6 +58,36 @@ extern int proc_count;			//Number of nodes (including central node)
 extern int proc_id;				//Processor ID of this specific instance
 extern int sched_type;			//Scheduling algorithm to use
 extern int priority_option;		//Prority option to use
+extern int thread_count;		//Number of worker threads (fsch_threads only)
+extern char *timing_path;		//Where to write the per-phase timing summary, or NULL if we're not timing
+extern char *trace_path;		//Where to write the Chrome trace, or NULL if we're not tracing
+extern char *status_path;		//Where to listen for status connections (fsch only), or NULL if we're not
+extern int hier_enabled;		//1 if nodes are grouped under sub-coordinators (fsch only); 0 otherwise
+extern int hier_group_max;		//Most nodes in a group, or 0 to group every node on a host together
+extern int hier_chunk;			//Files the central machine hands a sub-coordinator at a time
+extern int shm_enabled;			//1 if the nodes on a host share one file queue (fsch only); 0 otherwise
+extern int rma_enabled;			//1 if nodes claim files from a catalog in an RMA window (fsch only); 0 otherwise
+extern int rma_claim;			//Files a node claims from the catalog at a time
+extern int speculate_pct;		//Percentile of file times a running file has to pass to be copied (fsch only), or 0 if we're not copying
+
+/* Universal functions */
+
+/*
+ * Parses the command line shared by every build: the file directory, archive
+ * directory and search key, followed by any options in any order. Prints the
+ * usage message if the command line doesn't make sense.
+ * Params: argc - the number of arguments.
+ *         argv - the arguments.
+ * Returns: 0 if the command line was valid; a nonzero value otherwise.
+ */
+int parse_args(int argc, char *argv[]);
+
+/*
+ * Gets the time, for measuring how long something took.
+ * Params: nothing
+ * Returns: the monotonic time in nanoseconds.
+ */
+long long now_ns();
 
 #endif //UNIV_H_INCLUDED
 
@@ -0,0 +1,310 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "walk.h"
+
+/* Defines a directory a walker still has to read */
+typedef struct _walk_dir_t {
+	int root;		//Index of the root it's under
+	char *path;		//Its path relative to the root ("" or ending with '/'), malloc()'d
+} walk_dir_t;
+
+/* Defines a walker's stack of directories, which other walkers can steal from */
+typedef struct _walk_stack_t {
+	walk_dir_t *dirs;		//Directories; the oldest is at bottom and the newest just below top
+	int bottom;				//Index of the oldest directory
+	int top;				//Index just past the newest directory
+	int capacity;			//Number of directories there's room for
+	pthread_mutex_t mutex;	//Protects everything above
+} walk_stack_t;
+
+/* Static function prototypes */
+
+/*
+ * The function every walker runs: reads directories off its own stack, or
+ * steals them, until every directory has been read.
+ * Params: arg - a pointer to the walker's index.
+ * Returns: NULL every time.
+ */
+static void* walker_func(void *arg);
+
+/*
+ * Reads a directory, pushing its subdirectories onto a walker's stack and
+ * calling the walk function for everything else.
+ * Params: id - the walker's index.
+ *         dir - the directory.
+ * Returns: nothing
+ */
+static void read_dir(int id, walk_dir_t *dir);
+
+/*
+ * Pushes a directory onto a walker's stack.
+ * Params: id - the walker's index.
+ *         root - the index of the root the directory is under.
+ *         path - its path relative to the root, malloc()'d.
+ * Returns: nothing
+ */
+static void push_dir(int id, int root, char *path);
+
+/*
+ * Takes a directory to read: the newest from a walker's own stack, or failing
+ * that, the oldest from somebody else's.
+ * Params: id - the walker's index.
+ *         dir - where to put the directory.
+ * Returns: 1 if there was a directory to take; 0 otherwise.
+ */
+static int take_dir(int id, walk_dir_t *dir);
+
+/* walk.h extern variables */
+char **walk_roots = NULL;
+int walk_root_count = 0;
+int walk_recursive = 0;
+int walk_threads = 0;
+
+/* Static variables */
+static walk_func_t walk_func;			//Function to call for every entry
+static walk_stack_t *stacks = NULL;		//Every walker's stack
+static int num_walkers = 0;				//Number of walkers
+static int dirs_left = 0;				//Directories pushed but not read yet
+static int pushes = 0;					//Number of directories ever pushed, so idle walkers can tell if they missed one
+static pthread_mutex_t left_mutex = PTHREAD_MUTEX_INITIALIZER;	//Protects dirs_left and pushes
+static pthread_cond_t left_cond = PTHREAD_COND_INITIALIZER;		//Signaled when a directory is pushed or the last one is read
+
+void walk_add_root(char *dir)
+{
+	walk_roots = realloc(walk_roots, sizeof(char*) * (walk_root_count + 1));
+	walk_roots[walk_root_count++] = dir;
+}
+
+void walk(walk_func_t func)
+{
+	walk_func = func;
+	num_walkers = (walk_threads > 0) ? walk_threads : (walk_recursive || walk_root_count > 1) ? WALK_DEFAULT_THREADS : 1;
+	stacks = malloc(sizeof(walk_stack_t) * num_walkers);
+	
+	for(int i = 0; i < num_walkers; i++)
+	{
+		stacks[i].capacity = 16;
+		stacks[i].dirs = malloc(sizeof(walk_dir_t) * stacks[i].capacity);
+		stacks[i].bottom = stacks[i].top = 0;
+		pthread_mutex_init(&(stacks[i].mutex), NULL);
+	}
+	
+	//Deal the roots out, last first, so the first walker reads the first root first
+	for(int i = walk_root_count - 1; i >= 0; i--)
+	{
+		char *path = malloc(1);
+		path[0] = '\0';
+		push_dir(i % num_walkers, i, path);
+	}
+	
+	//We're the first walker
+	pthread_t *threads = malloc(sizeof(pthread_t) * num_walkers);
+	int *ids = malloc(sizeof(int) * num_walkers);
+	
+	for(int i = 0; i < num_walkers; i++)
+	{
+		ids[i] = i;
+		
+		if(i > 0)
+			pthread_create(&threads[i], NULL, walker_func, &ids[i]);
+	}
+	
+	walker_func(&ids[0]);
+	
+	for(int i = 1; i < num_walkers; i++)
+		pthread_join(threads[i], NULL);
+	
+	for(int i = 0; i < num_walkers; i++)
+	{
+		free(stacks[i].dirs);
+		pthread_mutex_destroy(&(stacks[i].mutex));
+	}
+	
+	free(stacks);
+	free(threads);
+	free(ids);
+	stacks = NULL;
+	pushes = 0;
+}
+
+void walk_cleanup()
+{
+	for(int i = 1; i < walk_root_count; i++)
+		free(walk_roots[i]);
+	
+	free(walk_roots);
+	walk_roots = NULL;
+	walk_root_count = 0;
+}
+
+//This returns void* and takes in void* because pthread needs it to
+static void* walker_func(void *arg)
+{
+	int id = *((int*) arg);
+	
+	if(id > 0)
+		trace_thread_name("walk");
+	
+	for(;;)
+	{
+		//Note how many directories have been pushed before looking, so we can't sleep through one
+		pthread_mutex_lock(&left_mutex);
+		int seen = pushes;
+		pthread_mutex_unlock(&left_mutex);
+		
+		walk_dir_t dir;
+		
+		if(take_dir(id, &dir))
+		{
+			read_dir(id, &dir);
+			free(dir.path);
+			
+			//If that was the last directory, wake everyone up so they can stop
+			pthread_mutex_lock(&left_mutex);
+			
+			if(--dirs_left == 0)
+				pthread_cond_broadcast(&left_cond);
+			
+			pthread_mutex_unlock(&left_mutex);
+			continue;
+		}
+		
+		//Nothing to take: either we're done, or somebody's still reading a directory that might have subdirectories
+		pthread_mutex_lock(&left_mutex);
+		
+		while(dirs_left > 0 && pushes == seen)
+			pthread_cond_wait(&left_cond, &left_mutex);
+		
+		int done = (dirs_left == 0);
+		pthread_mutex_unlock(&left_mutex);
+		
+		if(done)
+			break;
+	}
+	
+	return NULL;
+}
+
+static void read_dir(int id, walk_dir_t *dir)
+{
+	//Open it by its full path
+	size_t root_len = strlen(walk_roots[dir->root]), path_len = strlen(dir->path);
+	char *full = malloc(root_len + path_len + 1);
+	memcpy(full, walk_roots[dir->root], root_len);
+	memcpy(full + root_len, dir->path, path_len + 1);
+	
+	DIR *d = opendir(full);
+	free(full);
+	
+	if(d == NULL)
+		return;	//It's gone or we can't read it, so there's nothing in it for us
+	
+	int fd = dirfd(d);
+	struct dirent *entry;
+	
+	while((entry = readdir(d)) != NULL)
+	{
+		//Hidden entries (including . and ..) are never walked into
+		int is_dir = 0;
+		
+		if(walk_recursive && entry->d_name[0] != '.')
+		{
+			struct stat st;
+			
+			//Some filesystems don't say what an entry is, so we have to ask
+			if(entry->d_type == DT_DIR)
+				is_dir = 1;
+			else if(entry->d_type == DT_UNKNOWN)
+				is_dir = !fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode);
+		}
+		
+		if(is_dir)
+		{
+			size_t name_len = strlen(entry->d_name);
+			char *sub = malloc(path_len + name_len + 2);
+			memcpy(sub, dir->path, path_len);
+			memcpy(sub + path_len, entry->d_name, name_len);
+			sub[path_len + name_len] = '/';
+			sub[path_len + name_len + 1] = '\0';
+			push_dir(id, dir->root, sub);
+		}
+		else
+			walk_func(dir->root, dir->path, entry->d_name, fd);
+	}
+	
+	closedir(d);
+}
+
+static void push_dir(int id, int root, char *path)
+{
+	walk_stack_t *stack = &(stacks[id]);
+	pthread_mutex_lock(&(stack->mutex));
+	
+	//If we've run out of room, slide everything back to the start, then grow if that's not enough
+	if(stack->top == stack->capacity)
+	{
+		int count = stack->top - stack->bottom;
+		memmove(stack->dirs, stack->dirs + stack->bottom, sizeof(walk_dir_t) * count);
+		stack->bottom = 0;
+		stack->top = count;
+		
+		if(count == stack->capacity)
+		{
+			stack->capacity *= 2;
+			stack->dirs = realloc(stack->dirs, sizeof(walk_dir_t) * stack->capacity);
+		}
+	}
+	
+	stack->dirs[stack->top].root = root;
+	stack->dirs[stack->top].path = path;
+	stack->top++;
+	pthread_mutex_unlock(&(stack->mutex));
+	
+	//Let idle walkers know there's something to steal
+	pthread_mutex_lock(&left_mutex);
+	dirs_left++;
+	pushes++;
+	pthread_cond_broadcast(&left_cond);
+	pthread_mutex_unlock(&left_mutex);
+}
+
+static int take_dir(int id, walk_dir_t *dir)
+{
+	//Our own newest directory first
+	walk_stack_t *stack = &(stacks[id]);
+	pthread_mutex_lock(&(stack->mutex));
+	
+	if(stack->top > stack->bottom)
+	{
+		*dir = stack->dirs[--stack->top];
+		pthread_mutex_unlock(&(stack->mutex));
+		return 1;
+	}
+	
+	pthread_mutex_unlock(&(stack->mutex));
+	
+	//Then everybody else's oldest, starting with the next walker
+	for(int i = 1; i < num_walkers; i++)
+	{
+		stack = &(stacks[(id + i) % num_walkers]);
+		pthread_mutex_lock(&(stack->mutex));
+		
+		if(stack->top > stack->bottom)
+		{
+			*dir = stack->dirs[stack->bottom++];
+			pthread_mutex_unlock(&(stack->mutex));
+			return 1;
+		}
+		
+		pthread_mutex_unlock(&(stack->mutex));
+	}
+	
+	return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef WALK_H_INCLUDED
+#define WALK_H_INCLUDED
+
+/*
+ * Finds files under any number of input roots: the file directory, plus one
+ * for every -root <dir>. With -recursive, every subdirectory (except hidden
+ * ones) is walked too, e.g. a landing zone laid out as <root>/<date>/<sensor>/.
+ * Archived files keep their place under the archive directory, with every root
+ * but the file directory under root<n>/, so files with the same name under
+ * different roots or subdirectories never collide.
+ *
+ * The walk is done by a pool of walker threads. Each walker has its own stack
+ * of directories it still has to read: it pushes the subdirectories it finds
+ * onto its own stack and pops the newest, so it goes depth-first through its
+ * part of the tree. A walker whose stack is empty steals the oldest directory
+ * from another walker's stack, which is usually the closest to a root and so
+ * the biggest piece of work left. That keeps every walker busy reading
+ * directories, so the walk scales with however many directory reads the
+ * filesystem can do at once.
+ */
+
+#define WALK_DEFAULT_THREADS 4	//Walkers with -recursive or more than one root, unless -walkers says otherwise
+
+/*
+ * A function that's called for every entry in every directory that isn't a
+ * subdirectory being walked. It's called from every walker at once.
+ * Params: root - the index of the root the entry is under.
+ *         path - the entry's directory, relative to the root ("" or ending
+ *         with '/').
+ *         name - the entry's name.
+ *         dir_fd - a descriptor for the entry's directory, for *at() calls.
+ * Returns: nothing
+ */
+typedef void (*walk_func_t)(int root, char *path, char *name, int dir_fd);
+
+/* Walk variables */
+extern char **walk_roots;		//Every input root, each ending with '/'; walk_roots[0] is the file directory
+extern int walk_root_count;		//Number of roots in walk_roots
+extern int walk_recursive;		//1 if subdirectories are walked too; 0 otherwise
+extern int walk_threads;		//Number of walkers, or 0 to pick
+
+/* Walk functions */
+
+/*
+ * Adds an input root.
+ * Params: dir - the root, ending with '/'. The walk owns it from now on.
+ * Returns: nothing
+ */
+void walk_add_root(char *dir);
+
+/*
+ * Walks every root, calling a function for every entry found, and waits for
+ * the walk to finish. The calling thread is one of the walkers.
+ * Params: func - the function to call for every entry.
+ * Returns: nothing
+ */
+void walk(walk_func_t func);
+
+/*
+ * Frees every root but the first (that's file_dir_str, which is freed on its
+ * own).
+ * Params: nothing
+ * Returns: nothing
+ */
+void walk_cleanup();
+
+#endif //WALK_H_INCLUDED